@@ -1,5 +1,6 @@
 import argparse 
 import os
+import struct
 import subprocess
 import shutil
 
@@ -7,14 +8,290 @@ import shutil
 BUILD_DIRECTORY = 'embed_build'
 EMBEDDED_VAR_NAME = '__embedded_program'
 EMBED_H_PATH = 'src/cg1/embed.h'
+EMBED_AOT_H_PATH = 'src/cg1/embed_aot.h'
 OUTPUT_EXECUTABLE_NAME = 'cg1'
 
 CMAKE_BASE_COMMAND = ['cmake', '-B', BUILD_DIRECTORY, '-DG1_EMBEDDED=ON']
 
 MINGW_TOOLCHAIN_PATH = 'mingw-w64-toolchain.cmake'
 
+# Opcode names in `instruction.h` and their argument counts
+OPCODES = [
+    'OP_MOV', 'OP_MOVP', 'OP_ADD', 'OP_SUB', 'OP_MUL', 'OP_DIV', 'OP_MOD', 'OP_LESS', 'OP_EQUAL', 'OP_NOT',
+    'OP_JMP', 'OP_COLOR', 'OP_POINT', 'OP_LINE', 'OP_RECT', 'OP_PUTC', 'OP_GETP', 'OP_SETCH', 'OP_CALL', 'OP_RET',
+    'OP_AND', 'OP_OR', 'OP_XOR', 'OP_SHL', 'OP_SHR', 'OP_SAR',
+    'OP_SIN', 'OP_COS', 'OP_SQRT', 'OP_ABS', 'OP_MIN', 'OP_MAX', 'OP_ATAN2',
+    'OP_MEMFILL', 'OP_MEMCOPY', 'OP_MEMCMP', 'OP_BLIT', 'OP_BLITKEY', 'OP_COPYRECT', 'OP_TRI'
+]
+ARGUMENT_COUNTS = [2, 2, 3, 3, 3, 3, 3, 3, 3, 2, 2, 3, 2, 4, 4, 1, 3, 4, 1, 0, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 3, 3, 3, 3, 3, 4, 3, 4, 3, 1]
+ARGUMENT_ADDRESS = 1
 
-def build(input_path: str, output_path: str, show_fps: bool, scale: int, title: str, static: bool, windows: bool):
+# g1b signatures, see `program.c`. Versioned programs have a uint16 version after the signature.
+G1B_SIGNATURE = 0x6731
+G1B_VERSIONED_SIGNATURE = 0x6756
+
+# Shortest equal/jmp chain that is translated to a switch, like `MIN_JUMP_TABLE_CASES` in `jump_table.h`
+MIN_JUMP_TABLE_CASES = 4
+
+# C expressions for the instructions that store a value, in terms of their source operands `a` and `b`
+STORE_EXPRESSIONS = {
+    'OP_MOV': '{a}',
+    'OP_ADD': '(int32_t) ((uint32_t) {a} + (uint32_t) {b})',
+    'OP_SUB': '(int32_t) ((uint32_t) {a} - (uint32_t) {b})',
+    'OP_MUL': '(int32_t) ((uint32_t) {a} * (uint32_t) {b})',
+    'OP_DIV': '{a} / {b}',
+    'OP_MOD': '_floored_mod({a}, {b})',
+    'OP_LESS': '{a} < {b}',
+    'OP_EQUAL': '{a} == {b}',
+    'OP_NOT': '!{a}',
+    'OP_AND': '{a} & {b}',
+    'OP_OR': '{a} | {b}',
+    'OP_XOR': '{a} ^ {b}',
+    'OP_SHL': 'shift_left({a}, {b})',
+    'OP_SHR': 'shift_right({a}, {b})',
+    'OP_SAR': 'shift_right_arithmetic({a}, {b})',
+    'OP_SIN': 'fixed_sin({a})',
+    'OP_COS': 'fixed_cos({a})',
+    'OP_SQRT': 'fixed_sqrt({a})',
+    'OP_ABS': 'fixed_abs({a})',
+    'OP_MIN': 'fixed_min({a}, {b})',
+    'OP_MAX': 'fixed_max({a}, {b})',
+    'OP_ATAN2': 'fixed_atan2({a}, {b})'
+}
+
+
+def read_program(program_bytes: bytes) -> dict:
+    """Read the metadata and instructions of a .g1b program."""
+    signature, = struct.unpack_from('>H', program_bytes)
+    offset = 2
+    if signature == G1B_VERSIONED_SIGNATURE:
+        offset += 2
+    elif signature != G1B_SIGNATURE:
+        raise ValueError('Input is not a g1b program')
+    memory_size, _, _, _, tick_index, start_index, instruction_count = struct.unpack_from('>iHHHiiI', program_bytes, offset)
+
+    instructions = []
+    offset += struct.calcsize('>iHHHiiI')
+    for _ in range(instruction_count):
+        opcode = program_bytes[offset]
+        offset += 1
+        arguments = []
+        for _ in range(ARGUMENT_COUNTS[opcode]):
+            arguments.append(struct.unpack_from('>Bi', program_bytes, offset))
+            offset += 5
+        instructions.append((OPCODES[opcode], arguments))
+
+    return {'memory_size': memory_size, 'start': start_index, 'tick': tick_index, 'instructions': instructions}
+
+
+def c_int(value: int) -> str:
+    return '(-2147483647-1)' if value == -2**31 else str(value)
+
+
+def translate_instruction(index: int, opcode: str, arguments: list, memory_size: int, instruction_count: int) -> list[str]:
+    """
+    Translate one instruction to C statements. Any check that fails passes the instruction to `_aot_raise`,
+    before the instruction has changed anything.
+    """
+    modes = sum(1 << i for i, (kind, _) in enumerate(arguments) if kind == ARGUMENT_ADDRESS)
+    operands = ', '.join(c_int(value) for _, value in arguments)
+    exit_statement = (
+        f'return _aot_raise(program_context, raised_error, {index}, '
+        f'&(DecodedInstruction) {{.opcode = {opcode}, .modes = {modes}, .operands = {{{operands}}}}});'
+    )
+
+    def in_memory(address: int) -> bool:
+        return 0 <= address < memory_size
+
+    def source(argument: tuple) -> str | None:
+        kind, value = argument
+        if kind != ARGUMENT_ADDRESS:
+            return c_int(value)
+        return f'm[{value}]' if in_memory(value) else None
+
+    sources = [source(argument) for argument in arguments]
+    if None in sources:
+        return [exit_statement]
+
+    def jump_to(argument: tuple) -> str:
+        kind, target = argument
+        if kind == ARGUMENT_ADDRESS:
+            return f'{{ index = (uint32_t) {source(argument)}; goto dispatch; }}'
+        return f'goto i{target};' if 0 <= target < instruction_count else 'goto halt;'
+
+    # Calls and returns share the interpreter's return stack, so the interpreter can return from calls made here.
+    # A call or return the stack can't take raises a runtime error, or ends the thread in unchecked threads.
+    def call_stack_error(raise_error: str) -> str:
+        return f'{{ if (checked) {{ {raise_error}(); return _aot_error(raised_error, {index}); }} goto halt; }}'
+
+    if opcode == 'OP_CALL':
+        return [
+            f'if (!_push_call(program_context, {index+1}, {index+1})) {call_stack_error("_call_stack_overflow_error")}',
+            jump_to(arguments[0])
+        ]
+
+    if opcode == 'OP_RET':
+        return [
+            'const CallFrame *frame = _pop_call(program_context);',
+            f'if (!frame) {call_stack_error("_call_stack_underflow_error")}',
+            'index = (uint32_t) frame->address;',
+            'goto dispatch;'
+        ]
+
+    if opcode == 'OP_JMP':
+        condition_kind, condition = arguments[1]
+        jump = jump_to(arguments[0])
+        if condition_kind != ARGUMENT_ADDRESS:
+            return [jump] if condition else []
+        return [f'if ({sources[1]}) {jump}']
+
+    if opcode not in STORE_EXPRESSIONS and opcode != 'OP_MOVP':
+        # Graphics, text and audio instructions run through the interpreter's implementation
+        return [
+            f'if (_run_instruction(program_context, {opcode}, (int32_t[]) {{{", ".join(sources)}}}) && checked) '
+            f'return _aot_error(raised_error, {index});'
+        ]
+
+    statements = []
+    dest_kind, dest = arguments[0]
+    if dest_kind == ARGUMENT_ADDRESS:
+        statements.append(f'int32_t dest = {sources[0]};')
+        dest = 'dest'
+    elif not in_memory(dest):
+        return [exit_statement]
+
+    if opcode == 'OP_MOVP':
+        statements.append(f'int32_t pointer = {sources[1]};')
+        statements.append(f'if (checked && (uint32_t) pointer >= {memory_size}u) {exit_statement}')
+        value = 'm[pointer]'
+    else:
+        divisor_kind, divisor = arguments[2] if len(arguments) > 2 else (None, None)
+        if opcode in ('OP_DIV', 'OP_MOD') and (divisor_kind == ARGUMENT_ADDRESS or divisor == 0):
+            statements.append(f'if (checked && {sources[2]} == 0) {exit_statement}')
+        value = STORE_EXPRESSIONS[opcode].format(a=sources[1], b=sources[2] if len(sources) > 2 else None)
+
+    if dest == 'dest':
+        statements.append(f'if (checked && (uint32_t) dest >= {memory_size}u) {exit_statement}')
+    statements.append(f'm[{dest}] = {value};')
+    return statements
+
+
+def find_jump_chain(instructions: list, head: int, memory_size: int) -> tuple | None:
+    """
+    Find a chain of `equal result $subject key` / `jmp target $result` pairs starting at `head`.
+    Returns the subject slot, the result slot and the (key, target) of each comparison, or `None`.
+    """
+    subject = result = None
+    cases = []
+    for index in range(head, len(instructions) - 1, 2):
+        (compare_opcode, compare_arguments), (jump_opcode, jump_arguments) = instructions[index], instructions[index+1]
+        if compare_opcode != 'OP_EQUAL' or jump_opcode != 'OP_JMP' or compare_arguments[0][0] == ARGUMENT_ADDRESS:
+            break
+        kinds = [kind for kind, _ in compare_arguments[1:]]
+        if sorted(kinds) != [0, ARGUMENT_ADDRESS]:
+            break
+        case_subject = compare_arguments[1 + kinds.index(ARGUMENT_ADDRESS)][1]
+        key = compare_arguments[2 - kinds.index(ARGUMENT_ADDRESS)][1]
+        case_result = compare_arguments[0][1]
+        if jump_arguments[0][0] == ARGUMENT_ADDRESS or jump_arguments[1] != (ARGUMENT_ADDRESS, case_result):
+            break
+        if cases and (case_subject, case_result) != (subject, result):
+            break
+        subject, result = case_subject, case_result
+        cases.append((key, jump_arguments[0][1]))
+
+    if len(cases) < MIN_JUMP_TABLE_CASES or subject == result or not (0 <= subject < memory_size and 0 <= result < memory_size):
+        return None
+    return subject, result, cases
+
+
+def translate_jump_chain(head: int, chain: tuple, instruction_count: int) -> list[str]:
+    """Translate an equal/jmp chain to a switch on its subject, leaving the result slot as the chain would."""
+    subject, result, cases = chain
+    statements = [f'switch (m[{subject}]) {{']
+    keys = set()
+    for key, target in cases:
+        # Only the first comparison against a key can match
+        if key not in keys:
+            keys.add(key)
+            jump = f'goto i{target};' if 0 <= target < instruction_count else 'goto halt;'
+            statements.append(f'    case {c_int(key)}: m[{result}] = 1; {jump}')
+    statements.append('}')
+    statements.append(f'm[{result}] = 0;')
+    end = head + 2 * len(cases)
+    statements.append(f'goto i{end};' if end < instruction_count else 'goto halt;')
+    return statements
+
+
+def translate_program(program: dict, input_name: str) -> str:
+    """
+    Translate a program to the C function `_run_embedded_aot`, which `instruction_impl.h` runs in place of the interpreter.
+    Each instruction becomes a labelled block of C, literal jumps become `goto`s and computed jumps go through a switch.
+    Chains of comparisons against one slot become a switch on that slot, see `find_jump_chain`.
+    """
+    instructions = program['instructions']
+    instruction_count = len(instructions)
+    memory_size = program['memory_size']
+
+    jump_chains = {}
+    index = 0
+    while index < instruction_count:
+        chain = find_jump_chain(instructions, index, memory_size)
+        if chain:
+            jump_chains[index] = chain
+            index += 2 * len(chain[2])
+        else:
+            index += 1
+
+    # Label every instruction a jump can reach. A computed jump or a return can reach any of them.
+    computed_jumps = any(
+        (opcode in ('OP_JMP', 'OP_CALL') and arguments[0][0] == ARGUMENT_ADDRESS) or opcode == 'OP_RET'
+        for opcode, arguments in instructions
+    )
+    if computed_jumps:
+        labels = set(range(instruction_count))
+    else:
+        labels = {program['start'], program['tick']}
+        for opcode, arguments in instructions:
+            if opcode in ('OP_JMP', 'OP_CALL'):
+                labels.add(arguments[0][1])
+        labels.update(head + 2 * len(chain[2]) for head, chain in jump_chains.items())
+        labels = {label for label in labels if 0 <= label < instruction_count}
+
+    lines = [
+        '/*',
+        f'    Generated by embed.py from "{input_name}", do not edit.',
+        '*/',
+        '',
+        'static size_t _run_embedded_aot(ProgramContext *program_context, size_t index, bool *raised_error) {',
+        '    int32_t *m = program_context->memory;',
+        '    const bool checked = _AOT_CHECKED;',
+        '    (void) checked;',
+        ''
+    ]
+    if computed_jumps:
+        lines.append('dispatch:')
+    lines.append('    switch (index) {')
+    lines.extend(f'        case {label}: goto i{label};' for label in sorted(labels))
+    lines.extend(['        default: goto halt;', '    }', ''])
+
+    for index, (opcode, arguments) in enumerate(instructions):
+        if index in labels:
+            lines.append(f'i{index}:')
+        if index in jump_chains:
+            statements = translate_jump_chain(index, jump_chains[index], instruction_count)
+            opcode = 'OP_JUMP_TABLE'
+        else:
+            statements = translate_instruction(index, opcode, arguments, memory_size, instruction_count)
+        lines.append(f'    {{  // {opcode[3:].lower()}')
+        lines.extend(f'        {statement}' for statement in statements)
+        lines.append('    }')
+
+    lines.extend(['', 'halt:', '    *raised_error = false;', f'    return {instruction_count};', '}', ''])
+    return '\n'.join(lines)
+
+
+def build(input_path: str, output_path: str, show_fps: bool, scale: int, title: str, unchecked: bool, budget: int, deferred: bool, static: bool, windows: bool, aot: bool):
     if not os.path.isfile(input_path):
         raise FileNotFoundError(f'Could not find file "{input_path}"')
     
@@ -24,9 +301,19 @@ def build(input_path: str, output_path: str, show_fps: bool, scale: int, title:
     with open(EMBED_H_PATH, 'w') as f:
         f.write(xxd_result.stdout)
 
+    # Create embed_aot.h
+    if aot:
+        with open(input_path, 'rb') as f:
+            program = read_program(f.read())
+        with open(EMBED_AOT_H_PATH, 'w') as f:
+            f.write(translate_program(program, os.path.basename(input_path)))
+
     # Create cmake command
     cmake_command = CMAKE_BASE_COMMAND
-    cmake_command.extend([f'-DG1_FLAG_SHOW_FPS={show_fps}', f'-DG1_FLAG_SCALE={scale}', f'-DG1_FLAG_TITLE={title}'])
+    cmake_command.extend([f'-DG1_FLAG_SHOW_FPS={show_fps}', f'-DG1_FLAG_SCALE={scale}', f'-DG1_FLAG_TITLE={title}', f'-DG1_FLAG_UNCHECKED={unchecked}', f'-DG1_FLAG_BUDGET={budget}', f'-DG1_FLAG_DEFERRED={deferred}'])
+
+    if aot:
+        cmake_command.append('-DG1_EMBEDDED_AOT=ON')
 
     if static:
         cmake_command.append('-DSTATIC_BUILD=ON')
@@ -48,8 +335,10 @@ def build(input_path: str, output_path: str, show_fps: bool, scale: int, title:
         output_executable += '.exe'
     shutil.copy(f'{BUILD_DIRECTORY}/{output_executable}', output_path)
 
-    # Remove embed.h
+    # Remove embed.h and embed_aot.h
     os.remove(EMBED_H_PATH)
+    if aot:
+        os.remove(EMBED_AOT_H_PATH)
 
 
 def main():
@@ -59,14 +348,18 @@ def main():
     parser.add_argument('--show_fps', '-f', action='store_true')
     parser.add_argument('--scale', '-s', default=1)
     parser.add_argument('--title', '-t', type=str, default='cg1', help='The title of the output window')
+    parser.add_argument('--unchecked', '-u', action='store_true', help='Run the program without runtime errors')
+    parser.add_argument('--budget', '-b', type=int, default=0, help='Instructions the program runs per frame before it continues on the next frame, 0 for no limit')
+    parser.add_argument('--deferred', '-df', action='store_true', help='Draw each frame only once it\'s presented, skipping what later draws cover')
     parser.add_argument('--static', '-d', action='store_true', help='Enable static linking')
     parser.add_argument('--windows', '-win', action='store_true', help='Build for Windows')
+    parser.add_argument('--aot', '-a', action='store_true', help='Compile the program to C instead of interpreting it')
 
     args = parser.parse_args()
 
     try:
-        build(args.input_path, args.output_path, args.show_fps, args.scale, args.title, args.static, args.windows)
-    except FileNotFoundError as e:
+        build(args.input_path, args.output_path, args.show_fps, args.scale, args.title, args.unchecked, args.budget, args.deferred, args.static, args.windows, args.aot)
+    except (FileNotFoundError, ValueError) as e:
         print(e)
         return 1
     
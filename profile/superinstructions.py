@@ -0,0 +1,263 @@
+import argparse
+import json
+import os
+import re
+import subprocess
+import tempfile
+
+
+CORPUS_DIRECTORY = 'profile/corpus'
+COUNTS_PATH = 'profile/counts.txt'
+HEADER_PATH = 'src/instruction/superinstructions.h'
+INTERPRETER_PATH = 'src/instruction/interpreter_impl.h'
+
+# Instruction names in `instruction.c`, their argument counts and the version that added them
+INSTRUCTIONS = [
+    'mov', 'movp', 'add', 'sub', 'mul', 'div', 'mod', 'less', 'equal', 'not',
+    'jmp', 'color', 'point', 'line', 'rect', 'putc', 'getp', 'setch', 'call', 'ret',
+    'and', 'or', 'xor', 'shl', 'shr', 'sar',
+    'sin', 'cos', 'sqrt', 'abs', 'min', 'max', 'atan2',
+    'memfill', 'memcopy', 'memcmp', 'blit', 'blitkey', 'copyrect', 'tri'
+]
+ARGUMENT_COUNTS = [2, 2, 3, 3, 3, 3, 3, 3, 3, 2, 2, 3, 2, 4, 4, 1, 3, 4, 1, 0, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 3, 3, 3, 3, 3, 4, 3, 4, 3, 1]
+INSTRUCTION_VERSIONS = [1] * 18 + [2] * 2 + [3] * 6 + [4] * 7 + [5] * 3 + [6] * 2 + [7, 8]
+
+# Program metadata defaults, see the README
+METADATA_DEFAULTS = {'width': 100, 'height': 100, 'memory': 128, 'tickrate': 60, 'version': 1}
+
+# Superinstructions are picked while they save at least this share of an average program's dispatches
+MIN_SAVED_SHARE = 0.005
+MAX_SUPERINSTRUCTIONS = 16
+
+# Instruction bodies for each kind of operand-specialized handler in `interpreter_impl.h`, see `instruction_impl.h`.
+# `{0}`, `{1}` and `{2}` are the addressing modes of the operands.
+HANDLER_BODIES = {
+    '_UNARY_HANDLER': '_UNARY_BODY(C, {0}, {1}, {expression})',
+    '_MOVP_HANDLER': '_MOVP_BODY(C, {0}, {1})',
+    '_BINARY_HANDLER': '_BINARY_BODY(C, {0}, {1}, {2}, {expression})',
+    '_DIVISION_HANDLER': '_DIVISION_BODY(C, {0}, {1}, {2}, {expression})',
+    '_POW2_HANDLER': '_BINARY_BODY(C, {0}, {1}, L, {expression})',
+    '_JMP_HANDLER': '_JMP_BODY(C, {0}, {1})'
+}
+HANDLER_PATTERN = re.compile(r'_DEFINE_VARIANTS\(_DEFINE_HANDLERS_\d, (\w+), (\w+)(?:, (.*))?\)$')
+
+
+def assemble(source: str, name: str) -> dict:
+    """Assemble g1 source into the JSON form cg1 loads. Data entries aren't supported."""
+    metadata = dict(METADATA_DEFAULTS)
+    labels = {}
+    statements = []
+    for line_number, line in enumerate(source.splitlines(), 1):
+        line = line.split(';', 1)[0].strip()
+        if line.startswith('#'):
+            key, value = line[1:].split()
+            metadata[key] = int(value)
+            continue
+        if ':' in line:
+            label, line = line.split(':', 1)
+            labels[label.strip()] = len(statements)
+            line = line.strip()
+        if line:
+            statements.append((line_number, line.split()))
+
+    instructions = []
+    for line_number, (instruction, *arguments) in statements:
+        if instruction not in INSTRUCTIONS:
+            raise ValueError(f'{name}:{line_number}: unknown instruction "{instruction}"')
+        opcode = INSTRUCTIONS.index(instruction)
+        if len(arguments) != ARGUMENT_COUNTS[opcode]:
+            raise ValueError(f'{name}:{line_number}: "{instruction}" takes {ARGUMENT_COUNTS[opcode]} arguments')
+        if INSTRUCTION_VERSIONS[opcode] > metadata['version']:
+            raise ValueError(f'{name}:{line_number}: "{instruction}" needs version {INSTRUCTION_VERSIONS[opcode]}')
+
+        values = []
+        for argument in arguments:
+            if argument.startswith('$'):
+                values.append(argument)
+            elif re.fullmatch(r'-?\d+', argument):
+                values.append(int(argument))
+            elif argument in labels:
+                values.append(labels[argument])
+            else:
+                raise ValueError(f'{name}:{line_number}: unknown label "{argument}"')
+        instructions.append([instruction, values])
+
+    return {
+        'meta': metadata,
+        'start': labels.get('start', -1),
+        'tick': labels.get('tick', -1),
+        'instructions': instructions
+    }
+
+
+def profile_corpus(cg1_path: str) -> list[tuple[str, list[str]]]:
+    """Run every corpus program with a profiling build of cg1 and return the name and profile lines of each."""
+    environment = dict(os.environ, SDL_VIDEODRIVER='dummy', SDL_AUDIODRIVER='dummy')
+    profiles = []
+    with tempfile.TemporaryDirectory() as directory:
+        for file_name in sorted(os.listdir(CORPUS_DIRECTORY)):
+            if not file_name.endswith('.g1'):
+                continue
+            with open(os.path.join(CORPUS_DIRECTORY, file_name)) as f:
+                program = assemble(f.read(), file_name)
+
+            program_path = os.path.join(directory, 'program.json')
+            profile_path = os.path.join(directory, 'profile.txt')
+            with open(program_path, 'w') as f:
+                json.dump(program, f)
+            print(f'Profiling {file_name}')
+            subprocess.run([cg1_path, program_path, '--profile', profile_path], env=environment, check=True, stdout=subprocess.DEVNULL)
+
+            with open(profile_path) as f:
+                lines = f.read().splitlines()
+            instructions_line, counts = lines[0], lines[1:]
+            counts.sort(key=lambda line: (-int(line.split(' ', 1)[0]), line.split(' ', 1)[1]))
+            profiles.append((file_name, [instructions_line] + counts))
+    return profiles
+
+
+def write_counts(profiles: list[tuple[str, list[str]]]):
+    """Write the profiles to `COUNTS_PATH`, one section per program."""
+    with open(COUNTS_PATH, 'w') as f:
+        f.write('# Instruction sequence counts of the corpus programs, written by profile/superinstructions.py\n')
+        for name, lines in profiles:
+            f.write(f'\n{name}\n')
+            f.write(''.join(line + '\n' for line in lines))
+
+
+def read_shares() -> dict[str, float]:
+    """Read `COUNTS_PATH` and return the share of each sequence in the dispatches of an average corpus program."""
+    with open(COUNTS_PATH) as f:
+        sections = f.read().split('\n\n')[1:]
+
+    shares = {}
+    for section in sections:
+        _, instructions_line, *count_lines = section.strip().splitlines()
+        instructions = int(instructions_line.split()[0])
+        for line in count_lines:
+            count, sequence = line.split(' ', 1)
+            shares[sequence] = shares.get(sequence, 0) + int(count) / instructions / len(sections)
+    return shares
+
+
+def read_component_bodies() -> dict[str, str]:
+    """Return the body of each operand-specialized handler in `INTERPRETER_PATH` as a format string."""
+    bodies = {}
+    with open(INTERPRETER_PATH) as f:
+        for line in f:
+            match = HANDLER_PATTERN.search(line.strip())
+            if match and match.group(1) in HANDLER_BODIES:
+                kind, name, expression = match.groups()
+                bodies[name] = HANDLER_BODIES[kind].replace('{expression}', expression or '')
+    return bodies
+
+
+def parse_sequence(sequence: str) -> list[tuple[str, str]]:
+    """Split a sequence like `add LML, jmp LM` into the name and addressing modes of each instruction."""
+    return [tuple(component.strip().partition(' ')[::2]) for component in sequence.split(', ')]
+
+
+def overlap(a: list, b: list) -> bool:
+    """Returns true if the shorter of two sequences starts or ends the longer one."""
+    short, long = sorted((a, b), key=len)
+    return len(short) < len(long) and (long[:len(short)] == short or long[-len(short):] == short)
+
+
+def select_superinstructions(shares: dict[str, float], bodies: dict[str, str]) -> list[tuple[list, float]]:
+    """
+    Greedily pick the sequences that save the most dispatches.
+    A sequence saves one dispatch per instruction after its first each time it runs. Runs of a sequence that start or end
+    a longer one, or that a picked sequence starts or ends, are only counted once, since the decoder fuses the longest.
+    """
+    candidates = {}
+    for sequence, share in shares.items():
+        components = parse_sequence(sequence)
+        if len(components) > 1 and all(name in bodies for name, _ in components):
+            candidates[sequence] = (components, share)
+
+    selected = []
+    while len(selected) < MAX_SUPERINSTRUCTIONS:
+        best = None
+        for sequence, (components, share) in candidates.items():
+            saved = (len(components) - 1) * share
+            for picked, _ in selected:
+                if overlap(components, picked):
+                    saved -= shares[', '.join(' '.join(c) for c in max(components, picked, key=len))]
+            if not best or saved > best[2]:
+                best = (sequence, components, saved)
+        if not best or best[2] < MIN_SAVED_SHARE:
+            break
+        del candidates[best[0]]
+        selected.append((best[1], best[2]))
+    return selected
+
+
+def superinstruction_name(components: list) -> str:
+    return '_'.join(f'{name}_{modes}'.upper() for name, modes in components)
+
+
+def modes_value(modes: str) -> str:
+    return hex(sum(1 << i for i, mode in enumerate(modes) if mode == 'M'))
+
+
+def write_header(selected: list[tuple[list, float]], bodies: dict[str, str]):
+    """Write the picked superinstructions to `HEADER_PATH`."""
+    lines = [
+        '/*',
+        '    The superinstructions the decoder fuses, generated by `profile/superinstructions.py` from the instruction',
+        '    sequence counts of the programs in `profile/corpus`, which are in `profile/counts.txt`. Don\'t edit it by hand.',
+        '*/',
+        '',
+        '#ifndef SUPERINSTRUCTIONS_HEADER',
+        '#define SUPERINSTRUCTIONS_HEADER',
+        '',
+        '',
+        '/*',
+        'Share of the dispatches of an average corpus program that each superinstruction saves:'
+    ]
+    width = max(len(superinstruction_name(components)) for components, _ in selected)
+    for components, saved in selected:
+        sequence = ', '.join(' '.join(c) for c in components)
+        lines.append(f'    {superinstruction_name(components):<{width}}  {100 * saved:5.2f}%  {sequence}')
+    lines += [
+        '',
+        'Each entry is the name, the number of instructions, their opcodes and their addressing modes.',
+        '*/',
+        '#define SUPERINSTRUCTIONS(X) \\'
+    ]
+    for i, (components, _) in enumerate(selected):
+        opcodes = ', '.join(f'OP_{name.upper()}' for name, _ in components)
+        modes = ', '.join(modes_value(modes) for _, modes in components)
+        end = ' \\' if i < len(selected) - 1 else ''
+        lines.append(f'    X({superinstruction_name(components)}, {len(components)}, ({opcodes}), ({modes})){end}')
+
+    lines += ['', '// The body of each superinstruction, its instructions\' bodies in order, see `instruction_impl.h`']
+    for components, _ in selected:
+        lines.append(f'#define SUPERINSTRUCTION_BODY_{superinstruction_name(components)}(C) \\')
+        parts = [bodies[name].format(*modes) for name, modes in components]
+        lines += [f'    {part} _NEXT_COMPONENT() \\' for part in parts[:-1]] + [f'    {parts[-1]}']
+
+    lines += ['', '#endif', '']
+    with open(HEADER_PATH, 'w') as f:
+        f.write('\n'.join(lines))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        'superinstructions',
+        description=f'Pick the superinstructions that save the most dispatches in {CORPUS_DIRECTORY} and write them to {HEADER_PATH}. Run from the root of the repository.'
+    )
+    parser.add_argument('--cg1', help=f'cg1 built with ENABLE_G1_PROFILING to count the corpus with first, instead of reading {COUNTS_PATH}')
+    args = parser.parse_args()
+
+    if args.cg1:
+        write_counts(profile_corpus(args.cg1))
+    bodies = read_component_bodies()
+    selected = select_superinstructions(read_shares(), bodies)
+    write_header(selected, bodies)
+    for components, saved in selected:
+        print(f'{100 * saved:5.2f}%  {superinstruction_name(components)}')
+
+
+if __name__ == '__main__':
+    main()
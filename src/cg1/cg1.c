@@ -20,6 +20,10 @@
 #include "flags.h"
 #include "audio.h"
 
+#ifdef ENABLE_G1_PROFILING
+    #include "profile.h"
+#endif
+
 #ifdef G1_EMBEDDED
     #include "embed.h"
 #endif
@@ -32,6 +36,18 @@
     #define G1_FLAG_SCALE 1
 #endif
 
+#ifndef G1_FLAG_UNCHECKED
+    #define G1_FLAG_UNCHECKED 0
+#endif
+
+#ifndef G1_FLAG_BUDGET
+    #define G1_FLAG_BUDGET 0
+#endif
+
+#ifndef G1_FLAG_DEFERRED
+    #define G1_FLAG_DEFERRED 0
+#endif
+
 
 const int FPS_FONT_SIZE = 20;
 const uint16_t FPS_LABEL_DISPLAY_INTERVAL = 10;
@@ -61,8 +77,14 @@ void update_reserved_memory(const ProgramState *program_state, const Uint8 *keys
 void free_program_state(const ProgramState *program_state) {
     ProgramData *program_data = program_state->data;
     ProgramContext *program_context = program_state->context;
-    free(program_data->instructions);
-    free(program_context->memory);
+    free_threaded_code(&program_data->threaded_code);
+    free(program_data->decoded_instructions);
+    free_counted_loops(&program_data->counted_loops);
+    free_jump_tables(&program_data->jump_tables);
+    #ifdef ENABLE_G1_JIT
+        jit_free(program_data->jit_code);
+    #endif
+    free_program_memory(program_context);
     if (program_context->audio_device_id) {
         free(program_context->audio_buffer);
     }
@@ -99,9 +121,13 @@ void quit_sdl(ProgramContext *program_context) {
     SDL_Window *win = program_context->win;
     SDL_Renderer *renderer = program_context->renderer;
     SDL_Surface *render_surface = program_context->render_surface;
+    SDL_Texture *present_texture = program_context->present_texture;
     TTF_Font *font = program_context->font;
     SDL_AudioDeviceID audio_device_id = program_context->audio_device_id;
 
+    if (present_texture) {
+        SDL_DestroyTexture(present_texture);
+    }
     if (win) {
         SDL_DestroyWindow(win);
     }
@@ -113,6 +139,8 @@ void quit_sdl(ProgramContext *program_context) {
         if (render_surface) {
             SDL_FreeSurface(render_surface);
         }
+        dirty_tiles_free(&program_context->dirty_tiles);
+        draw_buffer_free(&program_context->draw_buffer);
     #endif
 
     if (font) {
@@ -160,6 +188,30 @@ int init_sdl(ProgramContext *program_context, uint32_t window_width, uint32_t wi
             quit_sdl(program_context);
             return -3;
         }
+
+        // Frames are copied to the same texture every tick, in the surface's format so there's nothing to convert
+        SDL_Surface *surf = program_context->render_surface;
+        program_context->present_texture = SDL_CreateTexture(program_context->renderer, surf->format->format, SDL_TEXTUREACCESS_STREAMING, surf->w, surf->h);
+        if (!program_context->present_texture) {
+            print_sdl_error("Failed to create presentation texture");
+            quit_sdl(program_context);
+            return -3;
+        }
+
+        // Only the parts of the surface that were drawn to are copied to the texture, see `dirty_tiles.h`
+        if (dirty_tiles_init(&program_context->dirty_tiles, surf->w, surf->h) < 0) {
+            printf("Failed to allocate dirty tiles.\n");
+            quit_sdl(program_context);
+            return -3;
+        }
+        surf->userdata = &program_context->dirty_tiles;
+
+        if (flags->deferred && draw_buffer_init(&program_context->draw_buffer) < 0) {
+            printf("Failed to allocate draw buffer.\n");
+            quit_sdl(program_context);
+            return -3;
+        }
+        program_context->deferred_drawing = flags->deferred;
     #endif
     
     // Load font for displaying framerate
@@ -238,11 +290,9 @@ int program_tick_loop(ProgramState *program_state, const Uint8 *keyboard, struct
     ProgramContext *program_context = program_state->context;
 
     Uint32 target_frame_time = 1000 / program_data->tickrate;
-    Uint64 last_frame_time = 0, start_frame_time = 0;
+    Uint64 last_frame_time = 0, start_frame_time = 0, last_tick_time = 0;
     int32_t delta_ms = 0;
 
-    SDL_Texture *present_texture;
-
     SDL_Rect dest_rect = {0, 0, flag_data->pixel_size * program_data->width, flag_data->pixel_size * program_data->height};
 
     uint32_t fps_label_timer = 0;
@@ -265,8 +315,20 @@ int program_tick_loop(ProgramState *program_state, const Uint8 *keyboard, struct
         }
         SDL_PumpEvents();
         
-        update_reserved_memory(program_state, keyboard, delta_ms);
-        int run_thread_response = run_program_thread(program_state, program_data->tick_index);
+        // A thread that ran out of its instruction budget continues where it stopped, still presenting and playing audio every frame.
+        // Reserved memory only changes when a new tick starts, and its delta covers every frame since the last tick started.
+        int run_thread_response;
+        if (program_context->thread_suspended) {
+            run_thread_response = resume_program_thread(program_state);
+        }
+        else if (program_data->tick_index == -1) {  // The resumed start routine finished and there's no tick routine
+            break;
+        }
+        else {
+            update_reserved_memory(program_state, keyboard, start_frame_time - last_tick_time);
+            last_tick_time = start_frame_time;
+            run_thread_response = run_program_thread(program_state, program_data->tick_index);
+        }
         if (run_thread_response < 0) {
             return -1;
         }
@@ -285,9 +347,11 @@ int program_tick_loop(ProgramState *program_state, const Uint8 *keyboard, struct
             SDL_RenderPresent(program_context->renderer);
             SDL_RenderClear(program_context->renderer);
         #else
-            present_texture = SDL_CreateTextureFromSurface(program_context->renderer, program_context->render_surface);
-            SDL_RenderCopy(program_context->renderer, present_texture, NULL, &dest_rect);
-            SDL_DestroyTexture(present_texture);
+            if (program_context->deferred_drawing) {
+                draw_buffer_flush(&program_context->draw_buffer, program_context->render_surface);
+            }
+            dirty_tiles_upload(&program_context->dirty_tiles, program_context->render_surface, program_context->present_texture);
+            SDL_RenderCopy(program_context->renderer, program_context->present_texture, NULL, &dest_rect);
             if (flag_data->show_fps) {
                 fps_label_timer += 1;
                 fps_label_accumulated_time += delta_ms;
@@ -327,6 +391,8 @@ int run_program(ProgramState *program_state, struct FlagData *flag_data) {
         return -2;
     }
     program_context->color = 0;
+    program_context->runtime_errors = !flag_data->unchecked;
+    program_context->instruction_budget = flag_data->instruction_budget;
 
     const Uint8 *keyboard = SDL_GetKeyboardState(NULL);
     
@@ -348,7 +414,8 @@ int run_program(ProgramState *program_state, struct FlagData *flag_data) {
             return -3;
         }
     }
-    if (program_data->tick_index == -1) {
+    // A start routine that ran out of budget is resumed by the tick loop before the first tick
+    if (program_data->tick_index == -1 && !program_context->thread_suspended) {
         quit_sdl(program_context);
         free_program_state(program_state);
         return 1;
@@ -368,6 +435,14 @@ int run_program(ProgramState *program_state, struct FlagData *flag_data) {
 }
 
 
+// Print how many times the program was suspended for running out of its instruction budget, if it ever was.
+static void report_budget_overruns(const ProgramContext *program_context) {
+    if (program_context->budget_overruns > 0) {
+        printf("Ran out of the instruction budget %llu times.\n", (unsigned long long) program_context->budget_overruns);
+    }
+}
+
+
 int run_file(const char *file_path, const char* flags) {
     // Parse flags
     struct FlagData flag_data = {0};
@@ -382,13 +457,21 @@ int run_file(const char *file_path, const char* flags) {
         return -1;
     }
 
-    return run_program(&program_state, &flag_data);
+    int run_program_response = run_program(&program_state, &flag_data);
+    report_budget_overruns(&program_context);
+    #ifdef ENABLE_G1_PROFILING
+        if (flag_data.profile_path[0] != '\0') {
+            profile_write(flag_data.profile_path);
+        }
+        profile_report();
+    #endif
+    return run_program_response;
 }
 
 
 int run_embedded() {
     #ifdef G1_EMBEDDED
-        struct FlagData flag_data = {G1_FLAG_SHOW_FPS, G1_FLAG_SCALE, G1_FLAG_TITLE};
+        struct FlagData flag_data = {G1_FLAG_SHOW_FPS, G1_FLAG_SCALE, G1_FLAG_TITLE, G1_FLAG_UNCHECKED, G1_FLAG_BUDGET, G1_FLAG_DEFERRED};
         ProgramData program_data = {0};
         ProgramContext program_context = {0};
         ProgramState program_state = {&program_data, &program_context};
@@ -397,7 +480,12 @@ int run_embedded() {
             return -1;
         }
 
-        return run_program(&program_state, &flag_data);
+        int run_program_response = run_program(&program_state, &flag_data);
+        report_budget_overruns(&program_context);
+        #ifdef ENABLE_G1_PROFILING
+            profile_report();
+        #endif
+        return run_program_response;
     #endif
 
     return 0;
@@ -0,0 +1,120 @@
+/*
+    Native call and return on a hidden return stack.
+*/
+
+#include <stdlib.h>
+#include "instruction.h"
+#include "decode.h"
+#include "call.h"
+
+
+static bool in_memory(int32_t address, size_t memory_size) {
+    return address >= 0 && (size_t) address < memory_size;
+}
+
+static int compare_slots(const void *a, const void *b) {
+    int32_t slot_a = *(const int32_t*) a, slot_b = *(const int32_t*) b;
+    return (slot_a > slot_b) - (slot_a < slot_b);
+}
+
+
+// Returns the decoded instruction that continues from a jump to instruction `address`.
+static int32_t return_target(const DecodedInstruction *instructions, size_t instruction_count, int32_t address) {
+    // Entry blocks start with a jump into their optimized code, which is the only jump marked as an entry point yet
+    if ((size_t) address >= instruction_count) {
+        return address;
+    }
+    const DecodedInstruction *ins = &instructions[address];
+    if (ins->opcode == OP_JMP && ins->entry_point && ins->modes == 0) {
+        return ins->operands[0];
+    }
+    return address;
+}
+
+
+// Returns true if `ins` is `jmp $slot 1`, a return through a slot inside memory.
+static bool is_return(const DecodedInstruction *ins, size_t memory_size) {
+    return ins->opcode == OP_JMP && ins->modes == 1 && ins->operands[1] && in_memory(ins->operands[0], memory_size);
+}
+
+// Returns true if `ins` and the instruction after it are `mov slot address` and `jmp target 1`.
+static bool is_call(const DecodedInstruction *ins, size_t instruction_count, size_t memory_size) {
+    const DecodedInstruction *jump = ins+1;
+    return ins->opcode == OP_MOV && ins->modes == 0 && !ins->idiom && in_memory(ins->operands[0], memory_size)
+        && ins->operands[1] >= 0 && (size_t) ins->operands[1] <= instruction_count
+        && jump->opcode == OP_JMP && jump->modes == 0 && jump->operands[1];
+}
+
+
+void link_calls(DecodedInstruction *instructions, size_t instruction_count, size_t decoded_count, size_t memory_size) {
+    bool uses_call_stack = false;
+    for (size_t i = 0; i < decoded_count; i++) {
+        DecodedInstruction *ins = &instructions[i];
+        if (ins->opcode == OP_CALL) {
+            ins->operands[2] = return_target(instructions, instruction_count, ins->operands[1]);
+        }
+        uses_call_stack |= ins->opcode == OP_CALL || ins->opcode == OP_RET;
+    }
+    // Frames of recognized calls would get in the way of the program's own
+    if (uses_call_stack) {
+        return;
+    }
+
+    // The slots that returns jump through, sorted
+    size_t slot_count = 0;
+    for (size_t i = 0; i < decoded_count; i++) {
+        slot_count += is_return(&instructions[i], memory_size);
+    }
+    if (slot_count == 0) {
+        return;
+    }
+    int32_t *slots = malloc(sizeof(int32_t) * slot_count);
+    bool *called = calloc(slot_count, sizeof(bool));
+    if (!slots || !called) {
+        free(slots);
+        free(called);
+        return;
+    }
+    slot_count = 0;
+    for (size_t i = 0; i < decoded_count; i++) {
+        if (is_return(&instructions[i], memory_size)) {
+            slots[slot_count++] = instructions[i].operands[0];
+        }
+    }
+    qsort(slots, slot_count, sizeof(int32_t), compare_slots);
+    size_t unique_count = 0;
+    for (size_t i = 0; i < slot_count; i++) {
+        if (unique_count == 0 || slots[unique_count-1] != slots[i]) {
+            slots[unique_count++] = slots[i];
+        }
+    }
+    slot_count = unique_count;
+
+    for (size_t i = 0; i + 1 < decoded_count; i++) {
+        DecodedInstruction *ins = &instructions[i];
+        if (!is_call(ins, instruction_count, memory_size)) {
+            continue;
+        }
+        int32_t *slot = bsearch(&ins->operands[0], slots, slot_count, sizeof(int32_t), compare_slots);
+        if (slot) {
+            ins->idiom = IDIOM_CALL;
+            ins->operands[2] = return_target(instructions, instruction_count, ins->operands[1]);
+            called[slot - slots] = true;
+        }
+    }
+
+    // Only returns through slots that calls store to can take a frame
+    for (size_t i = 0; i < decoded_count; i++) {
+        DecodedInstruction *ins = &instructions[i];
+        if (!is_return(ins, memory_size) || ins->idiom) {
+            continue;
+        }
+        int32_t *slot = bsearch(&ins->operands[0], slots, slot_count, sizeof(int32_t), compare_slots);
+        if (called[slot - slots]) {
+            ins->idiom = IDIOM_RETURN;
+        }
+    }
+
+    free(slots);
+    free(called);
+}
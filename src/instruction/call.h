@@ -0,0 +1,36 @@
+/*
+    Native call and return on a hidden return stack.
+
+    A decoded `call` keeps its target as its first operand, the instruction it returns to as its second operand,
+    and the decoded instruction that continues from there as its third operand, which skips the jump into the
+    optimized code when the optimizer placed one there.
+
+    Programs written for the original instruction set call subroutines through a return slot instead:
+
+        mov ret after_call
+        jmp subroutine 1
+        after_call:
+        ...
+        subroutine:
+        ...
+        jmp $ret 1
+
+    These are recognized too. The call pushes a frame like `call` does, and the return only takes the frame if it
+    returns where the slot says, so programs that use the slot any other way run exactly as written.
+*/
+
+#ifndef CALL_HEADER
+#define CALL_HEADER
+
+#include "decode.h"
+
+
+/*
+Fill in the third operand of every `call`, and for programs that don't use `call` or `ret` themselves,
+set `IDIOM_CALL` on the `mov` of every call through a return slot inside a memory of `memory_size` slots
+and `IDIOM_RETURN` on every return through one of those slots. The `mov` of a call gets the decoded instruction
+its return continues at as its third operand.
+*/
+void link_calls(DecodedInstruction *instructions, size_t instruction_count, size_t decoded_count, size_t memory_size);
+
+#endif
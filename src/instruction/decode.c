@@ -0,0 +1,121 @@
+/*
+    Load-time decoding of parsed instructions into the form run by the interpreter.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "instruction.h"
+#include "decode.h"
+#include "optimize.h"
+#include "idiom.h"
+#include "jump_table.h"
+#include "call.h"
+
+#define MAX_SUPERINSTRUCTION_LENGTH 3
+
+
+// The sequence of instructions that each superinstruction replaces.
+typedef struct {
+    byte length;
+    byte opcodes[MAX_SUPERINSTRUCTION_LENGTH];
+    byte modes[MAX_SUPERINSTRUCTION_LENGTH];
+} SuperinstructionPattern;
+
+#define _UNPACK(...) __VA_ARGS__
+#define _SUPERINSTRUCTION_PATTERN(name, length, opcodes, modes) [SUPER_##name] = {length, {_UNPACK opcodes}, {_UNPACK modes}},
+static const SuperinstructionPattern SUPERINSTRUCTION_PATTERNS[AMOUNT_SUPERINSTRUCTIONS] = {
+    SUPERINSTRUCTIONS(_SUPERINSTRUCTION_PATTERN)
+};
+
+
+byte superinstruction_length(byte superinstruction) {
+    return SUPERINSTRUCTION_PATTERNS[superinstruction].length;
+}
+
+
+// Profiling builds count the sequences that fusion would see, so they never fuse superinstructions
+#ifndef ENABLE_G1_PROFILING
+// Returns true if the instructions starting at `index` match `pattern`.
+static bool matches_pattern(const DecodedInstruction *instructions, size_t instruction_count, size_t index, const SuperinstructionPattern *pattern) {
+    if (index + pattern->length > instruction_count) {
+        return false;
+    }
+    for (byte i = 0; i < pattern->length; i++) {
+        const DecodedInstruction *ins = &instructions[index+i];
+        if (ins->opcode != pattern->opcodes[i] || ins->modes != pattern->modes[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*
+Mark every instruction that starts a superinstruction sequence.
+The instructions inside a sequence are left untouched, so jumping into the middle of one still works.
+*/
+static void fuse_superinstructions(DecodedInstruction *instructions, size_t instruction_count) {
+    for (size_t i = 0; i < instruction_count; i++) {
+        byte best_length = 0;
+        for (byte j = SUPER_NONE+1; j < AMOUNT_SUPERINSTRUCTIONS; j++) {
+            const SuperinstructionPattern *pattern = &SUPERINSTRUCTION_PATTERNS[j];
+            if (pattern->length > best_length && matches_pattern(instructions, instruction_count, i, pattern)) {
+                instructions[i].superinstruction = j;
+                best_length = pattern->length;
+            }
+        }
+    }
+}
+#endif
+
+
+DecodedInstruction* decode_instructions(const InstructionList *instructions, size_t instruction_count, const ProgramInfo *program_info, size_t *decoded_count, CountedLoopList *counted_loops, JumpTableList *jump_tables) {
+    DecodedInstruction *decoded_instructions = malloc(sizeof(DecodedInstruction) * (instruction_count+1));
+    if (!decoded_instructions) {
+        printf("Failed to allocate memory for decoded instructions.\n");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < instruction_count; i++) {
+        const int32_t *operands = instruction_operands(instructions, i);
+        DecodedInstruction *decoded = &decoded_instructions[i];
+        decoded->opcode = instruction_opcode(instructions, i);
+        decoded->modes = instruction_modes(instructions, i);
+        decoded->superinstruction = SUPER_NONE;
+        decoded->idiom = IDIOM_NONE;
+        decoded->verified = false;
+        decoded->entry_point = false;
+
+        byte argument_count = ARGUMENT_COUNTS[decoded->opcode];
+        for (byte j = 0; j < MAX_ARGUMENTS; j++) {
+            decoded->operands[j] = j < argument_count ? operands[j] : 0;
+        }
+
+        // Calls return to the next instruction, see `call.h`
+        if (decoded->opcode == OP_CALL) {
+            decoded->operands[1] = decoded->operands[2] = i+1;
+        }
+
+        // Jumping outside of the program ends it, so point those jumps at the halt instruction
+        if ((decoded->opcode == OP_JMP || decoded->opcode == OP_CALL) && !(decoded->modes & 1)) {
+            int32_t target = decoded->operands[0];
+            if (target < 0 || (size_t) target >= instruction_count) {
+                decoded->operands[0] = instruction_count;
+            }
+        }
+    }
+
+    // Falling off the end of the program runs the halt instruction
+    decoded_instructions[instruction_count] = (DecodedInstruction) {OP_HALT, 0, SUPER_NONE, IDIOM_NONE, false, true, {0}};
+    *decoded_count = instruction_count+1;
+
+    decoded_instructions = optimize_instructions(decoded_instructions, instruction_count, program_info, decoded_count);
+    recognize_idioms(decoded_instructions, *decoded_count, program_info->memory_size, counted_loops);
+    recognize_jump_tables(decoded_instructions, *decoded_count, program_info->memory_size, jump_tables);
+    link_calls(decoded_instructions, instruction_count, *decoded_count, program_info->memory_size);
+    #ifndef ENABLE_G1_PROFILING
+        fuse_superinstructions(decoded_instructions, *decoded_count);
+    #endif
+
+    return decoded_instructions;
+}
@@ -0,0 +1,144 @@
+/*
+    Load-time decoding of parsed instructions, which are then threaded into the form run by the interpreter, see `threaded.h`.
+*/
+
+#ifndef DECODE_HEADER
+#define DECODE_HEADER
+
+#include "util.h"
+#include "instruction.h"
+#include "superinstructions.h"
+
+typedef struct JumpTableList JumpTableList;
+typedef struct CountedLoopList CountedLoopList;
+
+#define MAX_ARGUMENTS 4
+
+// Internal opcodes that only appear in decoded programs
+#define OP_HALT AMOUNT_INSTRUCTIONS
+#define OP_DIV_POW2 (AMOUNT_INSTRUCTIONS + 1)  // `div` by a power of two, the third operand is the shift
+#define OP_MOD_POW2 (AMOUNT_INSTRUCTIONS + 2)  // `mod` by a power of two, the third operand is the mask
+
+#define AMOUNT_DECODED_OPCODES (AMOUNT_INSTRUCTIONS + 3)
+
+// Addressing mode combinations, named in argument order. (`L` = literal, `M` = address)
+#define MODES_LM 0x2
+#define MODES_MM 0x3
+#define MODES_LML 0x2
+#define MODES_LLM 0x4
+#define MODES_LMM 0x6
+
+
+/*
+Superinstructions run a sequence of adjacent instructions with a single dispatch.
+The set is generated into `superinstructions.h` by `profile/superinstructions.py`, which picks the sequences that save
+the most dispatches in the instruction sequence counts that `ENABLE_G1_PROFILING` builds write for the programs in
+`profile/corpus`. Rerun it when the corpus or the handlers change.
+*/
+#define _SUPERINSTRUCTION_ENUM(name, ...) SUPER_##name,
+typedef enum {
+    SUPER_NONE,
+    SUPERINSTRUCTIONS(_SUPERINSTRUCTION_ENUM)
+    AMOUNT_SUPERINSTRUCTIONS
+} Superinstruction;
+
+
+/*
+Instruction sequences that run as a single native operation.
+The counted loops are loops whose body is one of these instructions and `add v $v 1` increments,
+ending in `less c $i bound` and a jump back, see `idiom.h`.
+*/
+typedef enum {
+    IDIOM_NONE,
+    IDIOM_FILL,        // Memory fill: mov MX with a counting destination
+    IDIOM_COPY,        // Memory copy: movp MM with a counting destination and source
+    IDIOM_SPAN,        // Row or column of pixels: point with one counting coordinate
+    IDIOM_JUMP_TABLE,  // Chain of equal LML and jmp LM pairs on one slot, see `jump_table.h`
+    IDIOM_CALL,        // Call through a return slot: mov LL of a return address and jmp LL, see `call.h`
+    IDIOM_RETURN,      // Return through a return slot: jmp ML, see `call.h`
+    AMOUNT_IDIOMS
+} Idiom;
+
+
+/*
+An instruction whose addressing modes have been resolved at load time.
+`modes` has bit `i` set if argument `i` is an address.
+`superinstruction` is set if this instruction starts a sequence that runs as a `Superinstruction`.
+`idiom` is set if this instruction starts a sequence that runs as one native operation, see `Idiom`.
+`verified` is set if every runtime check in this instruction is known to pass, see `verify.h`.
+`entry_point` is set if computed jumps to this instruction can run its verified code.
+*/
+typedef struct {
+    byte opcode;
+    byte modes;
+    byte superinstruction;
+    byte idiom;
+    bool verified;
+    bool entry_point;
+    int32_t operands[MAX_ARGUMENTS];
+} DecodedInstruction;
+
+
+// Program metadata that decoding uses to optimize the instructions.
+typedef struct {
+    int32_t memory_size, width, height, tickrate;
+    int32_t start_index, tick_index;
+} ProgramInfo;
+
+
+// Returns the number of arguments read by a decoded instruction with `opcode`.
+static inline byte decoded_argument_count(byte opcode) {
+    if (opcode < AMOUNT_INSTRUCTIONS) {
+        return ARGUMENT_COUNTS[opcode];
+    }
+    return opcode == OP_HALT ? 0 : 3;
+}
+
+
+// Returns true if a decoded instruction with `opcode` stores a value at its first argument.
+static inline bool writes_destination(byte opcode) {
+    switch (opcode) {
+        case OP_MOV: case OP_MOVP: case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+        case OP_LESS: case OP_EQUAL: case OP_NOT: case OP_GETP: case OP_DIV_POW2: case OP_MOD_POW2:
+        case OP_AND: case OP_OR: case OP_XOR: case OP_SHL: case OP_SHR: case OP_SAR:
+        case OP_SIN: case OP_COS: case OP_SQRT: case OP_ABS: case OP_MIN: case OP_MAX: case OP_ATAN2: case OP_MEMCMP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+// Truncating division by `1 << shift`, which `OP_DIV_POW2` runs.
+static inline int32_t div_pow2(int32_t value, int32_t shift) {
+    return (value + ((value >> 31) & ((1 << shift) - 1))) >> shift;
+}
+
+// Shifts by the low five bits of `shift`, which `shl`, `shr` and `sar` run.
+static inline int32_t shift_left(int32_t value, int32_t shift) {
+    return (int32_t) ((uint32_t) value << (shift & 31));
+}
+
+static inline int32_t shift_right(int32_t value, int32_t shift) {
+    return (int32_t) ((uint32_t) value >> (shift & 31));
+}
+
+static inline int32_t shift_right_arithmetic(int32_t value, int32_t shift) {
+    return value >> (shift & 31);
+}
+
+
+/*
+Convert a list of parsed instructions into an array of `DecodedInstruction` structs.
+The returned array has an extra `OP_HALT` instruction at index `instruction_count`, which every jump outside
+of the program goes to. Optimized code may follow it, see `optimize.h`. `decoded_count` is set to the length
+of the returned array. The loops that run as counted loop idioms are stored in `counted_loops`, and the tables for any
+`IDIOM_JUMP_TABLE` chains are stored in `jump_tables`.
+*/
+DecodedInstruction* decode_instructions(const InstructionList *instructions, size_t instruction_count, const ProgramInfo *program_info, size_t *decoded_count, CountedLoopList *counted_loops, JumpTableList *jump_tables);
+
+
+// Returns the number of instructions run by `superinstruction`.
+byte superinstruction_length(byte superinstruction);
+
+#endif
@@ -0,0 +1,165 @@
+/*
+    Fixed-point trigonometry and square roots. Everything here is integer only, so results are the same everywhere.
+*/
+
+#include "fixed_math.h"
+
+
+// `FIXED_ONE * sin(i/FIXED_TURN turns)` for the first quarter turn, rounded to the nearest integer.
+static const int32_t SIN_TABLE[FIXED_QUARTER_TURN + 1] = {
+    0, 101, 201, 302, 402, 503, 603, 704, 804, 905, 1005, 1106, 1206, 1307, 1407, 1508,
+    1608, 1709, 1809, 1910, 2010, 2111, 2211, 2312, 2412, 2513, 2613, 2714, 2814, 2914, 3015, 3115,
+    3216, 3316, 3417, 3517, 3617, 3718, 3818, 3918, 4019, 4119, 4219, 4320, 4420, 4520, 4621, 4721,
+    4821, 4921, 5022, 5122, 5222, 5322, 5422, 5523, 5623, 5723, 5823, 5923, 6023, 6123, 6224, 6324,
+    6424, 6524, 6624, 6724, 6824, 6924, 7024, 7124, 7224, 7323, 7423, 7523, 7623, 7723, 7823, 7923,
+    8022, 8122, 8222, 8322, 8421, 8521, 8621, 8720, 8820, 8919, 9019, 9119, 9218, 9318, 9417, 9517,
+    9616, 9716, 9815, 9914, 10014, 10113, 10212, 10312, 10411, 10510, 10609, 10709, 10808, 10907, 11006, 11105,
+    11204, 11303, 11402, 11501, 11600, 11699, 11798, 11897, 11996, 12095, 12193, 12292, 12391, 12490, 12588, 12687,
+    12785, 12884, 12983, 13081, 13180, 13278, 13376, 13475, 13573, 13672, 13770, 13868, 13966, 14065, 14163, 14261,
+    14359, 14457, 14555, 14653, 14751, 14849, 14947, 15045, 15143, 15240, 15338, 15436, 15534, 15631, 15729, 15826,
+    15924, 16021, 16119, 16216, 16314, 16411, 16508, 16606, 16703, 16800, 16897, 16994, 17091, 17188, 17285, 17382,
+    17479, 17576, 17673, 17770, 17867, 17963, 18060, 18156, 18253, 18350, 18446, 18543, 18639, 18735, 18832, 18928,
+    19024, 19120, 19216, 19313, 19409, 19505, 19600, 19696, 19792, 19888, 19984, 20080, 20175, 20271, 20366, 20462,
+    20557, 20653, 20748, 20844, 20939, 21034, 21129, 21224, 21320, 21415, 21510, 21604, 21699, 21794, 21889, 21984,
+    22078, 22173, 22268, 22362, 22457, 22551, 22645, 22740, 22834, 22928, 23022, 23116, 23210, 23304, 23398, 23492,
+    23586, 23680, 23774, 23867, 23961, 24054, 24148, 24241, 24335, 24428, 24521, 24614, 24708, 24801, 24894, 24987,
+    25080, 25172, 25265, 25358, 25451, 25543, 25636, 25728, 25821, 25913, 26005, 26098, 26190, 26282, 26374, 26466,
+    26558, 26650, 26742, 26833, 26925, 27017, 27108, 27200, 27291, 27382, 27474, 27565, 27656, 27747, 27838, 27929,
+    28020, 28111, 28202, 28293, 28383, 28474, 28564, 28655, 28745, 28835, 28926, 29016, 29106, 29196, 29286, 29376,
+    29466, 29555, 29645, 29735, 29824, 29914, 30003, 30093, 30182, 30271, 30360, 30449, 30538, 30627, 30716, 30805,
+    30893, 30982, 31071, 31159, 31248, 31336, 31424, 31512, 31600, 31688, 31776, 31864, 31952, 32040, 32127, 32215,
+    32303, 32390, 32477, 32565, 32652, 32739, 32826, 32913, 33000, 33087, 33173, 33260, 33347, 33433, 33520, 33606,
+    33692, 33778, 33865, 33951, 34037, 34122, 34208, 34294, 34380, 34465, 34551, 34636, 34721, 34806, 34892, 34977,
+    35062, 35146, 35231, 35316, 35401, 35485, 35570, 35654, 35738, 35823, 35907, 35991, 36075, 36159, 36243, 36326,
+    36410, 36493, 36577, 36660, 36744, 36827, 36910, 36993, 37076, 37159, 37241, 37324, 37407, 37489, 37572, 37654,
+    37736, 37818, 37900, 37982, 38064, 38146, 38228, 38309, 38391, 38472, 38554, 38635, 38716, 38797, 38878, 38959,
+    39040, 39120, 39201, 39282, 39362, 39442, 39523, 39603, 39683, 39763, 39843, 39922, 40002, 40082, 40161, 40241,
+    40320, 40399, 40478, 40557, 40636, 40715, 40794, 40872, 40951, 41029, 41108, 41186, 41264, 41342, 41420, 41498,
+    41576, 41653, 41731, 41808, 41886, 41963, 42040, 42117, 42194, 42271, 42348, 42424, 42501, 42578, 42654, 42730,
+    42806, 42882, 42958, 43034, 43110, 43186, 43261, 43337, 43412, 43487, 43562, 43638, 43713, 43787, 43862, 43937,
+    44011, 44086, 44160, 44234, 44308, 44382, 44456, 44530, 44604, 44677, 44751, 44824, 44898, 44971, 45044, 45117,
+    45190, 45262, 45335, 45408, 45480, 45552, 45625, 45697, 45769, 45841, 45912, 45984, 46056, 46127, 46199, 46270,
+    46341, 46412, 46483, 46554, 46624, 46695, 46765, 46836, 46906, 46976, 47046, 47116, 47186, 47256, 47325, 47395,
+    47464, 47534, 47603, 47672, 47741, 47809, 47878, 47947, 48015, 48084, 48152, 48220, 48288, 48356, 48424, 48491,
+    48559, 48626, 48694, 48761, 48828, 48895, 48962, 49029, 49095, 49162, 49228, 49295, 49361, 49427, 49493, 49559,
+    49624, 49690, 49756, 49821, 49886, 49951, 50016, 50081, 50146, 50211, 50275, 50340, 50404, 50468, 50532, 50596,
+    50660, 50724, 50787, 50851, 50914, 50977, 51041, 51104, 51166, 51229, 51292, 51354, 51417, 51479, 51541, 51603,
+    51665, 51727, 51789, 51850, 51911, 51973, 52034, 52095, 52156, 52217, 52277, 52338, 52398, 52459, 52519, 52579,
+    52639, 52699, 52759, 52818, 52878, 52937, 52996, 53055, 53114, 53173, 53232, 53290, 53349, 53407, 53465, 53523,
+    53581, 53639, 53697, 53754, 53812, 53869, 53926, 53983, 54040, 54097, 54154, 54210, 54267, 54323, 54379, 54435,
+    54491, 54547, 54603, 54658, 54714, 54769, 54824, 54879, 54934, 54989, 55043, 55098, 55152, 55206, 55260, 55314,
+    55368, 55422, 55476, 55529, 55582, 55636, 55689, 55742, 55794, 55847, 55900, 55952, 56004, 56056, 56108, 56160,
+    56212, 56264, 56315, 56367, 56418, 56469, 56520, 56571, 56621, 56672, 56722, 56773, 56823, 56873, 56923, 56972,
+    57022, 57072, 57121, 57170, 57219, 57268, 57317, 57366, 57414, 57463, 57511, 57559, 57607, 57655, 57703, 57750,
+    57798, 57845, 57892, 57939, 57986, 58033, 58079, 58126, 58172, 58219, 58265, 58311, 58356, 58402, 58448, 58493,
+    58538, 58583, 58628, 58673, 58718, 58763, 58807, 58851, 58896, 58940, 58983, 59027, 59071, 59114, 59158, 59201,
+    59244, 59287, 59330, 59372, 59415, 59457, 59499, 59541, 59583, 59625, 59667, 59708, 59750, 59791, 59832, 59873,
+    59914, 59954, 59995, 60035, 60075, 60116, 60156, 60195, 60235, 60275, 60314, 60353, 60392, 60431, 60470, 60509,
+    60547, 60586, 60624, 60662, 60700, 60738, 60776, 60813, 60851, 60888, 60925, 60962, 60999, 61035, 61072, 61108,
+    61145, 61181, 61217, 61253, 61288, 61324, 61359, 61394, 61429, 61464, 61499, 61534, 61568, 61603, 61637, 61671,
+    61705, 61739, 61772, 61806, 61839, 61873, 61906, 61939, 61971, 62004, 62036, 62069, 62101, 62133, 62165, 62197,
+    62228, 62260, 62291, 62322, 62353, 62384, 62415, 62445, 62476, 62506, 62536, 62566, 62596, 62626, 62655, 62685,
+    62714, 62743, 62772, 62801, 62830, 62858, 62886, 62915, 62943, 62971, 62998, 63026, 63054, 63081, 63108, 63135,
+    63162, 63189, 63215, 63242, 63268, 63294, 63320, 63346, 63372, 63397, 63423, 63448, 63473, 63498, 63523, 63547,
+    63572, 63596, 63621, 63645, 63668, 63692, 63716, 63739, 63763, 63786, 63809, 63832, 63854, 63877, 63899, 63922,
+    63944, 63966, 63987, 64009, 64031, 64052, 64073, 64094, 64115, 64136, 64156, 64177, 64197, 64217, 64237, 64257,
+    64277, 64296, 64316, 64335, 64354, 64373, 64392, 64410, 64429, 64447, 64465, 64483, 64501, 64519, 64536, 64554,
+    64571, 64588, 64605, 64622, 64639, 64655, 64672, 64688, 64704, 64720, 64735, 64751, 64766, 64782, 64797, 64812,
+    64827, 64841, 64856, 64870, 64884, 64899, 64912, 64926, 64940, 64953, 64967, 64980, 64993, 65006, 65018, 65031,
+    65043, 65055, 65067, 65079, 65091, 65103, 65114, 65126, 65137, 65148, 65159, 65169, 65180, 65190, 65200, 65210,
+    65220, 65230, 65240, 65249, 65259, 65268, 65277, 65286, 65294, 65303, 65311, 65320, 65328, 65336, 65343, 65351,
+    65358, 65366, 65373, 65380, 65387, 65393, 65400, 65406, 65413, 65419, 65425, 65430, 65436, 65442, 65447, 65452,
+    65457, 65462, 65467, 65471, 65476, 65480, 65484, 65488, 65492, 65495, 65499, 65502, 65505, 65508, 65511, 65514,
+    65516, 65519, 65521, 65523, 65525, 65527, 65528, 65530, 65531, 65532, 65533, 65534, 65535, 65535, 65536, 65536,
+    65536
+};
+
+// `atan(i/ATAN_STEPS)` in 1/65536ths of a turn, rounded to the nearest integer.
+#define ATAN_STEPS 512
+static const int32_t ATAN_TABLE[ATAN_STEPS + 1] = {
+    0, 20, 41, 61, 81, 102, 122, 143, 163, 183, 204, 224, 244, 265, 285, 305,
+    326, 346, 367, 387, 407, 428, 448, 468, 489, 509, 529, 550, 570, 590, 610, 631,
+    651, 671, 692, 712, 732, 752, 773, 793, 813, 833, 854, 874, 894, 914, 935, 955,
+    975, 995, 1015, 1036, 1056, 1076, 1096, 1116, 1136, 1156, 1177, 1197, 1217, 1237, 1257, 1277,
+    1297, 1317, 1337, 1357, 1377, 1397, 1417, 1437, 1457, 1477, 1497, 1517, 1537, 1557, 1577, 1597,
+    1617, 1637, 1656, 1676, 1696, 1716, 1736, 1756, 1775, 1795, 1815, 1835, 1854, 1874, 1894, 1914,
+    1933, 1953, 1973, 1992, 2012, 2031, 2051, 2071, 2090, 2110, 2129, 2149, 2168, 2188, 2207, 2227,
+    2246, 2266, 2285, 2305, 2324, 2343, 2363, 2382, 2401, 2421, 2440, 2459, 2478, 2498, 2517, 2536,
+    2555, 2574, 2594, 2613, 2632, 2651, 2670, 2689, 2708, 2727, 2746, 2765, 2784, 2803, 2822, 2841,
+    2860, 2879, 2897, 2916, 2935, 2954, 2973, 2991, 3010, 3029, 3047, 3066, 3085, 3103, 3122, 3141,
+    3159, 3178, 3196, 3215, 3233, 3252, 3270, 3289, 3307, 3325, 3344, 3362, 3380, 3399, 3417, 3435,
+    3453, 3472, 3490, 3508, 3526, 3544, 3562, 3580, 3599, 3617, 3635, 3653, 3670, 3688, 3706, 3724,
+    3742, 3760, 3778, 3796, 3813, 3831, 3849, 3867, 3884, 3902, 3920, 3937, 3955, 3972, 3990, 4007,
+    4025, 4042, 4060, 4077, 4095, 4112, 4129, 4147, 4164, 4181, 4199, 4216, 4233, 4250, 4267, 4284,
+    4302, 4319, 4336, 4353, 4370, 4387, 4404, 4421, 4438, 4454, 4471, 4488, 4505, 4522, 4539, 4555,
+    4572, 4589, 4605, 4622, 4639, 4655, 4672, 4688, 4705, 4721, 4738, 4754, 4771, 4787, 4803, 4820,
+    4836, 4852, 4869, 4885, 4901, 4917, 4933, 4949, 4966, 4982, 4998, 5014, 5030, 5046, 5062, 5078,
+    5094, 5109, 5125, 5141, 5157, 5173, 5188, 5204, 5220, 5235, 5251, 5267, 5282, 5298, 5313, 5329,
+    5344, 5360, 5375, 5391, 5406, 5421, 5437, 5452, 5467, 5483, 5498, 5513, 5528, 5543, 5559, 5574,
+    5589, 5604, 5619, 5634, 5649, 5664, 5679, 5694, 5708, 5723, 5738, 5753, 5768, 5782, 5797, 5812,
+    5826, 5841, 5856, 5870, 5885, 5899, 5914, 5928, 5943, 5957, 5972, 5986, 6000, 6015, 6029, 6043,
+    6058, 6072, 6086, 6100, 6114, 6128, 6142, 6157, 6171, 6185, 6199, 6213, 6227, 6240, 6254, 6268,
+    6282, 6296, 6310, 6323, 6337, 6351, 6365, 6378, 6392, 6406, 6419, 6433, 6446, 6460, 6473, 6487,
+    6500, 6514, 6527, 6540, 6554, 6567, 6580, 6594, 6607, 6620, 6633, 6646, 6660, 6673, 6686, 6699,
+    6712, 6725, 6738, 6751, 6764, 6777, 6790, 6803, 6815, 6828, 6841, 6854, 6867, 6879, 6892, 6905,
+    6917, 6930, 6943, 6955, 6968, 6980, 6993, 7005, 7018, 7030, 7043, 7055, 7068, 7080, 7092, 7105,
+    7117, 7129, 7141, 7154, 7166, 7178, 7190, 7202, 7214, 7226, 7238, 7250, 7262, 7274, 7286, 7298,
+    7310, 7322, 7334, 7346, 7358, 7369, 7381, 7393, 7405, 7416, 7428, 7440, 7451, 7463, 7475, 7486,
+    7498, 7509, 7521, 7532, 7544, 7555, 7566, 7578, 7589, 7601, 7612, 7623, 7635, 7646, 7657, 7668,
+    7679, 7691, 7702, 7713, 7724, 7735, 7746, 7757, 7768, 7779, 7790, 7801, 7812, 7823, 7834, 7845,
+    7856, 7866, 7877, 7888, 7899, 7910, 7920, 7931, 7942, 7952, 7963, 7974, 7984, 7995, 8005, 8016,
+    8026, 8037, 8047, 8058, 8068, 8079, 8089, 8100, 8110, 8120, 8131, 8141, 8151, 8161, 8172, 8182,
+    8192
+};
+
+
+int32_t fixed_sin(int32_t angle) {
+    uint32_t turn_angle = (uint32_t) angle % FIXED_TURN;
+    uint32_t quarter = turn_angle / FIXED_QUARTER_TURN, offset = turn_angle % FIXED_QUARTER_TURN;
+    int32_t value = SIN_TABLE[quarter & 1 ? FIXED_QUARTER_TURN - offset : offset];
+    return quarter & 2 ? -value : value;
+}
+
+int32_t fixed_cos(int32_t angle) {
+    return fixed_sin((int32_t) ((uint32_t) angle + FIXED_QUARTER_TURN));
+}
+
+
+int32_t fixed_sqrt(int32_t value) {
+    uint32_t remainder = (uint32_t) value, root = 0;
+    for (uint32_t bit = 1u << 30; bit; bit >>= 2) {
+        if (remainder >= root + bit) {
+            remainder -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+    }
+    return (int32_t) root;
+}
+
+
+// The arctangent of `ratio`/65536, which is at most 1, in 1/65536ths of a turn.
+static int32_t atan_ratio(int64_t ratio) {
+    int64_t index = ratio >> 7, fraction = ratio & 127;
+    if (index >= ATAN_STEPS) {
+        return ATAN_TABLE[ATAN_STEPS];
+    }
+    return ATAN_TABLE[index] + (int32_t) (((ATAN_TABLE[index+1] - ATAN_TABLE[index]) * fraction + 64) >> 7);
+}
+
+int32_t fixed_atan2(int32_t y, int32_t x) {
+    if (x == 0 && y == 0) {
+        return 0;
+    }
+    int64_t abs_x = x < 0 ? -(int64_t) x : x, abs_y = y < 0 ? -(int64_t) y : y;
+
+    // Find the angle in the first octant in 1/65536ths of a turn, then mirror it out to the point's quadrant
+    int32_t angle = abs_y <= abs_x ? atan_ratio((abs_y << 16) / abs_x) : 16384 - atan_ratio((abs_x << 16) / abs_y);
+    if (x < 0) {
+        angle = 32768 - angle;
+    }
+    angle = (angle + 8) >> 4;
+    return y < 0 ? -angle : angle;
+}
@@ -0,0 +1,41 @@
+/*
+    Fixed-point math run by the `sin`, `cos`, `sqrt` and `atan2` instructions.
+
+    Values are 16.16 fixed point, so `FIXED_ONE` is 1.0, and angles are in 1/4096ths of a turn.
+*/
+
+#ifndef FIXED_MATH_HEADER
+#define FIXED_MATH_HEADER
+
+#include <stdint.h>
+
+#define FIXED_ONE 65536
+#define FIXED_TURN 4096
+#define FIXED_QUARTER_TURN (FIXED_TURN / 4)
+
+
+// The sine and cosine of `angle` times `FIXED_ONE`, rounded to the nearest integer. Any angle is allowed.
+int32_t fixed_sin(int32_t angle);
+int32_t fixed_cos(int32_t angle);
+
+// The square root of `value` read as an unsigned integer, rounded down.
+int32_t fixed_sqrt(int32_t value);
+
+// The angle of the point (`x`, `y`), from -`FIXED_TURN`/2 to `FIXED_TURN`/2. The angle of (0, 0) is 0.
+int32_t fixed_atan2(int32_t y, int32_t x);
+
+
+// Absolute value, where the smallest integer stays the same like it does in two's complement.
+static inline int32_t fixed_abs(int32_t value) {
+    return value < 0 ? (int32_t) (0u - (uint32_t) value) : value;
+}
+
+static inline int32_t fixed_min(int32_t a, int32_t b) {
+    return a < b ? a : b;
+}
+
+static inline int32_t fixed_max(int32_t a, int32_t b) {
+    return a > b ? a : b;
+}
+
+#endif
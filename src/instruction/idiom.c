@@ -0,0 +1,168 @@
+/*
+    Recognition of counted loops that fill memory, copy memory or draw a row of pixels,
+    so the interpreter can run them as one native operation.
+*/
+
+#include <stdlib.h>
+#include "instruction.h"
+#include "decode.h"
+#include "idiom.h"
+
+
+// Returns the index of `address` in the counting variables of `loop`, or -1.
+static int find_variable(const CountedLoop *loop, int32_t address) {
+    for (byte i = 0; i < loop->variable_count; i++) {
+        if (loop->variables[i] == address) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+// Returns true if `ins` is `add v $v 1` or `add v 1 $v`, and sets `variable` to `v`.
+static bool is_increment(const DecodedInstruction *ins, int32_t *variable) {
+    if (ins->opcode != OP_ADD) {
+        return false;
+    }
+    bool increment = (ins->modes == MODES_LML && ins->operands[1] == ins->operands[0] && ins->operands[2] == 1)
+        || (ins->modes == MODES_LLM && ins->operands[2] == ins->operands[0] && ins->operands[1] == 1);
+    *variable = ins->operands[0];
+    return increment;
+}
+
+
+static bool in_memory(int32_t address, size_t memory_size) {
+    return address >= 0 && (size_t) address < memory_size;
+}
+
+
+// Returns true if a counted loop that runs as an `Idiom` starts at `head`, and describes it in `loop`.
+static bool match_counted_loop(const DecodedInstruction *instructions, size_t decoded_count, size_t head, size_t memory_size, CountedLoop *loop) {
+    // The loop ends at the first jump, which has to go back to the head
+    size_t end = head;
+    while (end < decoded_count && end - head < MAX_IDIOM_LENGTH && instructions[end].opcode != OP_JMP) {
+        end++;
+    }
+    if (end >= decoded_count || end - head >= MAX_IDIOM_LENGTH || end < head + 3) {
+        return false;
+    }
+    const DecodedInstruction *jump = &instructions[end];
+    const DecodedInstruction *compare = &instructions[end-1];
+    if (jump->modes != MODES_LM || jump->operands[0] != (int32_t) head) {
+        return false;
+    }
+    if (compare->opcode != OP_LESS || (compare->modes & 3) != MODES_LM || compare->operands[0] != jump->operands[1]) {
+        return false;
+    }
+
+    // The rest of the body is the effect and the increments
+    size_t increment_indices[MAX_IDIOM_LENGTH];
+    const DecodedInstruction *effect = NULL;
+    size_t effect_index = 0;
+    loop->variable_count = 0;
+    for (size_t i = head; i < end-1; i++) {
+        const DecodedInstruction *ins = &instructions[i];
+        int32_t variable;
+        if (is_increment(ins, &variable)) {
+            if (find_variable(loop, variable) >= 0 || !in_memory(variable, memory_size)) {
+                return false;
+            }
+            increment_indices[loop->variable_count] = i;
+            loop->variables[loop->variable_count++] = variable;
+        }
+        else if (!effect) {
+            effect = ins;
+            effect_index = i;
+        }
+        else {
+            return false;
+        }
+    }
+
+    loop->length = end - head + 1;
+    loop->condition = compare->operands[0];
+    loop->counter = compare->operands[1];
+    loop->bound = compare->operands[2];
+    loop->bound_address = compare->modes & 4;
+    if (!effect || find_variable(loop, loop->counter) < 0) {
+        return false;
+    }
+    if (find_variable(loop, loop->condition) >= 0 || !in_memory(loop->condition, memory_size)) {
+        return false;
+    }
+    if (loop->bound_address) {
+        if (find_variable(loop, loop->bound) >= 0 || loop->bound == loop->condition || !in_memory(loop->bound, memory_size)) {
+            return false;
+        }
+    }
+
+    // Find which operands of the effect count. The others have to stay the same throughout the loop.
+    loop->effect = *effect;
+    byte counting = 0;
+    for (byte i = 0; i < MAX_ARGUMENTS; i++) {
+        loop->effect_counts[i] = -1;
+        if (i >= decoded_argument_count(effect->opcode) || !(effect->modes & (1 << i))) {
+            continue;
+        }
+        int32_t address = effect->operands[i];
+        int variable = find_variable(loop, address);
+        if (variable >= 0) {
+            loop->effect_counts[i] = increment_indices[variable] < effect_index;
+            counting |= 1 << i;
+        }
+        else if (address == loop->condition || !in_memory(address, memory_size)) {
+            return false;
+        }
+    }
+
+    switch (effect->opcode) {
+        case OP_MOV:
+            loop->idiom = IDIOM_FILL;
+            return counting == 0x1;
+        case OP_MOVP:
+            loop->idiom = IDIOM_COPY;
+            return counting == 0x3;
+        #ifndef ENABLE_G1_GPU_RENDERING
+        case OP_POINT:
+            loop->idiom = IDIOM_SPAN;
+            return counting == 0x1 || counting == 0x2;
+        #endif
+        default:
+            return false;
+    }
+}
+
+
+void recognize_idioms(DecodedInstruction *instructions, size_t decoded_count, size_t memory_size, CountedLoopList *counted_loops) {
+    counted_loops->loops = NULL;
+    counted_loops->count = 0;
+    size_t capacity = 0;
+
+    for (size_t i = 0; i < decoded_count; i++) {
+        CountedLoop loop;
+        if (!match_counted_loop(instructions, decoded_count, i, memory_size, &loop)) {
+            continue;
+        }
+
+        if (counted_loops->count == capacity) {
+            size_t new_capacity = capacity ? capacity * 2 : 8;
+            CountedLoop *loops = realloc(counted_loops->loops, sizeof(CountedLoop) * new_capacity);
+            if (!loops) {
+                return;
+            }
+            counted_loops->loops = loops;
+            capacity = new_capacity;
+        }
+        counted_loops->loops[counted_loops->count] = loop;
+        instructions[i].idiom = loop.idiom;
+        instructions[i].operands[3] = counted_loops->count++;
+    }
+}
+
+
+void free_counted_loops(CountedLoopList *counted_loops) {
+    free(counted_loops->loops);
+    counted_loops->loops = NULL;
+    counted_loops->count = 0;
+}
@@ -0,0 +1,57 @@
+/*
+    Recognition of counted loops that fill memory, copy memory or draw a row of pixels,
+    so the interpreter can run them as one native operation.
+*/
+
+#ifndef IDIOM_HEADER
+#define IDIOM_HEADER
+
+#include "decode.h"
+
+#define MAX_IDIOM_LENGTH 8
+
+
+/*
+A counted loop of up to `MAX_IDIOM_LENGTH` instructions:
+
+    head:
+        <one effect instruction and any number of `add v $v 1` increments, in any order>
+        less c $counter bound
+        jmp head $c
+
+Every counting variable is incremented exactly once per iteration, so the loop runs `bound - counter` times
+(at least once) and leaves every variable advanced by that many and `c` set to 0.
+*/
+typedef struct {
+    byte idiom;
+    byte length;  // Instructions from the head up to and including the jump back
+    DecodedInstruction effect;  // The instruction in the body that isn't an increment
+
+    // For each operand of `effect`, -1 if it isn't a counting variable, otherwise 1 if the variable is
+    // incremented before `effect` in an iteration and 0 if it's incremented after
+    int8_t effect_counts[MAX_ARGUMENTS];
+
+    int32_t variables[MAX_IDIOM_LENGTH];
+    byte variable_count;
+    int32_t counter, condition;
+    int32_t bound;
+    bool bound_address;  // `bound` is an address rather than a literal
+} CountedLoop;
+
+struct CountedLoopList {
+    CountedLoop *loops;
+    size_t count;
+};
+
+
+/*
+Find every counted loop that runs as an `Idiom` and describe it in `counted_loops`.
+The first instruction of each loop gets its idiom, with the index of its `CountedLoop` as its fourth operand.
+Every address a loop uses directly must be inside a memory of `memory_size` slots. Loops that can't be stored are left
+to run as they are.
+*/
+void recognize_idioms(DecodedInstruction *instructions, size_t decoded_count, size_t memory_size, CountedLoopList *counted_loops);
+
+void free_counted_loops(CountedLoopList *counted_loops);
+
+#endif
@@ -29,10 +29,43 @@ const char *INSTRUCTIONS[AMOUNT_INSTRUCTIONS] = {
     "rect",
     "putc",
     "getp",
-    "setch"
+    "setch",
+    "call",
+    "ret",
+    "and",
+    "or",
+    "xor",
+    "shl",
+    "shr",
+    "sar",
+    "sin",
+    "cos",
+    "sqrt",
+    "abs",
+    "min",
+    "max",
+    "atan2",
+    "memfill",
+    "memcopy",
+    "memcmp",
+    "blit",
+    "blitkey",
+    "copyrect",
+    "tri"
 };
 
-const byte ARGUMENT_COUNTS[AMOUNT_INSTRUCTIONS] = {2, 2, 3, 3, 3, 3, 3, 3, 3, 2, 2, 3, 2, 4, 4, 1, 3, 4};
+const byte ARGUMENT_COUNTS[AMOUNT_INSTRUCTIONS] = {2, 2, 3, 3, 3, 3, 3, 3, 3, 2, 2, 3, 2, 4, 4, 1, 3, 4, 1, 0, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 3, 3, 3, 3, 3, 4, 3, 4, 3, 1};
+
+const byte INSTRUCTION_VERSIONS[AMOUNT_INSTRUCTIONS] = {
+    [0 ... OP_SETCH] = G1_VERSION_BASE,
+    [OP_CALL] = G1_VERSION_CALL, [OP_RET] = G1_VERSION_CALL,
+    [OP_AND ... OP_SAR] = G1_VERSION_BITWISE,
+    [OP_SIN ... OP_ATAN2] = G1_VERSION_MATH,
+    [OP_MEMFILL ... OP_MEMCMP] = G1_VERSION_MEMORY,
+    [OP_BLIT ... OP_BLITKEY] = G1_VERSION_BLIT,
+    [OP_COPYRECT] = G1_VERSION_COPYRECT,
+    [OP_TRI] = G1_VERSION_TRI
+};
 
 
 int32_t get_json_int(cJSON *json, const char *name) {
@@ -44,18 +77,52 @@ int32_t get_json_int(cJSON *json, const char *name) {
 }
 
 
-int parse_json_arguments(cJSON *arguments_json, Argument *instruction_args, byte argument_count) {
+// Allocate the arrays of `instructions` for `instruction_count` instructions with up to 4 arguments each.
+static int allocate_instructions(InstructionList *instructions, size_t instruction_count) {
+    instructions->codes = malloc(sizeof(uint16_t) * instruction_count);
+    instructions->offsets = malloc(sizeof(uint32_t) * instruction_count);
+    instructions->operands = malloc(sizeof(int32_t) * 4 * instruction_count);
+    if (!instructions->codes || !instructions->offsets || !instructions->operands) {
+        free_instructions(instructions);
+        printf("Failed to allocate memory for instructions.\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+// Give back the operand space that instructions with fewer than 4 arguments didn't use.
+static void shrink_operands(InstructionList *instructions, size_t operand_count) {
+    int32_t *operands = realloc(instructions->operands, sizeof(int32_t) * (operand_count ? operand_count : 1));
+    if (operands) {
+        instructions->operands = operands;
+    }
+}
+
+
+void free_instructions(InstructionList *instructions) {
+    free(instructions->codes);
+    free(instructions->offsets);
+    free(instructions->operands);
+    instructions->codes = NULL;
+    instructions->offsets = NULL;
+    instructions->operands = NULL;
+}
+
+
+// Parse `argument_count` arguments into `operands` and return their addressing modes, or -1 on failure.
+int parse_json_arguments(cJSON *arguments_json, int32_t *operands, byte argument_count) {
+    int modes = 0;
     for (size_t i = 0; i < argument_count; i++) {
         cJSON *argument_value = cJSON_GetArrayItem(arguments_json, i);
 
         if (cJSON_IsNumber(argument_value)) {
-            Argument arg = {0, (int32_t) cJSON_GetNumberValue(argument_value)};
-            instruction_args[i] = arg;
+            operands[i] = (int32_t) cJSON_GetNumberValue(argument_value);
         }
         else if (cJSON_IsString(argument_value)) {
             char *address_string = cJSON_GetStringValue(argument_value);
-            Argument arg = {1, (int32_t) atoi(address_string+1)};
-            instruction_args[i] = arg;
+            operands[i] = (int32_t) atoi(address_string+1);
+            modes |= 1 << i;
         }
         else {
             char *argument_value_string = cJSON_Print(argument_value);
@@ -63,7 +130,24 @@ int parse_json_arguments(cJSON *arguments_json, Argument *instruction_args, byte
             return -1;
         }
     }
-    return 0;
+    return modes;
+}
+
+
+// Returns true if a program of `version` may use `opcode`, and prints why not otherwise.
+static bool check_opcode(byte opcode, int32_t version, size_t index) {
+    if (opcode >= AMOUNT_INSTRUCTIONS) {
+        printf("Unrecognized opcode at index %ld: %d\n", index, opcode);
+        return false;
+    }
+    if (INSTRUCTION_VERSIONS[opcode] > version) {
+        printf(
+            "Instruction \"%s\" at index %ld needs program version %d, but the program is version %d.\n",
+            INSTRUCTIONS[opcode], index, INSTRUCTION_VERSIONS[opcode], version
+        );
+        return false;
+    }
+    return true;
 }
 
 
@@ -77,48 +161,65 @@ byte get_opcode(char *instruction_name) {
 }
 
 
-Instruction* parse_instructions_json(cJSON *instructions_json) {
+int parse_instructions_json(cJSON *instructions_json, int32_t version, InstructionList *instructions) {
     size_t instruction_count = cJSON_GetArraySize(instructions_json);
-    Instruction *instructions = malloc(sizeof(Instruction) * instruction_count);
-    if (!instructions) {
-        printf("Failed to allocate memory for instructions.\n");
-        return NULL;
+    if (allocate_instructions(instructions, instruction_count) < 0) {
+        return -1;
     }
 
+    uint32_t operand_count = 0;
     for (size_t i = 0; i < instruction_count; i++) {
         cJSON *instruction_data = cJSON_GetArrayItem(instructions_json, i);
         char *instruction_name = cJSON_GetStringValue(cJSON_GetArrayItem(instruction_data, 0));
         byte opcode = get_opcode(instruction_name);
         if (opcode == 255) {
-            free(instructions);
+            free_instructions(instructions);
             printf("Unrecognized instruction at index %ld: \"%s\"\n", i, instruction_name);
-            return NULL;
+            return -1;
+        }
+        if (!check_opcode(opcode, version, i)) {
+            free_instructions(instructions);
+            return -1;
         }
-        instructions[i].opcode = opcode;
         byte argument_count = ARGUMENT_COUNTS[opcode];
-        int parse_arguments_response = parse_json_arguments(cJSON_GetArrayItem(instruction_data, 1), instructions[i].arguments, argument_count);
-        if (parse_arguments_response < 0) {
-            free(instructions);
-            return NULL;
+        int modes = parse_json_arguments(cJSON_GetArrayItem(instruction_data, 1), &instructions->operands[operand_count], argument_count);
+        if (modes < 0) {
+            free_instructions(instructions);
+            return -1;
         }
+        instructions->codes[i] = INSTRUCTION_CODE(opcode, modes);
+        instructions->offsets[i] = operand_count;
+        operand_count += argument_count;
     }
-    return instructions;
+    shrink_operands(instructions, operand_count);
+    return 0;
 }
 
 
-Instruction* parse_instructions_binary(size_t instruction_count, BytesIterator *iter) {
-    Instruction *instructions = malloc(sizeof(Instruction) * instruction_count);
+int parse_instructions_binary(size_t instruction_count, int32_t version, BytesIterator *iter, InstructionList *instructions) {
+    if (allocate_instructions(instructions, instruction_count) < 0) {
+        return -1;
+    }
+
+    uint32_t operand_count = 0;
     for (size_t i = 0; i < instruction_count; i++) {
-        Instruction *ins = &instructions[i];
-        bi_next_n(&ins->opcode, iter, 1);
-        size_t argument_count = ARGUMENT_COUNTS[ins->opcode];
+        byte opcode, modes = 0;
+        bi_next_n(&opcode, iter, 1);
+        if (!check_opcode(opcode, version, i)) {
+            free_instructions(instructions);
+            return -1;
+        }
+        size_t argument_count = ARGUMENT_COUNTS[opcode];
         for (size_t j = 0; j < argument_count; j++) {
-            Argument arg;
-            bi_next_n(&arg.type, iter, 1);
-            bi_next_n(&arg.value, iter, 4);
-            ins->arguments[j] = arg;
+            byte type;
+            bi_next_n(&type, iter, 1);
+            bi_next_n(&instructions->operands[operand_count+j], iter, 4);
+            modes |= (type == 1) << j;  // Address
         }
+        instructions->codes[i] = INSTRUCTION_CODE(opcode, modes);
+        instructions->offsets[i] = operand_count;
+        operand_count += argument_count;
     }
-
-    return instructions;
+    shrink_operands(instructions, operand_count);
+    return 0;
 }
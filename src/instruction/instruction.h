@@ -7,7 +7,7 @@
 
 #include "util.h"
 
-#define AMOUNT_INSTRUCTIONS 18
+#define AMOUNT_INSTRUCTIONS 40
 
 #define OP_MOV 0
 #define OP_MOVP 1
@@ -27,33 +27,87 @@
 #define OP_PUTC 15
 #define OP_GETP 16
 #define OP_SETCH 17
+#define OP_CALL 18
+#define OP_RET 19
+#define OP_AND 20
+#define OP_OR 21
+#define OP_XOR 22
+#define OP_SHL 23
+#define OP_SHR 24
+#define OP_SAR 25
+#define OP_SIN 26
+#define OP_COS 27
+#define OP_SQRT 28
+#define OP_ABS 29
+#define OP_MIN 30
+#define OP_MAX 31
+#define OP_ATAN2 32
+#define OP_MEMFILL 33
+#define OP_MEMCOPY 34
+#define OP_MEMCMP 35
+#define OP_BLIT 36
+#define OP_BLITKEY 37
+#define OP_COPYRECT 38
+#define OP_TRI 39
 
+/*
+Instruction set versions. A program declares the version it's written for in its `version` metadata,
+and may only use the instructions that version has.
+*/
+#define G1_VERSION_BASE 1
+#define G1_VERSION_CALL 2  // Adds `call` and `ret`
+#define G1_VERSION_BITWISE 3  // Adds `and`, `or`, `xor`, `shl`, `shr` and `sar`
+#define G1_VERSION_MATH 4  // Adds `sin`, `cos`, `sqrt`, `abs`, `min`, `max` and `atan2`
+#define G1_VERSION_MEMORY 5  // Adds `memfill`, `memcopy` and `memcmp`
+#define G1_VERSION_BLIT 6  // Adds `blit` and `blitkey`
+#define G1_VERSION_COPYRECT 7  // Adds `copyrect`
+#define G1_VERSION_TRI 8  // Adds `tri`
+#define G1_LATEST_VERSION G1_VERSION_TRI
+
+extern const char *INSTRUCTIONS[];
 extern const byte ARGUMENT_COUNTS[];
+extern const byte INSTRUCTION_VERSIONS[];  // The first version that has each instruction
 
 /*
-A g1 instruction argument.
-type:
-- `0` - Integer literal
-- `1` - Address
+Parsed g1 instructions in a packed structure-of-arrays layout, so large programs take little memory while they load.
+Programs run from their decoded and threaded instructions, see `decode.h`, so these are freed once they're decoded.
+Instruction `i` is described by `codes[i]`, which holds its opcode in the low byte and has bit `8+j` set if
+argument `j` is an address rather than an integer literal. Only the arguments the opcode has are stored,
+starting at `operands[offsets[i]]`.
 */
 typedef struct {
-    byte type;
-    int32_t value;
-} Argument;
+    uint16_t *codes;
+    uint32_t *offsets;
+    int32_t *operands;
+} InstructionList;
 
-// A single g1 instruction.
-typedef struct {
-    byte opcode;
-    Argument arguments[4];
-} Instruction;
+#define INSTRUCTION_CODE(opcode, modes) ((uint16_t) ((opcode) | ((modes) << 8)))
+
+static inline byte instruction_opcode(const InstructionList *instructions, size_t index) {
+    return instructions->codes[index] & 0xff;
+}
+
+static inline byte instruction_modes(const InstructionList *instructions, size_t index) {
+    return instructions->codes[index] >> 8;
+}
+
+static inline const int32_t* instruction_operands(const InstructionList *instructions, size_t index) {
+    return &instructions->operands[instructions->offsets[index]];
+}
 
 // Get a uint32 from `json`.
 int32_t get_json_int(cJSON *json, const char *name);
 
-// Convert a json instructions array into an array of `Instruction` structs.
-Instruction* parse_instructions_json(cJSON *instructions_json);
+// Convert a json instructions array into `instructions`, which may only use the instructions `version` has.
+int parse_instructions_json(cJSON *instructions_json, int32_t version, InstructionList *instructions);
+
+/*
+Read `instruction_count` instructions into `instructions` from an iterator starting at the instruction array index.
+The instructions may only use the instructions `version` has.
+*/
+int parse_instructions_binary(size_t instruction_count, int32_t version, BytesIterator *iter, InstructionList *instructions);
 
-// Create an array of `Instruction` structs from an iterator starting at the instruction array index.
-Instruction* parse_instructions_binary(size_t instruction_count, BytesIterator *iter);
+// Free the arrays of `instructions`.
+void free_instructions(InstructionList *instructions);
 
 #endif
\ No newline at end of file
@@ -6,17 +6,45 @@
 #define INSTRUCTION_IMPL_HEADER
 
 #include <stdint.h>
+#include <string.h>
 #include "program.h"
+#include "threaded.h"
 #include "audio_defs.h"
+#include "verify.h"
+#include "idiom.h"
+#include "guard.h"
+#include "fixed_math.h"
+
+// Profiling counts the instructions run by the interpreter, so profiling builds don't compile programs
+#if defined(ENABLE_G1_JIT) && defined(ENABLE_G1_PROFILING)
+    #undef ENABLE_G1_JIT
+#endif
+
+#ifdef ENABLE_G1_JIT
+    #include "jit.h"
+#endif
+
+// Profiling builds interpret the embedded program too
+#if defined(G1_EMBEDDED_AOT) && defined(ENABLE_G1_PROFILING)
+    #undef G1_EMBEDDED_AOT
+#endif
 
 
 #ifndef ENABLE_G1_GPU_RENDERING
     #include "cpu_primitives.h"
+    #include "draw_buffer.h"
+#endif
+
+#ifdef ENABLE_G1_PROFILING
+    #include "profile.h"
 #endif
 
 
 #define INSTRUCTION_ARGUMENT_BUFFER_SIZE 5
 
+// Returned by `run_program_thread` when the thread ran out of its instruction budget
+#define THREAD_SUSPENDED 1
+
 
 static inline void _error(char *message) {
     printf("\x1b[31mRUNTIME ERROR: %s\n", message);
@@ -35,10 +63,37 @@ static inline void _out_of_bounds_error(int32_t address) {
 }
 
 
+static inline void _out_of_bounds_range_error(int32_t start, int64_t count) {
+    char err_buff[256];
+    snprintf(err_buff, 256, "Tried to access out of bounds memory from address %d to %lld\n", start, (long long) (start + count - 1));
+    _error(err_buff);
+}
+
+
+static inline void _call_stack_overflow_error() {
+    _error("Call stack overflow.");
+}
+
+
+static inline void _call_stack_underflow_error() {
+    _error("Returned with an empty call stack.");
+}
+
+
+// Modulo whose result takes the sign of the divisor.
+static inline int32_t _floored_mod(int32_t a, int32_t b) {
+    int32_t mod = a % b;
+    if (mod != 0 && (mod < 0) ^ (b < 0)) {
+        mod += b;
+    }
+    return mod;
+}
+
+
 // Instruction function definitions
 static inline int _set_memory_value(int32_t dest, int32_t value, ProgramContext *program_context) {
     #ifdef ENABLE_G1_RUNTIME_ERRORS
-        if (dest < 0 || dest >= program_context->memory_size) {
+        if (program_context->runtime_errors && (dest < 0 || dest >= program_context->memory_size)) {
             _out_of_bounds_error(dest);
             return -1;
         }
@@ -55,7 +110,7 @@ static inline int _ins_mov(ProgramContext *program_context, int32_t *args) {
 
 static inline int _ins_movp(ProgramContext *program_context, int32_t *args) {
     #ifdef ENABLE_G1_RUNTIME_ERRORS
-        if (args[1] < 0 || args[1] >= program_context->memory_size) {
+        if (program_context->runtime_errors && (args[1] < 0 || args[1] >= program_context->memory_size)) {
             _out_of_bounds_error(args[1]);
             return -2;
         }
@@ -78,7 +133,7 @@ static inline int _ins_mul(ProgramContext *program_context, int32_t *args) {
 
 static inline int _ins_div(ProgramContext *program_context, int32_t *args) {
     #ifdef ENABLE_G1_RUNTIME_ERRORS
-        if (args[2] == 0) {
+        if (program_context->runtime_errors && args[2] == 0) {
             _zero_division_error();
             return -2;
         }
@@ -89,17 +144,13 @@ static inline int _ins_div(ProgramContext *program_context, int32_t *args) {
 
 static inline int _ins_mod(ProgramContext *program_context, int32_t *args) {
     #ifdef ENABLE_G1_RUNTIME_ERRORS
-        if (args[2] == 0) {
+        if (program_context->runtime_errors && args[2] == 0) {
             _zero_division_error();
             return -1;
         }
     #endif
 
-    int32_t mod = args[1] % args[2];
-    if (mod != 0 && (mod < 0) ^ (args[2] < 0)) {
-        mod += args[2];
-    }
-    return _set_memory_value(args[0], mod, program_context);
+    return _set_memory_value(args[0], _floored_mod(args[1], args[2]), program_context);
 }
 
 static inline int _ins_less(ProgramContext *program_context, int32_t *args) {
@@ -115,6 +166,131 @@ static inline int _ins_not(ProgramContext *program_context, int32_t *args) {
     return _set_memory_value(args[0], !args[1], program_context);
 }
 
+static inline int _ins_and(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], args[1] & args[2], program_context);
+}
+
+static inline int _ins_or(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], args[1] | args[2], program_context);
+}
+
+static inline int _ins_xor(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], args[1] ^ args[2], program_context);
+}
+
+static inline int _ins_shl(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], shift_left(args[1], args[2]), program_context);
+}
+
+static inline int _ins_shr(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], shift_right(args[1], args[2]), program_context);
+}
+
+static inline int _ins_sar(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], shift_right_arithmetic(args[1], args[2]), program_context);
+}
+
+static inline int _ins_sin(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], fixed_sin(args[1]), program_context);
+}
+
+static inline int _ins_cos(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], fixed_cos(args[1]), program_context);
+}
+
+static inline int _ins_sqrt(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], fixed_sqrt(args[1]), program_context);
+}
+
+static inline int _ins_abs(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], fixed_abs(args[1]), program_context);
+}
+
+static inline int _ins_min(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], fixed_min(args[1], args[2]), program_context);
+}
+
+static inline int _ins_max(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], fixed_max(args[1], args[2]), program_context);
+}
+
+static inline int _ins_atan2(ProgramContext *program_context, int32_t *args) {
+    return _set_memory_value(args[0], fixed_atan2(args[1], args[2]), program_context);
+}
+
+/*
+Returns true if the `count` slots from `start` are in memory. Bulk memory instructions check their ranges once,
+and skip ranges outside of memory in unchecked threads, since one instruction can reach anywhere.
+*/
+static inline bool _range_in_memory(ProgramContext *program_context, int32_t start, int64_t count) {
+    bool in_memory = start >= 0 && start + count <= program_context->memory_size;
+    #ifdef ENABLE_G1_RUNTIME_ERRORS
+        if (program_context->runtime_errors && !in_memory) {
+            _out_of_bounds_range_error(start, count);
+        }
+    #endif
+    return in_memory;
+}
+
+#ifdef ENABLE_G1_RUNTIME_ERRORS
+    #define _RANGE_ERROR(program_context) ((program_context)->runtime_errors ? -1 : 0)
+#else
+    #define _RANGE_ERROR(program_context) 0
+#endif
+
+static inline int _ins_memfill(ProgramContext *program_context, int32_t *args) {
+    int32_t start = args[0], value = args[1], count = args[2];
+    if (count <= 0) {
+        return 0;
+    }
+    if (!_range_in_memory(program_context, start, count)) {
+        return _RANGE_ERROR(program_context);
+    }
+    int32_t *memory = &program_context->memory[start];
+    if (value == 0) {
+        memset(memory, 0, sizeof(int32_t) * count);
+    }
+    else {
+        for (int32_t i = 0; i < count; i++) {
+            memory[i] = value;
+        }
+    }
+    return 0;
+}
+
+static inline int _ins_memcopy(ProgramContext *program_context, int32_t *args) {
+    int32_t dest = args[0], source = args[1], count = args[2];
+    if (count <= 0) {
+        return 0;
+    }
+    if (!_range_in_memory(program_context, dest, count) || !_range_in_memory(program_context, source, count)) {
+        return _RANGE_ERROR(program_context);
+    }
+    memmove(&program_context->memory[dest], &program_context->memory[source], sizeof(int32_t) * count);
+    return 0;
+}
+
+// Stores -1, 0 or 1 as the first slot that differs is less in `a`, none differ, or it's greater in `a`.
+static inline int _ins_memcmp(ProgramContext *program_context, int32_t *args) {
+    int32_t a = args[1], b = args[2], count = args[3];
+    int32_t result = 0;
+    if (count > 0) {
+        if (!_range_in_memory(program_context, a, count) || !_range_in_memory(program_context, b, count)) {
+            return _RANGE_ERROR(program_context);
+        }
+        const int32_t *memory = program_context->memory;
+        // Equal ranges, the common case, are found by `memcmp`, which can only order bytes
+        if (memcmp(&memory[a], &memory[b], sizeof(int32_t) * count) != 0) {
+            int32_t i = 0;
+            while (memory[a+i] == memory[b+i]) {
+                i++;
+            }
+            result = memory[a+i] < memory[b+i] ? -1 : 1;
+        }
+    }
+    return _set_memory_value(args[0], result, program_context);
+}
+
 static inline int _ins_jmp(ProgramContext *program_context, int32_t *args) {
     if (args[1]) {
         program_context->program_counter = args[0]-1;
@@ -132,11 +308,30 @@ static inline int _ins_color(ProgramContext *program_context, int32_t *args) {
     return 0;
 }
 
+#ifndef ENABLE_G1_GPU_RENDERING
+// Record a draw in deferred mode, see `draw_buffer.h`.
+static inline void _record_draw(ProgramContext *program_context, uint8_t kind, const int32_t *args, int count) {
+    draw_buffer_record(&program_context->draw_buffer, program_context->render_surface, kind, program_context->color, args, count);
+}
+
+// Draw everything recorded in deferred mode, before the surface is read or drawn on some other way.
+static inline void _flush_draws(ProgramContext *program_context) {
+    if (program_context->deferred_drawing) {
+        draw_buffer_flush(&program_context->draw_buffer, program_context->render_surface);
+    }
+}
+#endif
+
 static inline int _ins_point(ProgramContext *program_context, int32_t *args) {
     #ifdef ENABLE_G1_GPU_RENDERING
         return SDL_RenderDrawPoint(program_context->renderer, args[0], args[1]);
     #else
-        surf_draw_point(program_context->render_surface, args[0], args[1], program_context->color);
+        if (program_context->deferred_drawing) {
+            _record_draw(program_context, DRAW_POINT, args, 2);
+        }
+        else {
+            surf_draw_point(program_context->render_surface, args[0], args[1], program_context->color);
+        }
     #endif
 
     return 0;
@@ -146,7 +341,12 @@ static inline int _ins_line(ProgramContext *program_context, int32_t *args) {
     #ifdef ENABLE_G1_GPU_RENDERING
         return SDL_RenderDrawLine(program_context->renderer, args[0], args[1], args[2], args[3]);
     #else
-        surf_draw_line(program_context->render_surface, args[0], args[1], args[2], args[3], program_context->color);
+        if (program_context->deferred_drawing) {
+            _record_draw(program_context, DRAW_LINE, args, 4);
+        }
+        else {
+            surf_draw_line(program_context->render_surface, args[0], args[1], args[2], args[3], program_context->color);
+        }
     #endif
 
     return 0;
@@ -156,7 +356,12 @@ static inline int _ins_rect(ProgramContext *program_context, int32_t *args) {
     #ifdef ENABLE_G1_GPU_RENDERING
         return SDL_RenderFillRect(program_context->renderer, &(SDL_Rect) {args[0], args[1], args[2], args[3]});
     #else
-        surf_draw_rect(program_context->render_surface, args[0], args[1], args[2], args[3], program_context->color);
+        if (program_context->deferred_drawing) {
+            _record_draw(program_context, DRAW_RECT, args, 4);
+        }
+        else {
+            surf_draw_rect(program_context->render_surface, args[0], args[1], args[2], args[3], program_context->color);
+        }
     #endif
 
     return 0;
@@ -169,7 +374,8 @@ static inline int _ins_putc(ProgramContext *program_context, int32_t *args) {
 
 static inline int _ins_getp(ProgramContext *program_context, int32_t *args) {
     #ifdef ENABLE_G1_RUNTIME_ERRORS
-        if (args[1] < 0 || args[1] >= program_context->render_surface->w || args[2] < 0 || args[2] >= program_context->render_surface->h) {
+        bool out_of_bounds = args[1] < 0 || args[1] >= program_context->render_surface->w || args[2] < 0 || args[2] >= program_context->render_surface->h;
+        if (program_context->runtime_errors && out_of_bounds) {
             char err_buff[256];
             snprintf(err_buff, 256, "Tried to access out of bounds pixel at (%d, %d)\n", args[1], args[2]);
             _error(err_buff);
@@ -177,6 +383,9 @@ static inline int _ins_getp(ProgramContext *program_context, int32_t *args) {
         }
     #endif
 
+    #ifndef ENABLE_G1_GPU_RENDERING
+        _flush_draws(program_context);
+    #endif
     SDL_Surface *surf = program_context->render_surface;
     uint32_t *pixels = (uint32_t*) surf->pixels;
     uint32_t raw_pixel = pixels[args[1] + (args[2] * surf->w)];
@@ -188,15 +397,135 @@ static inline int _ins_getp(ProgramContext *program_context, int32_t *args) {
 }
 
 
+/*
+Draw the image at `address`, laid out like the `img` data operation lays it out: its width, its height, then every
+pixel packed like `getp` returns it. If `keyed` is set, pixels of color `key` aren't drawn.
+*/
+static inline int _blit(ProgramContext *program_context, int32_t address, int32_t x, int32_t y, bool keyed, int32_t key) {
+    if (!_range_in_memory(program_context, address, 2)) {
+        return _RANGE_ERROR(program_context);
+    }
+    int32_t width = program_context->memory[address], height = program_context->memory[address+1];
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+    int64_t pixel_count = (int64_t) width * height;
+    if (!_range_in_memory(program_context, address+2, pixel_count)) {
+        return _RANGE_ERROR(program_context);
+    }
+    const int32_t *image = &program_context->memory[address+2];
+
+    #ifdef ENABLE_G1_GPU_RENDERING
+        // Transparent pixels get an alpha of 0, and the texture is blended so they don't show
+        SDL_Texture *texture = SDL_CreateTexture(program_context->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, width, height);
+        Uint32 *pixels = malloc(sizeof(Uint32) * pixel_count);
+        int response = -1;
+        if (texture && pixels) {
+            for (int64_t i = 0; i < pixel_count; i++) {
+                Uint32 r = image[i] & 0xff, g = (image[i] >> 8) & 0xff, b = (image[i] >> 16) & 0xff;
+                pixels[i] = (keyed && image[i] == key ? 0 : 0xff000000) | (r << 16) | (g << 8) | b;
+            }
+            SDL_UpdateTexture(texture, NULL, pixels, width * sizeof(Uint32));
+            SDL_SetTextureBlendMode(texture, keyed ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE);
+            response = SDL_RenderCopy(program_context->renderer, texture, NULL, &(SDL_Rect) {x, y, width, height});
+        }
+        free(pixels);
+        if (texture) {
+            SDL_DestroyTexture(texture);
+        }
+        return response;
+    #else
+        _flush_draws(program_context);
+        surf_blit_packed(program_context->render_surface, x, y, width, height, image, keyed, key);
+        return 0;
+    #endif
+}
+
+static inline int _ins_blit(ProgramContext *program_context, int32_t *args) {
+    return _blit(program_context, args[0], args[1], args[2], false, 0);
+}
+
+static inline int _ins_blitkey(ProgramContext *program_context, int32_t *args) {
+    return _blit(program_context, args[0], args[1], args[2], true, args[3]);
+}
+
+/*
+`copyrect rect_address x y`: copy the rectangle stored at `rect_address` as its x, y, width and height
+so its top left corner is at (`x`, `y`).
+*/
+static inline int _ins_copyrect(ProgramContext *program_context, int32_t *args) {
+    if (!_range_in_memory(program_context, args[0], 4)) {
+        return _RANGE_ERROR(program_context);
+    }
+    const int32_t *rect = &program_context->memory[args[0]];
+
+    #ifdef ENABLE_G1_GPU_RENDERING
+        // Read the source back from the renderer's output, which is scaled up by the pixel size
+        SDL_Renderer *renderer = program_context->renderer;
+        SDL_Rect source_rect;
+        if (!SDL_IntersectRect(&(SDL_Rect) {rect[0], rect[1], rect[2], rect[3]}, &(SDL_Rect) {0, 0, program_context->render_surface->w, program_context->render_surface->h}, &source_rect)) {
+            return 0;
+        }
+        float scale_x, scale_y;
+        SDL_RenderGetScale(renderer, &scale_x, &scale_y);
+        SDL_Rect read_rect = {source_rect.x * scale_x, source_rect.y * scale_y, source_rect.w * scale_x, source_rect.h * scale_y};
+
+        SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, read_rect.w, read_rect.h);
+        Uint32 *pixels = malloc(sizeof(Uint32) * read_rect.w * read_rect.h);
+        int response = -1;
+        if (texture && pixels && !SDL_RenderReadPixels(renderer, &read_rect, SDL_PIXELFORMAT_ARGB8888, pixels, read_rect.w * sizeof(Uint32))) {
+            SDL_UpdateTexture(texture, NULL, pixels, read_rect.w * sizeof(Uint32));
+            SDL_Rect dest_rect = {source_rect.x + args[1] - rect[0], source_rect.y + args[2] - rect[1], source_rect.w, source_rect.h};
+            response = SDL_RenderCopy(renderer, texture, NULL, &dest_rect);
+        }
+        free(pixels);
+        if (texture) {
+            SDL_DestroyTexture(texture);
+        }
+        return response;
+    #else
+        _flush_draws(program_context);
+        surf_copy_rect(program_context->render_surface, rect[0], rect[1], rect[2], rect[3], args[1], args[2]);
+        return 0;
+    #endif
+}
+
+// `tri points_address`: draw a filled triangle whose corners are stored at `points_address` as x1, y1, x2, y2, x3, y3.
+static inline int _ins_tri(ProgramContext *program_context, int32_t *args) {
+    if (!_range_in_memory(program_context, args[0], 6)) {
+        return _RANGE_ERROR(program_context);
+    }
+    const int32_t *points = &program_context->memory[args[0]];
+
+    #ifdef ENABLE_G1_GPU_RENDERING
+        SDL_Color color;
+        SDL_GetRenderDrawColor(program_context->renderer, &color.r, &color.g, &color.b, &color.a);
+        SDL_Vertex vertices[3];
+        for (int i = 0; i < 3; i++) {
+            vertices[i] = (SDL_Vertex) {{points[i*2], points[i*2 + 1]}, color, {0, 0}};
+        }
+        return SDL_RenderGeometry(program_context->renderer, NULL, vertices, 3, NULL, 0);
+    #else
+        if (program_context->deferred_drawing) {
+            _record_draw(program_context, DRAW_TRI, points, 6);
+        }
+        else {
+            surf_draw_triangle(program_context->render_surface, points, program_context->color);
+        }
+        return 0;
+    #endif
+}
+
+
 static inline int _ins_setch(ProgramContext *program_context, int32_t *args) {
     #ifdef ENABLE_G1_RUNTIME_ERRORS
         char err_buff[256];
-        if (args[0] >= AMOUNT_AUDIO_CHANNELS) {
+        if (program_context->runtime_errors && args[0] >= AMOUNT_AUDIO_CHANNELS) {
             snprintf(err_buff, 256, "Tried to set channel %d, but only %d channels exist.\n", args[0], AMOUNT_AUDIO_CHANNELS);
             _error(err_buff);
             return -1;
         }
-        if (args[1] >= AMOUNT_WAVEFORMS) {
+        if (program_context->runtime_errors && args[1] >= AMOUNT_WAVEFORMS) {
             snprintf(err_buff, 256, "Tried to set to waveform %d, but only %d waveforms exist.\n", args[1], AMOUNT_WAVEFORMS);
             _error(err_buff);
             return -2;
@@ -212,129 +541,693 @@ static inline int _ins_setch(ProgramContext *program_context, int32_t *args) {
 }
 
 
-// Replaces `arguments` with either values in program memory or raw numbers then stores them in `parsed_arguments`.
-static inline int _parse_arguments(int32_t *parsed_arguments, ProgramContext *program_context, const Argument *arguments, byte argument_count) {
+// Replaces the `operands` of an instruction with either values in program memory or raw numbers then stores them in `parsed_arguments`.
+static inline int _parse_arguments(int32_t *parsed_arguments, ProgramContext *program_context, byte opcode, byte modes, const int32_t *operands) {
+    byte argument_count = decoded_argument_count(opcode);
     for (size_t i = 0; i < argument_count; i++) {
-        Argument arg = arguments[i];
-        if (arg.type == 1) {  // Address
+        int32_t value = operands[i];
+        if (modes & (1 << i)) {  // Address
             #ifdef ENABLE_G1_RUNTIME_ERRORS
-                if (arg.value < 0 || arg.value >= program_context->memory_size) {
-                    _out_of_bounds_error(arg.value);
+                if (program_context->runtime_errors && (value < 0 || value >= program_context->memory_size)) {
+                    _out_of_bounds_error(value);
                     return -1;
                 }
             #endif
-            parsed_arguments[i] = program_context->memory[arg.value];
+            parsed_arguments[i] = program_context->memory[value];
         }
         else {  // Integer literal
-            parsed_arguments[i] = arg.value;
+            parsed_arguments[i] = value;
         }
     }
     return 0;
 }
 
 
-int run_program_thread(const ProgramState *program_state, size_t index) {
-    static void *dispatch_table[] = {
-        &&do_mov, &&do_movp,
-        &&do_add, &&do_sub, &&do_mul, &&do_div, &&do_mod,
-        &&do_less, &&do_equal, &&do_not,
-        &&do_jmp,
-        &&do_color, &&do_point, &&do_line, &&do_rect,
-        &&do_putc, &&do_getp, &&do_setch
-    };
-    
-    ProgramContext *program_context = program_state->context;
+// Runs any instruction other than `jmp` with arguments from `_parse_arguments`.
+static inline int _run_instruction(ProgramContext *program_context, byte opcode, int32_t *args) {
+    switch (opcode) {
+        case OP_MOV: return _ins_mov(program_context, args);
+        case OP_MOVP: return _ins_movp(program_context, args);
+        case OP_ADD: return _ins_add(program_context, args);
+        case OP_SUB: return _ins_sub(program_context, args);
+        case OP_MUL: return _ins_mul(program_context, args);
+        case OP_DIV: return _ins_div(program_context, args);
+        case OP_MOD: return _ins_mod(program_context, args);
+        case OP_LESS: return _ins_less(program_context, args);
+        case OP_EQUAL: return _ins_equal(program_context, args);
+        case OP_NOT: return _ins_not(program_context, args);
+        case OP_AND: return _ins_and(program_context, args);
+        case OP_OR: return _ins_or(program_context, args);
+        case OP_XOR: return _ins_xor(program_context, args);
+        case OP_SHL: return _ins_shl(program_context, args);
+        case OP_SHR: return _ins_shr(program_context, args);
+        case OP_SAR: return _ins_sar(program_context, args);
+        case OP_SIN: return _ins_sin(program_context, args);
+        case OP_COS: return _ins_cos(program_context, args);
+        case OP_SQRT: return _ins_sqrt(program_context, args);
+        case OP_ABS: return _ins_abs(program_context, args);
+        case OP_MIN: return _ins_min(program_context, args);
+        case OP_MAX: return _ins_max(program_context, args);
+        case OP_ATAN2: return _ins_atan2(program_context, args);
+        case OP_MEMFILL: return _ins_memfill(program_context, args);
+        case OP_MEMCOPY: return _ins_memcopy(program_context, args);
+        case OP_MEMCMP: return _ins_memcmp(program_context, args);
+        case OP_BLIT: return _ins_blit(program_context, args);
+        case OP_BLITKEY: return _ins_blitkey(program_context, args);
+        case OP_COPYRECT: return _ins_copyrect(program_context, args);
+        case OP_TRI: return _ins_tri(program_context, args);
+        case OP_COLOR: return _ins_color(program_context, args);
+        case OP_POINT: return _ins_point(program_context, args);
+        case OP_LINE: return _ins_line(program_context, args);
+        case OP_RECT: return _ins_rect(program_context, args);
+        case OP_PUTC: return _ins_putc(program_context, args);
+        case OP_GETP: return _ins_getp(program_context, args);
+        case OP_SETCH: return _ins_setch(program_context, args);
+        case OP_DIV_POW2: return _set_memory_value(args[0], div_pow2(args[1], args[2]), program_context);
+        case OP_MOD_POW2: return _set_memory_value(args[0], args[1] & args[2], program_context);
+        default: return 0;
+    }
+}
+
+
+// Push the frame of a `call` that returns to instruction `address`. Returns false if the return stack is full.
+static inline bool _push_call(ProgramContext *program_context, int32_t address, int32_t target) {
+    if (program_context->call_depth >= CALL_STACK_SIZE) {
+        return false;
+    }
+    program_context->call_stack[program_context->call_depth++] = (CallFrame) {address, target};
+    return true;
+}
+
+// Pop the frame of a `ret`, or returns `NULL` if the return stack is empty.
+static inline const CallFrame* _pop_call(ProgramContext *program_context) {
+    return program_context->call_depth > 0 ? &program_context->call_stack[--program_context->call_depth] : NULL;
+}
+
+/*
+Frames of calls through a return slot, see `call.h`. A full stack overwrites its oldest frames, since returns only take
+a frame that returns where the slot says. Returns the top frame if it returns to `address` and pops it, or `NULL`.
+*/
+static inline void _push_slot_call(ProgramContext *program_context, int32_t address, int32_t target) {
+    program_context->call_stack[program_context->call_depth++ % CALL_STACK_SIZE] = (CallFrame) {address, target};
+}
+
+static inline const CallFrame* _pop_slot_call(ProgramContext *program_context, int32_t address) {
+    const CallFrame *frame = &program_context->call_stack[(program_context->call_depth - 1) % CALL_STACK_SIZE];
+    if (program_context->call_depth == 0 || frame->address != address) {
+        return NULL;
+    }
+    program_context->call_depth--;
+    return frame;
+}
+
+
+// Returns true if none of the slots that control `loop` are in the `count` slots from `start`.
+static inline bool _idiom_range_is_free(const CountedLoop *loop, int64_t start, int64_t count) {
+    #define _IN_RANGE(address) ((address) >= start && (address) < start + count)
+    for (byte i = 0; i < loop->variable_count; i++) {
+        if (_IN_RANGE(loop->variables[i])) {
+            return false;
+        }
+    }
+    return !_IN_RANGE(loop->condition) && !(loop->bound_address && _IN_RANGE(loop->bound));
+    #undef _IN_RANGE
+}
+
+
+/*
+Run `loop` as one native operation, with the same result as running its instructions.
+Returns the number of instructions to skip, or 0 if the loop has to run one instruction at a time because it
+reaches outside of memory or writes to slots it reads.
+*/
+static inline size_t _run_idiom(ProgramContext *program_context, const CountedLoop *loop) {
+    int32_t *memory = program_context->memory;
+    int64_t memory_size = program_context->memory_size;
+    int64_t bound = loop->bound_address ? memory[loop->bound] : loop->bound;
+    int64_t iterations = bound - memory[loop->counter];
+    iterations = iterations > 1 ? iterations : 1;
+
+    // The effect's operands in the first iteration. Counting operands go up by one every iteration.
+    const DecodedInstruction *effect = &loop->effect;
+    int64_t first[MAX_ARGUMENTS];
+    for (byte i = 0; i < decoded_argument_count(effect->opcode); i++) {
+        int32_t operand = effect->operands[i];
+        first[i] = (effect->modes & (1 << i)) ? memory[operand] : operand;
+        if (loop->effect_counts[i] >= 0) {
+            first[i] += loop->effect_counts[i];
+            if (first[i] + iterations - 1 > INT32_MAX) {
+                return 0;
+            }
+        }
+    }
+
+    switch (loop->idiom) {
+        case IDIOM_FILL: {
+            int64_t start = first[0];
+            bool value_address = effect->modes & 2;
+            if (start < 0 || start + iterations > memory_size || !_idiom_range_is_free(loop, start, iterations)) {
+                return 0;
+            }
+            if (value_address && effect->operands[1] >= start && effect->operands[1] < start + iterations) {
+                return 0;
+            }
+            int32_t value = first[1];
+            for (int64_t i = start; i < start + iterations; i++) {
+                memory[i] = value;
+            }
+            break;
+        }
+        case IDIOM_COPY: {
+            int64_t dest = first[0], source = first[1];
+            if (dest < 0 || dest + iterations > memory_size || source < 0 || source + iterations > memory_size) {
+                return 0;
+            }
+            if (!_idiom_range_is_free(loop, dest, iterations) || !_idiom_range_is_free(loop, source, iterations)) {
+                return 0;
+            }
+            // A copy forwards over an overlapping source repeats what it already copied, which `memmove` doesn't do
+            if (dest <= source || dest >= source + iterations) {
+                memmove(&memory[dest], &memory[source], sizeof(int32_t) * iterations);
+            }
+            else {
+                for (int64_t i = 0; i < iterations; i++) {
+                    memory[dest+i] = memory[source+i];
+                }
+            }
+            break;
+        }
+        #ifndef ENABLE_G1_GPU_RENDERING
+        case IDIOM_SPAN: {
+            // Only the pixels inside the surface are drawn, like `point`
+            SDL_Surface *surf = program_context->render_surface;
+            bool horizontal = loop->effect_counts[0] >= 0;
+            int64_t start = horizontal ? first[0] : first[1];
+            int64_t fixed = horizontal ? first[1] : first[0];
+            int64_t length = horizontal ? surf->w : surf->h;
+            int64_t breadth = horizontal ? surf->h : surf->w;
+            int64_t low = start > 0 ? start : 0;
+            int64_t high = start + iterations < length ? start + iterations : length;
+            if (fixed >= 0 && fixed < breadth && low < high) {
+                int32_t rect[4] = {low, fixed, high - low, 1};
+                if (!horizontal) {
+                    rect[0] = fixed;
+                    rect[1] = low;
+                    rect[2] = 1;
+                    rect[3] = high - low;
+                }
+                if (program_context->deferred_drawing) {
+                    _record_draw(program_context, DRAW_RECT, rect, 4);
+                }
+                else {
+                    surf_draw_rect(surf, rect[0], rect[1], rect[2], rect[3], program_context->color);
+                }
+            }
+            break;
+        }
+        #endif
+        default:
+            return 0;
+    }
+
+    // The loop leaves every variable advanced once per iteration and its condition false
+    for (byte i = 0; i < loop->variable_count; i++) {
+        int32_t variable = loop->variables[i];
+        memory[variable] = (int32_t) ((uint32_t) memory[variable] + (uint32_t) iterations);
+    }
+    memory[loop->condition] = 0;
+    return loop->length;
+}
+
+
+/*
+Operand access for operand-specialized handlers, which read the operands of the threaded instruction `instruction`.
+`L` operands are integer literals and `M` operands are addresses. `_ALL_OPERANDS` is every operand of an instruction,
+for handlers that read past the ones in `ThreadedInstruction`. The cold parts of the threaded code are read through
+`program_data` rather than kept in locals, which the handlers would otherwise have to keep in registers.
+
+Handlers come in a `CHECKED` variant and an `UNCHECKED` variant for instructions the verifier
+proved can never fail. Only the checked interpreter has the `CHECKED` variant.
+*/
+#define _OPERAND(ins, i) ((ins)->operands[i])
+#define _INFO(ins) (&program_data->threaded_code.info[(ins) - instructions])
+#define _ALL_OPERANDS(ins) (&program_data->threaded_code.operands[_INFO(ins)->first_operand])
+#define _OPERAND_L(i, C) _OPERAND(instruction, i)
+#define _OPERAND_M(i, C) _OPERAND_M_##C(i)
+
+#define _CHECK_ADDRESS_UNCHECKED(address)
+#define _OPERAND_M_UNCHECKED(i) (memory[_OPERAND(instruction, i)])
+#define _STORE_UNCHECKED(dest, value) memory[dest] = value;
+#define _CHECK_DIVISOR_UNCHECKED(divisor)
+
+// `_CHECK_ADDRESS_CHECKED` depends on the interpreter, see `interpreter_impl.h`
+#define _OPERAND_M_CHECKED(i) ({ \
+    int32_t _address = _OPERAND(instruction, i); \
+    _CHECK_ADDRESS_CHECKED(_address); \
+    memory[_address]; \
+})
+#define _STORE_CHECKED(dest, value) _CHECK_ADDRESS_CHECKED(dest); memory[dest] = value;
+#define _CHECK_DIVISOR_CHECKED(divisor) if (divisor == 0) { _zero_division_error(); goto thread_error; }
+
+/*
+Jump target access. Literal targets are clamped to the halt instruction by the decoder,
+so only targets read from memory need to be clamped here.
+*/
+#define _TARGET_L(i, C) _OPERAND_L(i, C)
+#define _TARGET_M(i, C) ({ \
+    int32_t _target = _OPERAND_M(i, C); \
+    (uint32_t) _target < instruction_count ? _target : (int32_t) instruction_count; \
+})
+
+// With guard memory, jumps leave their target in `program_counter` so a fault can be traced back to its instruction
+#ifdef G1_GUARD_MEMORY
+    #define _MARK_JUMP_TARGET(target) program_context->program_counter = target;
+#else
+    #define _MARK_JUMP_TARGET(target)
+#endif
+
+/*
+Every handler ends with its own indirect jump to the next instruction's handler.
+Handlers are stored as offsets from `do_halt`, see `ThreadedInstruction`.
+*/
+#define _HANDLER(ins) (&&do_halt + (ins)->handler)
+#ifdef ENABLE_G1_PROFILING
+    #define _PROFILE_RECORD() profile_record(_INFO(instruction));
+#else
+    #define _PROFILE_RECORD()
+#endif
+#define _DISPATCH() instruction++; _PROFILE_RECORD() goto *_HANDLER(instruction)
+#define _JUMP(target) _MARK_JUMP_TARGET(target) instruction = &instructions[target]; _PROFILE_RECORD() goto *_HANDLER(instruction)
+
+/*
+Taken jumps charge the instructions run since the previous taken jump to the thread's instruction budget,
+and suspend the thread at the jump target once the budget runs out. See `ProgramContext.instruction_budget`.
+*/
+#define _CHARGE_BUDGET() budget -= instruction - segment_start + 1;
+#define _SUSPEND_IF_OVER_BUDGET(target) \
+    segment_start = &instructions[target]; \
+    if (budget <= 0) { instruction = segment_start; goto thread_suspended; }
+
+#define _JUMP_L(target) _CHARGE_BUDGET() _SUSPEND_IF_OVER_BUDGET(target) _JUMP(target)
+#define _JUMP_M(target) _CHARGE_BUDGET() _CHECK_ENTRY_POINT(target) _SUSPEND_IF_OVER_BUDGET(target) _JUMP(target)
+
+
+// Handler definitions for every combination of addressing modes.
+#define _DEFINE_HANDLERS_1(C, HANDLER, name, ...) \
+    HANDLER(C, name, L, __VA_ARGS__) HANDLER(C, name, M, __VA_ARGS__)
+
+#define _DEFINE_HANDLERS_2(C, HANDLER, name, ...) \
+    HANDLER(C, name, L, L, __VA_ARGS__) HANDLER(C, name, M, L, __VA_ARGS__) \
+    HANDLER(C, name, L, M, __VA_ARGS__) HANDLER(C, name, M, M, __VA_ARGS__)
+
+#define _DEFINE_HANDLERS_3(C, HANDLER, name, ...) \
+    HANDLER(C, name, L, L, L, __VA_ARGS__) HANDLER(C, name, M, L, L, __VA_ARGS__) \
+    HANDLER(C, name, L, M, L, __VA_ARGS__) HANDLER(C, name, M, M, L, __VA_ARGS__) \
+    HANDLER(C, name, L, L, M, __VA_ARGS__) HANDLER(C, name, M, L, M, __VA_ARGS__) \
+    HANDLER(C, name, L, M, M, __VA_ARGS__) HANDLER(C, name, M, M, M, __VA_ARGS__)
+
+/*
+Dispatch table entries for every combination of addressing modes, indexed by the modes of a `ThreadedInfo`
+and then by `ThreadedInfo.verified`.
+*/
+#define _HANDLER_ENTRY(opcode, modes, label) \
+    [opcode][modes][0] = _CHECKED_LABEL(label), [opcode][modes][1] = &&label##_UNCHECKED
+
+#define _HANDLER_ENTRIES_1(opcode, name) \
+    _HANDLER_ENTRY(opcode, 0, do_##name##_L), _HANDLER_ENTRY(opcode, 1, do_##name##_M)
+
+#define _HANDLER_ENTRIES_2(opcode, name) \
+    _HANDLER_ENTRY(opcode, 0, do_##name##_LL), _HANDLER_ENTRY(opcode, 1, do_##name##_ML), \
+    _HANDLER_ENTRY(opcode, 2, do_##name##_LM), _HANDLER_ENTRY(opcode, 3, do_##name##_MM)
+
+#define _HANDLER_ENTRIES_3(opcode, name) \
+    _HANDLER_ENTRY(opcode, 0, do_##name##_LLL), _HANDLER_ENTRY(opcode, 1, do_##name##_MLL), \
+    _HANDLER_ENTRY(opcode, 2, do_##name##_LML), _HANDLER_ENTRY(opcode, 3, do_##name##_MML), \
+    _HANDLER_ENTRY(opcode, 4, do_##name##_LLM), _HANDLER_ENTRY(opcode, 5, do_##name##_MLM), \
+    _HANDLER_ENTRY(opcode, 6, do_##name##_LMM), _HANDLER_ENTRY(opcode, 7, do_##name##_MMM)
+
+#define _SUPERINSTRUCTION_ENTRY(name, ...) \
+    [SUPER_##name][0] = _CHECKED_LABEL(do_super_##name), [SUPER_##name][1] = &&do_super_##name##_UNCHECKED,
+
+/*
+Instruction bodies without a dispatch at the end.
+Handlers and superinstructions are built out of these.
+*/
+#define _UNARY_BODY(C, d, a, expression) { \
+    int32_t dest = _OPERAND_##d(0, C); \
+    int32_t value = _OPERAND_##a(1, C); \
+    _STORE_##C(dest, expression); \
+}
+
+#define _MOVP_BODY(C, d, a) { \
+    int32_t dest = _OPERAND_##d(0, C); \
+    int32_t address = _OPERAND_##a(1, C); \
+    _CHECK_ADDRESS_##C(address); \
+    _STORE_##C(dest, memory[address]); \
+}
+
+#define _BINARY_BODY(C, d, a, b, expression) { \
+    int32_t dest = _OPERAND_##d(0, C); \
+    int32_t lhs = _OPERAND_##a(1, C); \
+    int32_t rhs = _OPERAND_##b(2, C); \
+    _STORE_##C(dest, expression); \
+}
+
+#define _DIVISION_BODY(C, d, a, b, expression) { \
+    int32_t dest = _OPERAND_##d(0, C); \
+    int32_t lhs = _OPERAND_##a(1, C); \
+    int32_t rhs = _OPERAND_##b(2, C); \
+    _CHECK_DIVISOR_##C(rhs); \
+    _STORE_##C(dest, expression); \
+}
+
+#define _JMP_BODY(C, t, c) { \
+    int32_t target = _TARGET_##t(0, C); \
+    int32_t condition = _OPERAND_##c(1, C); \
+    if (condition) { \
+        _JUMP_##t(target); \
+    } \
+}
+
+// Moves on to the next instruction of a superinstruction without dispatching.
+#define _NEXT_COMPONENT() instruction++;
+
+#define _UNARY_HANDLER(C, name, d, a, expression) do_##name##_##d##a##_##C: _UNARY_BODY(C, d, a, expression) _DISPATCH();
+#define _MOVP_HANDLER(C, name, d, a, ...) do_##name##_##d##a##_##C: _MOVP_BODY(C, d, a) _DISPATCH();
+#define _BINARY_HANDLER(C, name, d, a, b, expression) do_##name##_##d##a##b##_##C: _BINARY_BODY(C, d, a, b, expression) _DISPATCH();
+#define _DIVISION_HANDLER(C, name, d, a, b, expression) do_##name##_##d##a##b##_##C: _DIVISION_BODY(C, d, a, b, expression) _DISPATCH();
+#define _POW2_HANDLER(C, name, d, a, expression) do_##name##_##d##a##_##C: _BINARY_BODY(C, d, a, L, expression) _DISPATCH();
+#define _JMP_HANDLER(C, name, t, c, ...) do_##name##_##t##c##_##C: _JMP_BODY(C, t, c) _DISPATCH();
+
+// `_CALL_STACK_ERROR` depends on the interpreter, see `interpreter_impl.h`
+#define _CALL_HANDLER(C, name, t, ...) do_##name##_##t##_##C: { \
+    int32_t target = _TARGET_##t(0, C); \
+    if (!_push_call(program_context, _OPERAND(instruction, 1), _OPERAND(instruction, 2))) { \
+        _CALL_STACK_ERROR(_call_stack_overflow_error); \
+    } \
+    _JUMP_##t(target); \
+}
+#define _RET_HANDLER(C, name) do_##name##_##C: { \
+    const CallFrame *frame = _pop_call(program_context); \
+    if (!frame) { \
+        _CALL_STACK_ERROR(_call_stack_underflow_error); \
+    } \
+    _JUMP_M(frame->target); \
+}
+
+// Superinstruction handlers, which run the body generated for each one in `superinstructions.h`
+#define _SUPERINSTRUCTION_HANDLER(C, name) do_super_##name##_##C: SUPERINSTRUCTION_BODY_##name(C) _DISPATCH();
+#define _DEFINE_SUPERINSTRUCTION(name, ...) _DEFINE_VARIANTS(_SUPERINSTRUCTION_HANDLER, name)
+
+
+// The checked interpreter only exists in builds with runtime errors
+#ifdef ENABLE_G1_RUNTIME_ERRORS
+    #define INTERPRETER_CHECKED
+    #define RUN_PROGRAM_THREAD _run_program_thread_checked
+    #include "interpreter_impl.h"
+    #undef RUN_PROGRAM_THREAD
+
+    // A checked interpreter that leaves bounds checks to the guard pages, for memories they cover exactly
+    #ifdef G1_GUARD_MEMORY
+        #define INTERPRETER_GUARDED
+        #define RUN_PROGRAM_THREAD _run_program_thread_guarded
+        #include "interpreter_impl.h"
+        #undef INTERPRETER_GUARDED
+        #undef RUN_PROGRAM_THREAD
+    #endif
+    #undef INTERPRETER_CHECKED
+#endif
+
+#define RUN_PROGRAM_THREAD _run_program_thread_unchecked
+#include "interpreter_impl.h"
+#undef RUN_PROGRAM_THREAD
+
+
+#ifdef ENABLE_G1_JIT
+// Runs instructions that compiled code doesn't implement itself.
+static int _jit_generic_instruction(void *context, const DecodedInstruction *instruction) {
+    ProgramContext *program_context = context;
+    int32_t args[INSTRUCTION_ARGUMENT_BUFFER_SIZE];
+    int parse_response = _parse_arguments(args, program_context, instruction->opcode, instruction->modes, instruction->operands);
+    if (parse_response < 0) {
+        return parse_response;
+    }
+    return _run_instruction(program_context, instruction->opcode, args);
+}
+
+
+/*
+Run the instruction at `index` that compiled code left at, with every check like the checked interpreter's slow path.
+Returns the index compiled code continues from, and sets `raised_error` if the instruction raised a runtime error.
+*/
+static size_t _run_compiled_exit(ProgramContext *program_context, const DecodedInstruction *instructions, size_t instruction_count, size_t index, bool *raised_error) {
+    const DecodedInstruction *instruction = &instructions[index];
+    #ifdef ENABLE_G1_RUNTIME_ERRORS
+        bool checked = program_context->runtime_errors;
+    #else
+        bool checked = false;
+    #endif
+    int32_t args[INSTRUCTION_ARGUMENT_BUFFER_SIZE];
+    *raised_error = _parse_arguments(args, program_context, instruction->opcode, instruction->modes, instruction->operands) != 0;
+    if (*raised_error) {
+        return index;
+    }
+
+    // A call or return that the stack can't take ends unchecked threads instead, like it does in the interpreter
+    if (instruction->opcode == OP_CALL) {
+        if (!_push_call(program_context, instruction->operands[1], instruction->operands[2])) {
+            if (checked) {
+                _call_stack_overflow_error();
+                *raised_error = true;
+                return index;
+            }
+            return instruction_count;
+        }
+        bool in_program = !(instruction->modes & 1) || (uint32_t) args[0] < instruction_count;
+        return in_program ? (size_t) args[0] : instruction_count;
+    }
+    if (instruction->opcode == OP_RET) {
+        const CallFrame *frame = _pop_call(program_context);
+        if (!frame) {
+            if (checked) {
+                _call_stack_underflow_error();
+                *raised_error = true;
+                return index;
+            }
+            return instruction_count;
+        }
+        return frame->target;
+    }
+    *raised_error = _run_instruction(program_context, instruction->opcode, args) != 0 && checked;
+    return index + 1;
+}
+
+
+/*
+Run compiled code from instruction `index`, compiling the program first if needed.
+Returns the index the interpreter should continue from, and sets `raised_error` if the thread ended with an error.
+*/
+static size_t _run_compiled(const ProgramState *program_state, size_t index, bool *raised_error) {
     ProgramData *program_data = program_state->data;
-    Instruction *instructions = program_data->instructions;
-    
-    program_context->program_counter = index-1;
+    ProgramContext *program_context = program_state->context;
+    bool checked = program_context->runtime_errors;
+
+    if (program_data->jit_code && jit_is_checked(program_data->jit_code) != checked) {
+        jit_free(program_data->jit_code);
+        program_data->jit_code = NULL;
+        program_data->jit_failed = false;
+    }
+    if (!program_data->jit_code && !program_data->jit_failed) {
+        program_data->jit_code = jit_compile(
+            program_data->decoded_instructions, program_data->instruction_count, program_data->decoded_count,
+            program_data->memory_size, checked, _jit_generic_instruction
+        );
+        program_data->jit_failed = !program_data->jit_code;
+    }
+    if (!program_data->jit_code) {
+        *raised_error = false;
+        return index;
+    }
+
+    // Calls and returns leave compiled code to run here, and compiled code continues from where they go.
+    // Checked threads also run every other instruction compiled code leaves at here, since compiled code may reach an
+    // instruction through a computed jump the verifier didn't expect, where the interpreter would skip its checks.
     size_t instruction_count = program_data->instruction_count;
+    while (true) {
+        index = jit_run(program_data->jit_code, program_context->memory, program_context, index, raised_error);
+        if (*raised_error || index == instruction_count) {
+            return index;
+        }
+        byte opcode = threaded_opcode(&program_data->threaded_code.info[index]);
+        if (!checked && opcode != OP_CALL && opcode != OP_RET) {
+            return index;
+        }
+        index = _run_compiled_exit(program_context, program_data->decoded_instructions, instruction_count, index, raised_error);
+        if (*raised_error || index == instruction_count) {
+            return index;
+        }
+    }
+}
+#endif
+
 
-    Instruction *next_instruction;
+#ifdef G1_EMBEDDED_AOT
+#ifdef ENABLE_G1_RUNTIME_ERRORS
+    #define _AOT_CHECKED program_context->runtime_errors
+#else
+    #define _AOT_CHECKED false
+#endif
+
+/*
+Called by compiled code in place of an `instruction` at `index` whose checks failed, before it changed anything.
+Runs the instruction with every check so it raises its runtime error. Unchecked threads, which only get here when an
+operand is outside of memory, leave the compiled code and run the instruction in the interpreter instead.
+*/
+static inline size_t _aot_raise(ProgramContext *program_context, bool *raised_error, size_t index, const DecodedInstruction *instruction) {
     int32_t args[INSTRUCTION_ARGUMENT_BUFFER_SIZE];
-    int instruction_response;
+    *raised_error = _AOT_CHECKED && (
+        _parse_arguments(args, program_context, instruction->opcode, instruction->modes, instruction->operands)
+        || _run_instruction(program_context, instruction->opcode, args)
+    );
+    return index;
+}
 
-    dispatch:
-        #ifdef ENABLE_G1_RUNTIME_ERRORS
-        if (instruction_response) {
-            return -1;
+// End the thread after instruction `index` raised a runtime error in compiled code.
+static inline size_t _aot_error(bool *raised_error, size_t index) {
+    *raised_error = true;
+    return index;
+}
+
+// Defines `_run_embedded_aot`, the embedded program compiled to C by `embed.py --aot`
+#include "embed_aot.h"
+#endif
+
+
+#ifdef G1_GUARD_MEMORY
+// Returns true if running the instruction at `index` with the current memory would access `address`.
+static inline bool _accesses_address(const ProgramContext *program_context, const ThreadedCode *code, size_t index, int32_t address) {
+    byte opcode = threaded_opcode(&code->info[index]);
+    byte modes = threaded_modes(&code->info[index]);
+    const int32_t *operands = &code->operands[code->info[index].first_operand];
+    int32_t args[INSTRUCTION_ARGUMENT_BUFFER_SIZE];
+    for (byte i = 0; i < decoded_argument_count(opcode); i++) {
+        int32_t value = operands[i];
+        if (modes & (1 << i)) {
+            if (value == address) {
+                return true;
+            }
+            if ((uint32_t) value >= program_context->memory_size) {
+                return false;
+            }
+            value = program_context->memory[value];
         }
-        #endif
+        args[i] = value;
+    }
+    return (writes_destination(opcode) && args[0] == address) || (opcode == OP_MOVP && args[1] == address);
+}
 
-        next_instruction = &instructions[++program_context->program_counter];
-        if (program_context->program_counter >= instruction_count) {
-            return 0;
+
+/*
+Returns the index of the instruction that faulted on `address`. The fault happened in the straight-line code after the
+jump target in `program_counter`, and the faulting instruction didn't change memory, so it's the first one there that
+accesses `address` with the current memory.
+*/
+static inline size_t _find_faulting_instruction(const ProgramState *program_state, int32_t address) {
+    const ThreadedCode *code = &program_state->data->threaded_code;
+    size_t start = program_state->context->program_counter;
+    for (size_t i = start; i < code->count; i++) {
+        if (_accesses_address(program_state->context, code, i, address)) {
+            return i;
         }
+    }
+    return start;
+}
+#endif
 
-        // Parse instruction arguments
-        byte argument_count = ARGUMENT_COUNTS[next_instruction->opcode];
-        int parse_args_response = _parse_arguments(args, program_context, next_instruction->arguments, argument_count);
 
-        #ifdef ENABLE_G1_RUNTIME_ERRORS
-        if (parse_args_response < 0) {
+// Run the program from instruction `index` in the interpreter selected by `program_context->runtime_errors`.
+static int _run_interpreter(const ProgramState *program_state, size_t index) {
+    ProgramContext *program_context = program_state->context;
+    int response;
+
+    // Out of bounds memory accesses that fault land here, where they're raised as runtime errors in every interpreter
+    #ifdef G1_GUARD_MEMORY
+        sigjmp_buf recovery;
+        if (sigsetjmp(recovery, 1)) {
+            int32_t address = guard_memory_fault_address();
+            _out_of_bounds_error(address);
+            program_context->program_counter = _find_faulting_instruction(program_state, address);
+            program_context->thread_suspended = false;
+            program_context->resume_slow_path = false;
             return -1;
         }
-        #endif
+        guard_memory_arm(program_context->memory, program_context->memory_size, &recovery);
+    #endif
+
+    #ifdef ENABLE_G1_RUNTIME_ERRORS
+        if (program_context->runtime_errors) {
+            #ifdef G1_GUARD_MEMORY
+                if (program_context->memory_guarded) {
+                    response = _run_program_thread_guarded(program_state, index);
+                }
+                else
+            #endif
+            response = _run_program_thread_checked(program_state, index);
+        }
+        else
+    #endif
+    response = _run_program_thread_unchecked(program_state, index);
 
-        goto *dispatch_table[next_instruction->opcode];
-        
-    // Run the corresponding instruction
-    do_mov:
-        instruction_response = _ins_mov(program_context, args);
-        goto dispatch;
-    do_movp:
-        instruction_response = _ins_movp(program_context, args);
-        goto dispatch;
-    do_add:
-        instruction_response = _ins_add(program_context, args);
-        goto dispatch;
-    do_sub:
-        instruction_response = _ins_sub(program_context, args);
-        goto dispatch;
-    do_mul:
-        instruction_response = _ins_mul(program_context, args);
-        goto dispatch;
-    do_div:
-        instruction_response = _ins_div(program_context, args);
-        goto dispatch;
-    do_mod:
-        instruction_response = _ins_mod(program_context, args);
-        goto dispatch;
-    do_less:
-        instruction_response = _ins_less(program_context, args);
-        goto dispatch;
-    do_equal:
-        instruction_response = _ins_equal(program_context, args);
-        goto dispatch;
-    do_not:
-        instruction_response = _ins_not(program_context, args);
-        goto dispatch;
-    do_jmp:
-        instruction_response = _ins_jmp(program_context, args);
-        goto dispatch;
-    do_color:
-        instruction_response = _ins_color(program_context, args);
-        goto dispatch;
-    do_point:
-        instruction_response = _ins_point(program_context, args);
-        goto dispatch;
-    do_line:
-        instruction_response = _ins_line(program_context, args);
-        goto dispatch;
-    do_rect:
-        instruction_response = _ins_rect(program_context, args);
-        goto dispatch;
-    do_putc:
-        instruction_response = _ins_putc(program_context, args);
-        goto dispatch;
-    do_getp:
-        instruction_response = _ins_getp(program_context, args);
-        goto dispatch;
-    do_setch:
-        instruction_response = _ins_setch(program_context, args);
-        goto dispatch;
+    #ifdef G1_GUARD_MEMORY
+        guard_memory_disarm();
+    #endif
 
-    return 0;
+    program_context->thread_suspended = response == THREAD_SUSPENDED;
+    program_context->budget_overruns += program_context->thread_suspended;
+    return response;
+}
+
+
+/*
+Run the program from instruction `index` until it halts or runs out of its instruction budget.
+Returns 0 when the thread halts, `THREAD_SUSPENDED` when it runs out of budget and -1 on a runtime error.
+*/
+int run_program_thread(const ProgramState *program_state, size_t index) {
+    // Entrypoints outside of the program halt, rather than running the optimized code after the halt instruction
+    size_t instruction_count = program_state->data->instruction_count;
+    index = index < instruction_count ? index : instruction_count;
+    program_state->context->call_depth = 0;
+
+    // Compiled code runs until the program halts or, in unchecked threads, reaches something only the interpreter can do.
+    // It can't be suspended, so threads with an instruction budget only run in the interpreter.
+    #ifdef G1_EMBEDDED_AOT
+        if (!program_state->context->instruction_budget) {
+            bool aot_raised_error;
+            index = _run_embedded_aot(program_state->context, index, &aot_raised_error);
+            if (aot_raised_error || index == instruction_count) {
+                program_state->context->program_counter = index;
+                return aot_raised_error ? -1 : 0;
+            }
+        }
+    #endif
+
+    #ifdef ENABLE_G1_JIT
+        if (!program_state->context->instruction_budget) {
+            bool raised_error;
+            index = _run_compiled(program_state, index, &raised_error);
+            if (raised_error || index == instruction_count) {
+                program_state->context->program_counter = index;
+                return raised_error ? -1 : 0;
+            }
+        }
+    #endif
+
+    return _run_interpreter(program_state, index);
+}
+
+
+// Continue a suspended thread from where it ran out of budget, with a new budget. Returns the same as `run_program_thread`.
+int resume_program_thread(const ProgramState *program_state) {
+    return _run_interpreter(program_state, program_state->context->program_counter);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,307 @@
+/*
+    The interpreter loop. `instruction_impl.h` includes this once for each interpreter,
+    with `RUN_PROGRAM_THREAD` set to the function name and `INTERPRETER_CHECKED` set for the checked ones.
+    `INTERPRETER_GUARDED` is also set for the checked interpreter that relies on guard pages for bounds checks.
+*/
+
+#ifdef INTERPRETER_GUARDED
+    // Out of bounds accesses fault on a guard page instead, see `_run_interpreter`
+    #define _CHECK_ADDRESS_CHECKED(address)
+#else
+    #define _CHECK_ADDRESS_CHECKED(address) if (address < 0 || address >= program_context->memory_size) { _out_of_bounds_error(address); goto thread_error; }
+#endif
+
+#ifdef INTERPRETER_CHECKED
+    #define _CHECK_RESPONSE(response) if (response) { goto thread_error; }
+
+    // Verified code may only be entered where the verifier expected it, anywhere else runs through `slow_path`
+    #define _CHECK_ENTRY_POINT(target) if (!_INFO(&instructions[target])->entry_point) { instruction = &instructions[target]; goto slow_path; }
+
+    #define _CALL_STACK_ERROR(raise_error) raise_error(); goto thread_error;
+
+    #define _DEFINE_VARIANTS(DEFINE, ...) DEFINE(CHECKED, __VA_ARGS__) DEFINE(UNCHECKED, __VA_ARGS__)
+    #define _CHECKED_LABEL(label) &&label##_CHECKED
+#else
+    #define _CHECK_RESPONSE(response) (void) (response);
+    #define _CHECK_ENTRY_POINT(target)
+
+    // A call or return that the stack can't take ends the thread instead
+    #define _CALL_STACK_ERROR(raise_error) _JUMP(instruction_count);
+
+    #define _DEFINE_VARIANTS(DEFINE, ...) DEFINE(UNCHECKED, __VA_ARGS__)
+    #define _CHECKED_LABEL(label) &&label##_UNCHECKED
+#endif
+
+
+static int RUN_PROGRAM_THREAD(const ProgramState *program_state, size_t index) {
+    // Operand-specialized handlers for the arithmetic, logic and control flow instructions.
+    // Everything else goes through `do_generic`, which fetches arguments at runtime.
+    static void *dispatch_table[AMOUNT_DECODED_OPCODES][1 << MAX_ARGUMENTS][2] = {
+        [0 ... AMOUNT_INSTRUCTIONS-1][0 ... (1 << MAX_ARGUMENTS)-1][0 ... 1] = &&do_generic,
+        _HANDLER_ENTRIES_2(OP_MOV, mov), _HANDLER_ENTRIES_2(OP_MOVP, movp),
+        _HANDLER_ENTRIES_3(OP_ADD, add), _HANDLER_ENTRIES_3(OP_SUB, sub), _HANDLER_ENTRIES_3(OP_MUL, mul),
+        _HANDLER_ENTRIES_3(OP_DIV, div), _HANDLER_ENTRIES_3(OP_MOD, mod),
+        _HANDLER_ENTRIES_3(OP_LESS, less), _HANDLER_ENTRIES_3(OP_EQUAL, equal), _HANDLER_ENTRIES_2(OP_NOT, not),
+        _HANDLER_ENTRIES_3(OP_AND, and), _HANDLER_ENTRIES_3(OP_OR, or), _HANDLER_ENTRIES_3(OP_XOR, xor),
+        _HANDLER_ENTRIES_3(OP_SHL, shl), _HANDLER_ENTRIES_3(OP_SHR, shr), _HANDLER_ENTRIES_3(OP_SAR, sar),
+        _HANDLER_ENTRIES_2(OP_SIN, sin), _HANDLER_ENTRIES_2(OP_COS, cos), _HANDLER_ENTRIES_2(OP_SQRT, sqrt),
+        _HANDLER_ENTRIES_2(OP_ABS, abs), _HANDLER_ENTRIES_3(OP_MIN, min), _HANDLER_ENTRIES_3(OP_MAX, max),
+        _HANDLER_ENTRIES_3(OP_ATAN2, atan2),
+        _HANDLER_ENTRIES_2(OP_JMP, jmp), _HANDLER_ENTRIES_1(OP_CALL, call), _HANDLER_ENTRY(OP_RET, 0, do_ret),
+        _HANDLER_ENTRIES_2(OP_DIV_POW2, div_pow2), _HANDLER_ENTRIES_2(OP_MOD_POW2, mod_pow2),
+        [OP_HALT][0][0 ... 1] = &&do_halt
+    };
+    static void *superinstruction_table[AMOUNT_SUPERINSTRUCTIONS][2] = {
+        SUPERINSTRUCTIONS(_SUPERINSTRUCTION_ENTRY)
+    };
+    static void *generic_dispatch_table[AMOUNT_INSTRUCTIONS] = {
+        [OP_COLOR] = &&do_color, [OP_POINT] = &&do_point, [OP_LINE] = &&do_line, [OP_RECT] = &&do_rect,
+        [OP_PUTC] = &&do_putc, [OP_GETP] = &&do_getp, [OP_SETCH] = &&do_setch,
+        [OP_MEMFILL] = &&do_memfill, [OP_MEMCOPY] = &&do_memcopy, [OP_MEMCMP] = &&do_memcmp,
+        [OP_BLIT] = &&do_blit, [OP_BLITKEY] = &&do_blitkey, [OP_COPYRECT] = &&do_copyrect, [OP_TRI] = &&do_tri
+    };
+    
+    ProgramContext *program_context = program_state->context;
+    ProgramData *program_data = program_state->data;
+    ThreadedInstruction *instructions = program_data->threaded_code.instructions;
+    int32_t *memory = program_context->memory;
+    size_t instruction_count = program_data->instruction_count;
+
+    // Store handler offsets in the instructions the first time the program is run by this interpreter
+    if (program_data->handler_owner != (const void*) RUN_PROGRAM_THREAD) {
+        const ThreadedInfo *instruction_info = program_data->threaded_code.info;
+        for (size_t i = 0; i < program_data->threaded_code.count; i++) {
+            const ThreadedInfo *info = &instruction_info[i];
+            const void *handler;
+            if (info->idiom == IDIOM_JUMP_TABLE) {
+                handler = &&do_jump_table;
+            }
+            else if (info->idiom == IDIOM_CALL) {
+                handler = &&do_slot_call;
+            }
+            else if (info->idiom == IDIOM_RETURN) {
+                handler = &&do_slot_return;
+            }
+            else if (info->idiom) {
+                handler = &&do_idiom;
+            }
+            else if (info->superinstruction) {
+                // A superinstruction can only skip its checks if every instruction in it can
+                bool verified = true;
+                for (size_t j = i; j < i + superinstruction_length(info->superinstruction); j++) {
+                    verified &= instruction_info[j].verified;
+                }
+                handler = superinstruction_table[info->superinstruction][verified];
+            }
+            else {
+                handler = dispatch_table[threaded_opcode(info)][threaded_modes(info)][info->verified];
+            }
+            instructions[i].handler = (const char*) handler - (const char*) &&do_halt;
+        }
+        program_data->handler_owner = (const void*) RUN_PROGRAM_THREAD;
+    }
+
+    // The program counter is kept in `instruction` and only written back to `program_context` on exit
+    const ThreadedInstruction *instruction;
+    int32_t args[INSTRUCTION_ARGUMENT_BUFFER_SIZE];
+
+    // Instructions left in the budget, which taken jumps charge from `segment_start` on
+    int64_t budget = program_context->instruction_budget > 0 ? program_context->instruction_budget : INT64_MAX;
+    const ThreadedInstruction *segment_start = &instructions[index];
+
+    #ifdef ENABLE_G1_PROFILING
+        profile_record(NULL);
+    #endif
+    #ifdef INTERPRETER_CHECKED
+        // A thread suspended in the slow path continues there
+        if (program_context->resume_slow_path) {
+            program_context->resume_slow_path = false;
+            instruction = segment_start;
+            goto slow_path;
+        }
+    #endif
+    _JUMP(index);
+    
+    // Operand-specialized instructions
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_2, _UNARY_HANDLER, mov, value)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_2, _MOVP_HANDLER, movp)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, add, lhs + rhs)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, sub, lhs - rhs)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, mul, lhs * rhs)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _DIVISION_HANDLER, div, lhs / rhs)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _DIVISION_HANDLER, mod, _floored_mod(lhs, rhs))
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, less, lhs < rhs)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, equal, lhs == rhs)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_2, _UNARY_HANDLER, not, !value)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, and, lhs & rhs)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, or, lhs | rhs)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, xor, lhs ^ rhs)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, shl, shift_left(lhs, rhs))
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, shr, shift_right(lhs, rhs))
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, sar, shift_right_arithmetic(lhs, rhs))
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_2, _UNARY_HANDLER, sin, fixed_sin(value))
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_2, _UNARY_HANDLER, cos, fixed_cos(value))
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_2, _UNARY_HANDLER, sqrt, fixed_sqrt(value))
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_2, _UNARY_HANDLER, abs, fixed_abs(value))
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, min, fixed_min(lhs, rhs))
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, max, fixed_max(lhs, rhs))
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_3, _BINARY_HANDLER, atan2, fixed_atan2(lhs, rhs))
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_2, _JMP_HANDLER, jmp)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_1, _CALL_HANDLER, call)
+    _DEFINE_VARIANTS(_RET_HANDLER, ret)
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_2, _POW2_HANDLER, div_pow2, div_pow2(lhs, rhs))
+    _DEFINE_VARIANTS(_DEFINE_HANDLERS_2, _POW2_HANDLER, mod_pow2, lhs & rhs)
+
+    // Superinstructions
+    SUPERINSTRUCTIONS(_DEFINE_SUPERINSTRUCTION)
+
+    // Run a counted loop as one operation, or run its first instruction if it can't run that way this time
+    do_idiom: {
+        const CountedLoop *loop = &program_data->counted_loops.loops[_ALL_OPERANDS(instruction)[3]];
+        size_t skipped = _run_idiom(program_context, loop);
+        if (skipped) {
+            _JUMP(instruction - instructions + skipped);
+        }
+        const ThreadedInfo *info = _INFO(instruction);
+        goto *dispatch_table[threaded_opcode(info)][threaded_modes(info)][info->verified];
+    }
+
+    // Run an equal/jmp chain with one lookup, leaving its result slot as the chain would
+    do_jump_table: {
+        const JumpTable *table = &program_data->jump_tables.tables[_ALL_OPERANDS(instruction)[3]];
+        int32_t target = jump_table_lookup(table, memory[table->subject]);
+        memory[table->result] = target >= 0;
+        if (target >= 0) {
+            _JUMP_L(target);
+        }
+        _JUMP(instruction - instructions + table->length);
+    }
+
+    // Run a call through a return slot, which is its `mov` and `jmp`, and push its frame
+    do_slot_call: {
+        int32_t target = _OPERAND(instruction + 1, 0);
+        memory[_OPERAND(instruction, 0)] = _OPERAND(instruction, 1);
+        _push_slot_call(program_context, _OPERAND(instruction, 1), _OPERAND(instruction, 2));
+        instruction++;
+        _JUMP_L(target);
+    }
+
+    // Return through the top frame if it returns where the slot says, or run the `jmp` as it is otherwise
+    do_slot_return: {
+        const CallFrame *frame = _pop_slot_call(program_context, memory[_OPERAND(instruction, 0)]);
+        if (frame) {
+            _JUMP_M(frame->target);
+        }
+        const ThreadedInfo *info = _INFO(instruction);
+        goto *dispatch_table[threaded_opcode(info)][threaded_modes(info)][info->verified];
+    }
+
+    // Parse instruction arguments at runtime
+    do_generic: {
+        const ThreadedInfo *info = _INFO(instruction);
+        _CHECK_RESPONSE(_parse_arguments(args, program_context, threaded_opcode(info), threaded_modes(info), _ALL_OPERANDS(instruction)));
+        goto *generic_dispatch_table[threaded_opcode(info)];
+    }
+        
+    // Run the corresponding instruction
+    do_color:
+        _CHECK_RESPONSE(_ins_color(program_context, args));
+        _DISPATCH();
+    do_point:
+        _CHECK_RESPONSE(_ins_point(program_context, args));
+        _DISPATCH();
+    do_line:
+        _CHECK_RESPONSE(_ins_line(program_context, args));
+        _DISPATCH();
+    do_rect:
+        _CHECK_RESPONSE(_ins_rect(program_context, args));
+        _DISPATCH();
+    do_putc:
+        _CHECK_RESPONSE(_ins_putc(program_context, args));
+        _DISPATCH();
+    do_getp:
+        _CHECK_RESPONSE(_ins_getp(program_context, args));
+        _DISPATCH();
+    do_setch:
+        _CHECK_RESPONSE(_ins_setch(program_context, args));
+        _DISPATCH();
+    do_memfill:
+        _CHECK_RESPONSE(_ins_memfill(program_context, args));
+        _DISPATCH();
+    do_memcopy:
+        _CHECK_RESPONSE(_ins_memcopy(program_context, args));
+        _DISPATCH();
+    do_memcmp:
+        _CHECK_RESPONSE(_ins_memcmp(program_context, args));
+        _DISPATCH();
+    do_blit:
+        _CHECK_RESPONSE(_ins_blit(program_context, args));
+        _DISPATCH();
+    do_blitkey:
+        _CHECK_RESPONSE(_ins_blitkey(program_context, args));
+        _DISPATCH();
+    do_copyrect:
+        _CHECK_RESPONSE(_ins_copyrect(program_context, args));
+        _DISPATCH();
+    do_tri:
+        _CHECK_RESPONSE(_ins_tri(program_context, args));
+        _DISPATCH();
+
+    // The program counter reached the end of the instruction list
+    do_halt:
+        program_context->program_counter = instruction - instructions;
+        return 0;
+
+    // The thread ran out of budget, and continues from `instruction` when it's resumed
+    thread_suspended:
+        program_context->program_counter = instruction - instructions;
+        return THREAD_SUSPENDED;
+
+    #ifdef INTERPRETER_CHECKED
+    // A computed jump landed somewhere the verifier didn't expect, so run with every check until an entrypoint is reached
+    slow_path:
+        while (!_INFO(instruction)->entry_point) {
+            if (budget-- <= 0) {
+                program_context->resume_slow_path = true;
+                goto thread_suspended;
+            }
+            const ThreadedInfo *info = _INFO(instruction);
+            byte opcode = threaded_opcode(info);
+            _CHECK_RESPONSE(_parse_arguments(args, program_context, opcode, threaded_modes(info), _ALL_OPERANDS(instruction)));
+            if (opcode == OP_CALL && !_push_call(program_context, _OPERAND(instruction, 1), _OPERAND(instruction, 2))) {
+                _call_stack_overflow_error();
+                goto thread_error;
+            }
+            if ((opcode == OP_JMP && args[1]) || opcode == OP_CALL) {
+                bool in_program = !(threaded_modes(info) & 1) || (uint32_t) args[0] < instruction_count;
+                instruction = &instructions[in_program ? args[0] : (int32_t) instruction_count];
+                continue;
+            }
+            if (opcode == OP_RET) {
+                const CallFrame *frame = _pop_call(program_context);
+                if (!frame) {
+                    _call_stack_underflow_error();
+                    goto thread_error;
+                }
+                instruction = &instructions[frame->target];
+                continue;
+            }
+            _CHECK_RESPONSE(_run_instruction(program_context, opcode, args));
+            instruction++;
+        }
+        segment_start = instruction;
+        _MARK_JUMP_TARGET(instruction - instructions)
+        goto *_HANDLER(instruction);
+
+    thread_error:
+        program_context->program_counter = instruction - instructions;
+        return -1;
+    #endif
+}
+
+#undef _CHECK_ADDRESS_CHECKED
+#undef _CHECK_RESPONSE
+#undef _CHECK_ENTRY_POINT
+#undef _CALL_STACK_ERROR
+#undef _DEFINE_VARIANTS
+#undef _CHECKED_LABEL
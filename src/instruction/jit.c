@@ -0,0 +1,587 @@
+/*
+    Compiles decoded programs to x86-64 machine code.
+
+    Every instruction is compiled from a fixed template for its opcode and addressing modes.
+    Memory values are never kept in registers between instructions, so the compiled code can leave at any
+    instruction and the interpreter can continue from there with the same memory.
+    Checked code runs every check itself instead of relying on `verified`, so computed jumps may land anywhere.
+
+    Register use in compiled code:
+    - rbx: program memory
+    - r12: `ProgramContext`, passed to the generic instruction function
+    - r13: native address of every instruction, for computed jumps
+    - eax, ecx, edx: scratch
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "instruction.h"
+#include "decode.h"
+#include "jit.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+    #define JIT_SUPPORTED
+    #include <sys/mman.h>
+#endif
+
+
+// Where compiled code stopped, returned in rax and rdx.
+typedef struct {
+    size_t index;
+    size_t raised_error;
+} JitExit;
+
+typedef JitExit (*JitEntry)(int32_t *memory, void *context, size_t index, void **addresses);
+
+struct JitCode {
+    byte *code;
+    size_t code_size;
+    void **addresses;  // Native address of every decoded instruction
+    bool checked;
+};
+
+
+#ifdef JIT_SUPPORTED
+
+// Upper bound on the machine code size of one instruction
+#define MAX_TEMPLATE_SIZE 96
+
+// Size of the code around the instructions, and of the code that leaves at each instruction
+#define FRAME_CODE_SIZE 64
+#define EXIT_CODE_SIZE 15
+
+// x86 register numbers
+#define EAX 0
+#define ECX 1
+#define EDX 2
+
+
+// A rel32 field at `offset` that should point at instruction `target`, or at its exit code.
+typedef struct {
+    size_t offset;
+    size_t target;
+} Patch;
+
+typedef struct {
+    byte *code;
+    size_t length;
+    size_t capacity;
+
+    Patch *jump_patches, *exit_patches, *error_patches;
+    size_t jump_patch_count, exit_patch_count, error_patch_count;
+
+    const DecodedInstruction *instructions;
+    size_t instruction_count, decoded_count;
+    int32_t memory_size;
+    bool checked;
+    size_t return_offset;  // Code that returns the index in eax and the error flag in edx
+} Compiler;
+
+
+static void emit(Compiler *compiler, const byte *bytes, size_t length) {
+    if (compiler->length + length <= compiler->capacity) {
+        memcpy(&compiler->code[compiler->length], bytes, length);
+    }
+    compiler->length += length;
+}
+
+#define EMIT(compiler, ...) emit(compiler, (const byte[]) {__VA_ARGS__}, sizeof((const byte[]) {__VA_ARGS__}))
+
+static void emit_u32(Compiler *compiler, uint32_t value) {
+    EMIT(compiler, value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24);
+}
+
+static void emit_u64(Compiler *compiler, uint64_t value) {
+    emit_u32(compiler, (uint32_t) value);
+    emit_u32(compiler, (uint32_t) (value >> 32));
+}
+
+// Emit a rel32 field that will be patched to point at `target`.
+static void emit_patch(Compiler *compiler, Patch *patches, size_t *patch_count, size_t target) {
+    patches[(*patch_count)++] = (Patch) {compiler->length, target};
+    emit_u32(compiler, 0);
+}
+
+// Leave the compiled code at instruction `index`.
+static void emit_exit(Compiler *compiler, size_t index) {
+    EMIT(compiler, 0xe9);  // jmp rel32
+    emit_patch(compiler, compiler->exit_patches, &compiler->exit_patch_count, index);
+}
+
+// Leave the compiled code at instruction `index` if the last comparison matched `condition`.
+static void emit_exit_if(Compiler *compiler, byte condition, size_t index) {
+    EMIT(compiler, 0x0f, 0x80 | condition);  // jcc rel32
+    emit_patch(compiler, compiler->exit_patches, &compiler->exit_patch_count, index);
+}
+
+// Leave the compiled code after instruction `index` raised an error, if the last comparison matched `condition`.
+static void emit_error_if(Compiler *compiler, byte condition, size_t index) {
+    EMIT(compiler, 0x0f, 0x80 | condition);  // jcc rel32
+    emit_patch(compiler, compiler->error_patches, &compiler->error_patch_count, index);
+}
+
+#define CONDITION_AE 0x3
+#define CONDITION_E 0x4
+#define CONDITION_NE 0x5
+
+
+// Returns true if `slot` can be accessed with a 32-bit displacement from the memory register.
+static bool valid_slot(const Compiler *compiler, int32_t slot) {
+    return slot >= 0 && slot < compiler->memory_size;
+}
+
+// `op reg, [rbx + slot*4]`
+static void emit_memory_operand(Compiler *compiler, byte opcode, byte reg, int32_t slot) {
+    EMIT(compiler, opcode, 0x83 | (reg << 3));
+    emit_u32(compiler, (uint32_t) slot * 4);
+}
+
+// Load argument `i` of `ins` into `reg`.
+static void emit_load_operand(Compiler *compiler, const DecodedInstruction *ins, byte i, byte reg) {
+    int32_t operand = ins->operands[i];
+    if (ins->modes & (1 << i)) {
+        emit_memory_operand(compiler, 0x8b, reg, operand);  // mov reg, [rbx + operand*4]
+    }
+    else {
+        EMIT(compiler, 0xb8 | reg);  // mov reg, imm32
+        emit_u32(compiler, operand);
+    }
+}
+
+// Apply an arithmetic operation to eax with argument `i` of `ins`.
+static void emit_arithmetic(Compiler *compiler, const DecodedInstruction *ins, byte i, byte memory_opcode, byte immediate_opcode) {
+    int32_t operand = ins->operands[i];
+    if (ins->modes & (1 << i)) {
+        emit_memory_operand(compiler, memory_opcode, EAX, operand);
+    }
+    else {
+        EMIT(compiler, immediate_opcode);
+        emit_u32(compiler, operand);
+    }
+}
+
+// Sign extend the address in ecx to rcx, leaving at instruction `index` first if it's outside of memory.
+static void emit_check_address(Compiler *compiler, size_t index) {
+    if (compiler->checked) {
+        EMIT(compiler, 0x81, 0xf9);  // cmp ecx, imm32
+        emit_u32(compiler, compiler->memory_size);
+        emit_exit_if(compiler, CONDITION_AE, index);
+    }
+    EMIT(compiler, 0x48, 0x63, 0xc9);  // movsxd rcx, ecx
+}
+
+// Store eax at the destination of `ins`.
+static void emit_store(Compiler *compiler, const DecodedInstruction *ins, size_t index) {
+    if (ins->modes & 1) {
+        emit_load_operand(compiler, ins, 0, ECX);
+        emit_check_address(compiler, index);
+        EMIT(compiler, 0x89, 0x04, 0x8b);  // mov [rbx + rcx*4], eax
+    }
+    else {
+        emit_memory_operand(compiler, 0x89, EAX, ins->operands[0]);  // mov [rbx + dest*4], eax
+    }
+}
+
+// Set eax to 1 if the flags match `setcc`, or 0 otherwise.
+static void emit_set_flag(Compiler *compiler, byte setcc) {
+    EMIT(compiler, 0x0f, setcc, 0xc0);  // setcc al
+    EMIT(compiler, 0x0f, 0xb6, 0xc0);   // movzx eax, al
+}
+
+
+// Returns true if compiled code can run `ins` by calling the generic instruction function.
+static bool is_generic(byte opcode) {
+    switch (opcode) {
+        case OP_COLOR: case OP_POINT: case OP_LINE: case OP_RECT: case OP_PUTC: case OP_GETP: case OP_SETCH:
+        case OP_SIN: case OP_COS: case OP_SQRT: case OP_ATAN2: case OP_MEMFILL: case OP_MEMCOPY: case OP_MEMCMP:
+        case OP_BLIT: case OP_BLITKEY: case OP_COPYRECT: case OP_TRI:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+static void compile_instruction(Compiler *compiler, size_t index, JitGenericFunction generic) {
+    const DecodedInstruction *ins = &compiler->instructions[index];
+
+    // Halt, returning the index of the halt instruction so every halt looks the same to the caller
+    if (ins->opcode == OP_HALT) {
+        EMIT(compiler, 0xb8);  // mov eax, imm32
+        emit_u32(compiler, compiler->instruction_count);
+        EMIT(compiler, 0x31, 0xd2);  // xor edx, edx
+        EMIT(compiler, 0xe9);  // jmp return
+        emit_u32(compiler, (uint32_t) (compiler->return_offset - (compiler->length + 4)));
+        return;
+    }
+
+    // Instructions with literal addresses outside of memory always fail, so leave those to the interpreter
+    byte argument_count = decoded_argument_count(ins->opcode);
+    for (byte i = 0; i < argument_count; i++) {
+        if ((ins->modes & (1 << i)) && !valid_slot(compiler, ins->operands[i])) {
+            emit_exit(compiler, index);
+            return;
+        }
+    }
+    bool writes_literal_destination = writes_destination(ins->opcode) && !is_generic(ins->opcode) && !(ins->modes & 1);
+    if (writes_literal_destination && !valid_slot(compiler, ins->operands[0])) {
+        emit_exit(compiler, index);
+        return;
+    }
+
+    switch (ins->opcode) {
+        case OP_MOV:
+            emit_load_operand(compiler, ins, 1, EAX);
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_MOVP:
+            emit_load_operand(compiler, ins, 1, ECX);
+            emit_check_address(compiler, index);
+            EMIT(compiler, 0x8b, 0x04, 0x8b);  // mov eax, [rbx + rcx*4]
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_ADD:
+            emit_load_operand(compiler, ins, 1, EAX);
+            emit_arithmetic(compiler, ins, 2, 0x03, 0x05);  // add eax, src
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_SUB:
+            emit_load_operand(compiler, ins, 1, EAX);
+            emit_arithmetic(compiler, ins, 2, 0x2b, 0x2d);  // sub eax, src
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_MUL:
+            emit_load_operand(compiler, ins, 1, EAX);
+            if (ins->modes & 4) {
+                EMIT(compiler, 0x0f);
+                emit_memory_operand(compiler, 0xaf, EAX, ins->operands[2]);  // imul eax, [rbx + src*4]
+            }
+            else {
+                EMIT(compiler, 0x69, 0xc0);  // imul eax, eax, imm32
+                emit_u32(compiler, ins->operands[2]);
+            }
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_DIV:
+        case OP_MOD:
+            emit_load_operand(compiler, ins, 1, EAX);
+            emit_load_operand(compiler, ins, 2, ECX);
+            if (compiler->checked) {
+                EMIT(compiler, 0x85, 0xc9);  // test ecx, ecx
+                emit_exit_if(compiler, CONDITION_E, index);
+            }
+            EMIT(compiler, 0x99, 0xf7, 0xf9);  // cdq; idiv ecx
+            if (ins->opcode == OP_MOD) {
+                // Give the remainder the sign of the divisor, like `_floored_mod`
+                EMIT(compiler,
+                    0x85, 0xd2,  // test edx, edx
+                    0x74, 0x08,  // jz done
+                    0x89, 0xd0,  // mov eax, edx
+                    0x31, 0xc8,  // xor eax, ecx
+                    0x79, 0x02,  // jns done
+                    0x01, 0xca,  // add edx, ecx
+                    0x89, 0xd0   // done: mov eax, edx
+                );
+            }
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_DIV_POW2:
+            // Round towards zero by adding `(1 << shift) - 1` to negative values before shifting
+            emit_load_operand(compiler, ins, 1, EAX);
+            EMIT(compiler, 0x89, 0xc1);  // mov ecx, eax
+            EMIT(compiler, 0xc1, 0xf9, 0x1f);  // sar ecx, 31
+            EMIT(compiler, 0x81, 0xe1);  // and ecx, imm32
+            emit_u32(compiler, ((uint32_t) 1 << ins->operands[2]) - 1);
+            EMIT(compiler, 0x01, 0xc8);  // add eax, ecx
+            EMIT(compiler, 0xc1, 0xf8, (byte) ins->operands[2]);  // sar eax, shift
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_MOD_POW2:
+            emit_load_operand(compiler, ins, 1, EAX);
+            EMIT(compiler, 0x25);  // and eax, imm32
+            emit_u32(compiler, ins->operands[2]);
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_AND:
+            emit_load_operand(compiler, ins, 1, EAX);
+            emit_arithmetic(compiler, ins, 2, 0x23, 0x25);  // and eax, src
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_OR:
+            emit_load_operand(compiler, ins, 1, EAX);
+            emit_arithmetic(compiler, ins, 2, 0x0b, 0x0d);  // or eax, src
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_XOR:
+            emit_load_operand(compiler, ins, 1, EAX);
+            emit_arithmetic(compiler, ins, 2, 0x33, 0x35);  // xor eax, src
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_SHL:
+        case OP_SHR:
+        case OP_SAR: {
+            // x86 shifts only use the low five bits of cl, like `shift_left` and friends
+            static const byte SHIFT_MODRM[] = {[OP_SHL-OP_SHL] = 0xe0, [OP_SHR-OP_SHL] = 0xe8, [OP_SAR-OP_SHL] = 0xf8};
+            emit_load_operand(compiler, ins, 1, EAX);
+            emit_load_operand(compiler, ins, 2, ECX);
+            EMIT(compiler, 0xd3, SHIFT_MODRM[ins->opcode-OP_SHL]);  // shl/shr/sar eax, cl
+            emit_store(compiler, ins, index);
+            break;
+        }
+
+        case OP_ABS:
+            emit_load_operand(compiler, ins, 1, EAX);
+            EMIT(compiler, 0x89, 0xc1);  // mov ecx, eax
+            EMIT(compiler, 0xf7, 0xd9);  // neg ecx
+            EMIT(compiler, 0x0f, 0x49, 0xc1);  // cmovns eax, ecx
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_MIN:
+        case OP_MAX:
+            emit_load_operand(compiler, ins, 1, EAX);
+            emit_load_operand(compiler, ins, 2, ECX);
+            EMIT(compiler, 0x39, 0xc8);  // cmp eax, ecx
+            EMIT(compiler, 0x0f, ins->opcode == OP_MIN ? 0x4f : 0x4c, 0xc1);  // cmovg/cmovl eax, ecx
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_LESS:
+        case OP_EQUAL:
+            emit_load_operand(compiler, ins, 1, EAX);
+            emit_arithmetic(compiler, ins, 2, 0x3b, 0x3d);  // cmp eax, src
+            emit_set_flag(compiler, ins->opcode == OP_LESS ? 0x9c : 0x94);
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_NOT:
+            emit_load_operand(compiler, ins, 1, EAX);
+            EMIT(compiler, 0x85, 0xc0);  // test eax, eax
+            emit_set_flag(compiler, 0x94);
+            emit_store(compiler, ins, index);
+            break;
+
+        case OP_JMP: {
+            bool computed = ins->modes & 1;
+            bool conditional = ins->modes & 2;
+            if (!conditional && ins->operands[1] == 0) {
+                break;
+            }
+
+            size_t skip_offset = 0;
+            if (conditional) {
+                emit_load_operand(compiler, ins, 1, EAX);
+                EMIT(compiler, 0x85, 0xc0);  // test eax, eax
+                if (!computed) {
+                    EMIT(compiler, 0x0f, 0x85);  // jnz target
+                    emit_patch(compiler, compiler->jump_patches, &compiler->jump_patch_count, ins->operands[0]);
+                    break;
+                }
+                EMIT(compiler, 0x74, 0x00);  // jz skip
+                skip_offset = compiler->length;
+            }
+
+            if (computed) {
+                // Targets outside of the program jump to the halt code
+                emit_load_operand(compiler, ins, 0, EAX);
+                EMIT(compiler, 0x3d);  // cmp eax, imm32
+                emit_u32(compiler, compiler->instruction_count);
+                EMIT(compiler, 0x72, 0x05, 0xb8);  // jb in_range; mov eax, imm32
+                emit_u32(compiler, compiler->instruction_count);
+                EMIT(compiler, 0x41, 0xff, 0x64, 0xc5, 0x00);  // in_range: jmp [r13 + rax*8]
+            }
+            else {
+                EMIT(compiler, 0xe9);  // jmp target
+                emit_patch(compiler, compiler->jump_patches, &compiler->jump_patch_count, ins->operands[0]);
+            }
+
+            if (conditional && compiler->length <= compiler->capacity) {
+                compiler->code[skip_offset-1] = compiler->length - skip_offset;
+            }
+            break;
+        }
+
+        default:
+            if (!is_generic(ins->opcode)) {
+                emit_exit(compiler, index);
+                break;
+            }
+            EMIT(compiler, 0x4c, 0x89, 0xe7);  // mov rdi, r12
+            EMIT(compiler, 0x48, 0xbe);        // mov rsi, imm64
+            emit_u64(compiler, (uint64_t) (uintptr_t) ins);
+            EMIT(compiler, 0x48, 0xb8);        // mov rax, imm64
+            emit_u64(compiler, (uint64_t) (uintptr_t) generic);
+            EMIT(compiler, 0xff, 0xd0);        // call rax
+            if (compiler->checked) {
+                EMIT(compiler, 0x85, 0xc0);    // test eax, eax
+                emit_error_if(compiler, CONDITION_NE, index);
+            }
+            break;
+    }
+}
+
+
+static void patch_rel32(byte *code, size_t offset, size_t destination) {
+    int32_t rel = (int32_t) (destination - (offset + 4));
+    memcpy(&code[offset], &rel, 4);
+}
+
+
+JitCode* jit_compile(const DecodedInstruction *instructions, size_t instruction_count, size_t decoded_count, int32_t memory_size, bool checked, JitGenericFunction generic) {
+    // Memory displacements are 32 bits
+    if (memory_size <= 0 || memory_size > INT32_MAX / 4 || decoded_count > INT32_MAX) {
+        return NULL;
+    }
+
+    Compiler compiler = {0};
+    compiler.instructions = instructions;
+    compiler.instruction_count = instruction_count;
+    compiler.decoded_count = decoded_count;
+    compiler.memory_size = memory_size;
+    compiler.checked = checked;
+    compiler.capacity = FRAME_CODE_SIZE + decoded_count * (MAX_TEMPLATE_SIZE + EXIT_CODE_SIZE*2);
+
+    JitCode *jit_code = calloc(1, sizeof(JitCode));
+    size_t *offsets = malloc(sizeof(size_t) * decoded_count);
+    size_t *exit_offsets = malloc(sizeof(size_t) * decoded_count * 2);
+    compiler.jump_patches = malloc(sizeof(Patch) * decoded_count);
+    compiler.exit_patches = malloc(sizeof(Patch) * decoded_count * 4);
+    compiler.error_patches = malloc(sizeof(Patch) * decoded_count);
+    void *code = mmap(NULL, compiler.capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit_code) {
+        jit_code->addresses = malloc(sizeof(void*) * decoded_count);
+    }
+
+    bool compiled = false;
+    if (jit_code && jit_code->addresses && offsets && exit_offsets && compiler.jump_patches && compiler.exit_patches && compiler.error_patches && code != MAP_FAILED) {
+        compiler.code = code;
+
+        // JitExit entry(int32_t *memory, void *context, size_t index, void **addresses)
+        EMIT(&compiler, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56);  // push rbx, rbp, r12, r13, r14
+        EMIT(&compiler, 0x48, 0x89, 0xfb);  // mov rbx, rdi
+        EMIT(&compiler, 0x49, 0x89, 0xf4);  // mov r12, rsi
+        EMIT(&compiler, 0x49, 0x89, 0xcd);  // mov r13, rcx
+        EMIT(&compiler, 0x48, 0x89, 0xd0);  // mov rax, rdx
+        EMIT(&compiler, 0x41, 0xff, 0x64, 0xc5, 0x00);  // jmp [r13 + rax*8]
+
+        // Return the instruction index in eax and whether an error was raised in edx
+        compiler.return_offset = compiler.length;
+        EMIT(&compiler, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5d, 0x5b, 0xc3);  // pop r14, r13, r12, rbp, rbx; ret
+
+        for (size_t i = 0; i < decoded_count; i++) {
+            offsets[i] = compiler.length;
+            compile_instruction(&compiler, i, generic);
+        }
+
+        // Code that leaves at each instruction that needs it
+        size_t *error_offsets = &exit_offsets[decoded_count];
+        for (size_t i = 0; i < decoded_count; i++) {
+            exit_offsets[i] = error_offsets[i] = SIZE_MAX;
+        }
+        for (int raised_error = 0; raised_error < 2; raised_error++) {
+            Patch *patches = raised_error ? compiler.error_patches : compiler.exit_patches;
+            size_t patch_count = raised_error ? compiler.error_patch_count : compiler.exit_patch_count;
+            size_t *stub_offsets = raised_error ? error_offsets : exit_offsets;
+            for (size_t i = 0; i < patch_count; i++) {
+                size_t index = patches[i].target;
+                if (stub_offsets[index] != SIZE_MAX) {
+                    continue;
+                }
+                stub_offsets[index] = compiler.length;
+                EMIT(&compiler, 0xb8);  // mov eax, imm32
+                emit_u32(&compiler, index);
+                EMIT(&compiler, 0xba);  // mov edx, imm32
+                emit_u32(&compiler, raised_error);
+                EMIT(&compiler, 0xe9);  // jmp return
+                emit_u32(&compiler, (uint32_t) (compiler.return_offset - (compiler.length + 4)));
+            }
+        }
+
+        if (compiler.length <= compiler.capacity) {
+            for (size_t i = 0; i < compiler.jump_patch_count; i++) {
+                patch_rel32(compiler.code, compiler.jump_patches[i].offset, offsets[compiler.jump_patches[i].target]);
+            }
+            for (size_t i = 0; i < compiler.exit_patch_count; i++) {
+                patch_rel32(compiler.code, compiler.exit_patches[i].offset, exit_offsets[compiler.exit_patches[i].target]);
+            }
+            for (size_t i = 0; i < compiler.error_patch_count; i++) {
+                patch_rel32(compiler.code, compiler.error_patches[i].offset, error_offsets[compiler.error_patches[i].target]);
+            }
+            for (size_t i = 0; i < decoded_count; i++) {
+                jit_code->addresses[i] = &compiler.code[offsets[i]];
+            }
+            compiled = mprotect(code, compiler.capacity, PROT_READ | PROT_EXEC) == 0;
+        }
+    }
+
+    free(offsets);
+    free(exit_offsets);
+    free(compiler.jump_patches);
+    free(compiler.exit_patches);
+    free(compiler.error_patches);
+    if (!compiled) {
+        if (code != MAP_FAILED) {
+            munmap(code, compiler.capacity);
+        }
+        if (jit_code) {
+            free(jit_code->addresses);
+        }
+        free(jit_code);
+        return NULL;
+    }
+
+    jit_code->code = code;
+    jit_code->code_size = compiler.capacity;
+    jit_code->checked = checked;
+    return jit_code;
+}
+
+
+size_t jit_run(const JitCode *jit_code, int32_t *memory, void *context, size_t index, bool *raised_error) {
+    JitEntry entry = (JitEntry) jit_code->code;
+    JitExit exit = entry(memory, context, index, jit_code->addresses);
+    *raised_error = exit.raised_error;
+    return exit.index;
+}
+
+
+void jit_free(JitCode *jit_code) {
+    if (!jit_code) {
+        return;
+    }
+    munmap(jit_code->code, jit_code->code_size);
+    free(jit_code->addresses);
+    free(jit_code);
+}
+
+#else
+
+JitCode* jit_compile(const DecodedInstruction *instructions, size_t instruction_count, size_t decoded_count, int32_t memory_size, bool checked, JitGenericFunction generic) {
+    return NULL;
+}
+
+size_t jit_run(const JitCode *jit_code, int32_t *memory, void *context, size_t index, bool *raised_error) {
+    *raised_error = false;
+    return index;
+}
+
+void jit_free(JitCode *jit_code) {}
+
+#endif
+
+
+bool jit_is_checked(const JitCode *jit_code) {
+    return jit_code->checked;
+}
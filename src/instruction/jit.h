@@ -0,0 +1,43 @@
+/*
+    Compiles decoded programs to x86-64 machine code.
+*/
+
+#ifndef JIT_HEADER
+#define JIT_HEADER
+
+#include "util.h"
+#include "decode.h"
+
+
+/*
+Runs an instruction that compiled code doesn't implement itself, like the graphics and audio instructions.
+`context` is the program's `ProgramContext`. Returns nonzero if the instruction failed.
+*/
+typedef int (*JitGenericFunction)(void *context, const DecodedInstruction *instruction);
+
+typedef struct JitCode JitCode;
+
+
+/*
+Compile every decoded instruction into a block of executable memory, including any optimized code after the halt
+instruction at `instruction_count`.
+If `checked` is set, any instruction that would fail leaves the compiled code so the error can be raised outside of it.
+Returns `NULL` if the host isn't supported or the program can't be compiled.
+*/
+JitCode* jit_compile(const DecodedInstruction *instructions, size_t instruction_count, size_t decoded_count, int32_t memory_size, bool checked, JitGenericFunction generic);
+
+/*
+Run compiled code from instruction `index` until the program halts or reaches an instruction it can't run, like `call`
+and `ret`, or one that would raise a runtime error in checked code.
+Returns the index of that instruction, which is `instruction_count` if the program halted. Checked code may have
+reached it through a computed jump the verifier didn't expect, so it must be run with every check.
+`raised_error` is set if the generic instruction function failed at the returned index, which ends the thread.
+*/
+size_t jit_run(const JitCode *jit_code, int32_t *memory, void *context, size_t index, bool *raised_error);
+
+// Returns true if `jit_code` was compiled with `checked` set.
+bool jit_is_checked(const JitCode *jit_code);
+
+void jit_free(JitCode *jit_code);
+
+#endif
@@ -0,0 +1,166 @@
+/*
+    Recognition of equal/jmp chains that compare one memory slot against literals,
+    so the interpreter can dispatch them with one table lookup.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "instruction.h"
+#include "decode.h"
+#include "jump_table.h"
+
+
+// A comparison in a chain, in the order it appears
+typedef struct {
+    int32_t key, target;
+    uint32_t order;
+} JumpCase;
+
+
+static int compare_cases(const void *a, const void *b) {
+    const JumpCase *case_a = a, *case_b = b;
+    if (case_a->key != case_b->key) {
+        return (case_a->key > case_b->key) - (case_a->key < case_b->key);
+    }
+    return (case_a->order > case_b->order) - (case_a->order < case_b->order);
+}
+
+
+// Returns true if `ins` is `equal result $subject key` or `equal result key $subject`, and sets its operands.
+static bool is_comparison(const DecodedInstruction *ins, int32_t *result, int32_t *subject, int32_t *key) {
+    if (ins->opcode != OP_EQUAL || (ins->modes != MODES_LML && ins->modes != MODES_LLM)) {
+        return false;
+    }
+    bool subject_first = ins->modes == MODES_LML;
+    *result = ins->operands[0];
+    *subject = ins->operands[subject_first ? 1 : 2];
+    *key = ins->operands[subject_first ? 2 : 1];
+    return true;
+}
+
+
+static bool in_memory(int32_t address, size_t memory_size) {
+    return address >= 0 && (size_t) address < memory_size;
+}
+
+
+// Returns the number of comparisons in the chain starting at `head`, and sets the slots it uses.
+static uint32_t count_cases(const DecodedInstruction *instructions, size_t decoded_count, size_t head, int32_t *subject, int32_t *result) {
+    uint32_t case_count = 0;
+    for (size_t i = head; i + 1 < decoded_count && case_count < INT32_MAX / 2; i += 2) {
+        int32_t case_result, case_subject, key;
+        const DecodedInstruction *jump = &instructions[i+1];
+        if (instructions[i].idiom || !is_comparison(&instructions[i], &case_result, &case_subject, &key)) {
+            break;
+        }
+        if (jump->opcode != OP_JMP || jump->modes != MODES_LM || jump->operands[1] != case_result) {
+            break;
+        }
+        if (case_count > 0 && (case_subject != *subject || case_result != *result)) {
+            break;
+        }
+        *subject = case_subject;
+        *result = case_result;
+        case_count++;
+    }
+    return case_count;
+}
+
+
+// Build the table for the chain of `case_count` comparisons at `head`. Returns false if it couldn't be allocated.
+static bool build_table(const DecodedInstruction *instructions, size_t head, uint32_t case_count, JumpTable *table) {
+    JumpCase *cases = malloc(sizeof(JumpCase) * case_count);
+    table->keys = malloc(sizeof(int32_t) * case_count);
+    table->targets = malloc(sizeof(int32_t) * case_count);
+    table->dense_targets = NULL;
+    if (!cases || !table->keys || !table->targets) {
+        free(cases);
+        free(table->keys);
+        free(table->targets);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < case_count; i++) {
+        int32_t result = 0, subject = 0;
+        is_comparison(&instructions[head + 2*i], &result, &subject, &cases[i].key);
+        cases[i].target = instructions[head + 2*i + 1].operands[0];
+        cases[i].order = i;
+    }
+
+    // Only the first comparison against a key can match
+    qsort(cases, case_count, sizeof(JumpCase), compare_cases);
+    table->case_count = 0;
+    for (uint32_t i = 0; i < case_count; i++) {
+        if (i == 0 || cases[i].key != cases[i-1].key) {
+            table->keys[table->case_count] = cases[i].key;
+            table->targets[table->case_count] = cases[i].target;
+            table->case_count++;
+        }
+    }
+    free(cases);
+
+    int64_t span = (int64_t) table->keys[table->case_count-1] - table->keys[0] + 1;
+    if (span <= (int64_t) table->case_count * DENSE_JUMP_TABLE_RATIO) {
+        table->dense_targets = malloc(sizeof(int32_t) * span);
+    }
+    if (table->dense_targets) {
+        table->low = table->keys[0];
+        table->span = span;
+        memset(table->dense_targets, 0xff, sizeof(int32_t) * span);
+        for (uint32_t i = 0; i < table->case_count; i++) {
+            table->dense_targets[table->keys[i] - table->low] = table->targets[i];
+        }
+    }
+    return true;
+}
+
+
+void recognize_jump_tables(DecodedInstruction *instructions, size_t decoded_count, size_t memory_size, JumpTableList *jump_tables) {
+    jump_tables->tables = NULL;
+    jump_tables->count = 0;
+    size_t capacity = 0;
+
+    for (size_t i = 0; i < decoded_count; i++) {
+        int32_t subject = 0, result = 0;
+        uint32_t case_count = count_cases(instructions, decoded_count, i, &subject, &result);
+        if (case_count < MIN_JUMP_TABLE_CASES) {
+            continue;
+        }
+        if (subject == result || !in_memory(subject, memory_size) || !in_memory(result, memory_size)) {
+            continue;
+        }
+
+        if (jump_tables->count == capacity) {
+            size_t new_capacity = capacity ? capacity * 2 : 8;
+            JumpTable *tables = realloc(jump_tables->tables, sizeof(JumpTable) * new_capacity);
+            if (!tables) {
+                return;
+            }
+            jump_tables->tables = tables;
+            capacity = new_capacity;
+        }
+        JumpTable *table = &jump_tables->tables[jump_tables->count];
+        if (!build_table(instructions, i, case_count, table)) {
+            return;
+        }
+        table->subject = subject;
+        table->result = result;
+        table->length = 2 * case_count;
+
+        instructions[i].idiom = IDIOM_JUMP_TABLE;
+        instructions[i].operands[3] = jump_tables->count++;
+        i += table->length - 1;
+    }
+}
+
+
+void free_jump_tables(JumpTableList *jump_tables) {
+    for (size_t i = 0; i < jump_tables->count; i++) {
+        free(jump_tables->tables[i].keys);
+        free(jump_tables->tables[i].targets);
+        free(jump_tables->tables[i].dense_targets);
+    }
+    free(jump_tables->tables);
+    jump_tables->tables = NULL;
+    jump_tables->count = 0;
+}
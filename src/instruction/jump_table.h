@@ -0,0 +1,78 @@
+/*
+    Recognition of equal/jmp chains that compare one memory slot against literals,
+    so the interpreter can dispatch them with one table lookup.
+*/
+
+#ifndef JUMP_TABLE_HEADER
+#define JUMP_TABLE_HEADER
+
+#include "decode.h"
+
+// Shorter chains run faster as they are
+#define MIN_JUMP_TABLE_CASES 4
+
+// Keys that span at most this many slots per case are looked up by index instead of by binary search
+#define DENSE_JUMP_TABLE_RATIO 4
+
+
+/*
+A chain of comparisons of `subject` against literal keys, each followed by a jump on the result:
+
+    equal result $subject key
+    jmp target $result
+    ...
+
+Running it leaves `result` set to 1 and jumps to the target of the first matching key,
+or leaves `result` set to 0 and continues after the chain if no key matches.
+*/
+typedef struct {
+    int32_t subject, result;
+    uint32_t length;  // Instructions in the chain
+
+    // Every distinct key and the target of its first comparison, sorted by key
+    uint32_t case_count;
+    int32_t *keys, *targets;
+
+    // For dense keys, the target for each key from `low`, or -1 where no key matches. `NULL` otherwise.
+    int32_t *dense_targets;
+    int32_t low;
+    uint32_t span;
+} JumpTable;
+
+struct JumpTableList {
+    JumpTable *tables;
+    size_t count;
+};
+
+
+/*
+Find every chain of at least `MIN_JUMP_TABLE_CASES` comparisons and build a `JumpTable` for it in `jump_tables`.
+The first instruction of each chain gets `IDIOM_JUMP_TABLE`, with the index of its table as its fourth operand.
+Every slot the chains use must be inside a memory of `memory_size` slots. Chains that tables can't be allocated for
+are left to run as they are.
+*/
+void recognize_jump_tables(DecodedInstruction *instructions, size_t decoded_count, size_t memory_size, JumpTableList *jump_tables);
+
+void free_jump_tables(JumpTableList *jump_tables);
+
+
+// Returns the instruction that `table` jumps to when its subject holds `value`, or -1 if no key matches.
+static inline int32_t jump_table_lookup(const JumpTable *table, int32_t value) {
+    if (table->dense_targets) {
+        uint32_t offset = (uint32_t) value - (uint32_t) table->low;
+        return offset < table->span ? table->dense_targets[offset] : -1;
+    }
+    uint32_t low = 0, high = table->case_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (table->keys[middle] < value) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low < table->case_count && table->keys[low] == value ? table->targets[low] : -1;
+}
+
+#endif
@@ -0,0 +1,1441 @@
+/*
+    Load-time optimization of decoded programs.
+
+    The program is split into basic blocks and lifted into SSA form. Every slot that the program addresses directly
+    is a variable, with a phi value at the start of each block and a new value wherever an instruction stores to it.
+    Each round runs these passes over the whole program:
+    - Value numbering while lifting, which folds constants, simplifies identities like `add x 0`, and finds common
+      subexpressions and copies
+    - Sparse conditional constant propagation across blocks, which also finds blocks that can never run
+    - Rewriting, which replaces reads with literals or with the slot a value was first stored in, removes stores of
+      values a slot already holds, folds jumps on known conditions, and strength reduces `div` and `mod` by powers of two
+    - Dead store elimination, using the liveness of the variables
+
+    The results are lowered back to decoded instructions, which are placed after the halt instruction.
+    Instruction indices are visible to programs through computed jumps, so the original instructions stay where they
+    are, and the blocks where the entrypoints and computed jumps are expected to land jump into the optimized code.
+    A computed jump that lands anywhere else runs the original instructions until it reaches one of those blocks.
+    Calls and returns are left as they are, and the instructions that calls jump to and return to are entry blocks.
+
+    Instructions are never reordered, and the only stores removed are ones that nothing reads before the slot is
+    written again. Instructions that can raise a runtime error are only removed when they are known to pass.
+    `movp` from an unknown address, computed jumps and halts may read any slot, and indirect stores may write any slot,
+    so memory holds what the original program would have stored wherever it can be observed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "instruction.h"
+#include "decode.h"
+#include "fixed_math.h"
+#include "optimize.h"
+
+// Each round exposes more work for the next one, like copies that become dead once their reads are folded
+#define OPTIMIZATION_ROUNDS 3
+
+// Programs that would need more phi values than this are run as written, which bounds load time and memory use
+#define MAX_PHI_VALUES (1 << 21)
+
+// Reserved slots holding program metadata, which are folded to their values unless the program may store to them
+#define FIRST_CONSTANT_SLOT 8
+#define AMOUNT_CONSTANT_SLOTS 4
+
+#define NO_BLOCK SIZE_MAX
+#define HALT_BLOCK (SIZE_MAX-1)
+#define NO_VALUE UINT32_MAX
+#define NO_SLOT -1
+
+
+typedef enum {
+    VALUE_CONSTANT,
+    VALUE_RESULT,  // Computed from `operands` by an arithmetic or logic instruction
+    VALUE_UNKNOWN  // Read from memory that isn't modeled, like the result of `movp` or `getp`
+} ValueKind;
+
+/*
+Any value other than a phi value. Phi values take the first ids, see `phi_value`.
+`home` is the variable the value was first stored in, which is where copies of it are read from.
+*/
+typedef struct {
+    byte kind;
+    byte opcode;
+    int32_t constant;
+    uint32_t operands[2];
+    int32_t home;
+} Value;
+
+
+typedef enum {
+    LATTICE_UNDEFINED,
+    LATTICE_CONSTANT,
+    LATTICE_VARYING
+} LatticeState;
+
+typedef struct {
+    byte state;
+    int32_t constant;
+} LatticeValue;
+
+
+#define EFFECT_BARRIER 0x1       // Has a literal address outside of memory, so it's left exactly as it is
+#define EFFECT_READS_MEMORY 0x2  // May read any slot
+#define EFFECT_CLOBBERS 0x4      // May store to any slot
+
+// An instruction lifted into SSA form.
+typedef struct {
+    uint32_t values[MAX_ARGUMENTS];  // Value of each argument, where the first is the pointer of an indirect store
+    int32_t slots[MAX_ARGUMENTS];    // Slot to read each address argument from
+    uint32_t result;                 // Value stored at a literal destination, or `NO_VALUE`
+    uint32_t previous;               // Value the destination held before the store, or `NO_VALUE` if it isn't known
+    int32_t copy_slot;               // Slot that already holds `result`, or `NO_SLOT` if it has to be computed
+    byte effects;
+} IrInstruction;
+
+
+typedef struct {
+    DecodedInstruction *code;  // Points into `Optimizer.code`
+    size_t length;
+    size_t source_index;       // Index of the first instruction of the block in the original program
+    size_t taken, next;        // Jump target and fallthrough, a block index, `NO_BLOCK` or `HALT_BLOCK`
+    bool entry;                // Reached from outside of the optimized code, where nothing is known about memory
+    bool reachable;
+
+    uint32_t first_value, end_value;  // Values created while lifting the block
+    uint32_t condition;               // Value of the jump condition, if the block ends with a jump
+    bool taken_feasible, next_feasible, visited, queued;
+    size_t output_index;
+} Block;
+
+
+typedef struct {
+    const ProgramInfo *program_info;
+    size_t instruction_count;
+    bool changed;
+
+    DecodedInstruction *code;
+    IrInstruction *ir;  // Parallel to `code`
+    Block *blocks;
+    size_t block_count;
+    size_t *predecessors, *predecessor_starts;
+
+    int32_t constant_values[AMOUNT_CONSTANT_SLOTS];
+    bool constant_slots[AMOUNT_CONSTANT_SLOTS];
+
+    // State of the current round
+    int32_t *variables;  // Sorted slots
+    size_t variable_count;
+    uint32_t phi_count;
+    Value *values;
+    size_t value_count, value_capacity;
+    uint32_t *value_table;  // Hash table of constant and result value ids
+    size_t value_table_capacity;
+    uint32_t unknown_value;  // Shared by every variable whose value is unknown at the end of a block
+    uint32_t *exits;         // Value of every variable at the end of every block
+    LatticeValue *lattice;
+
+    // State of the block being lifted
+    size_t block;
+    uint32_t *current;
+    uint32_t *current_generation;
+    uint32_t generation, block_generation;
+} Optimizer;
+
+
+static bool is_address(const DecodedInstruction *ins, byte argument) {
+    return ins->modes & (1 << argument);
+}
+
+static bool in_memory(const Optimizer *optimizer, int32_t slot) {
+    return slot >= 0 && slot < optimizer->program_info->memory_size;
+}
+
+// Returns true if the instruction computes its result from its arguments alone.
+static bool is_arithmetic(byte opcode) {
+    switch (opcode) {
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+        case OP_LESS: case OP_EQUAL: case OP_NOT: case OP_DIV_POW2: case OP_MOD_POW2:
+        case OP_AND: case OP_OR: case OP_XOR: case OP_SHL: case OP_SHR: case OP_SAR:
+        case OP_SIN: case OP_COS: case OP_SQRT: case OP_ABS: case OP_MIN: case OP_MAX: case OP_ATAN2:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Returns true if the arithmetic instruction has a single operand.
+static bool is_unary(byte opcode) {
+    switch (opcode) {
+        case OP_NOT: case OP_SIN: case OP_COS: case OP_SQRT: case OP_ABS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool is_commutative(byte opcode) {
+    switch (opcode) {
+        case OP_ADD: case OP_MUL: case OP_EQUAL: case OP_AND: case OP_OR: case OP_XOR: case OP_MIN: case OP_MAX:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Returns true if the only slots the instruction reads or writes are the ones its arguments address.
+static bool is_modeled(byte opcode) {
+    switch (opcode) {
+        case OP_MOV: case OP_MOVP: case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+        case OP_LESS: case OP_EQUAL: case OP_NOT: case OP_JMP: case OP_COLOR: case OP_POINT: case OP_LINE:
+        case OP_RECT: case OP_PUTC: case OP_GETP: case OP_SETCH: case OP_DIV_POW2: case OP_MOD_POW2:
+        case OP_AND: case OP_OR: case OP_XOR: case OP_SHL: case OP_SHR: case OP_SAR:
+        case OP_SIN: case OP_COS: case OP_SQRT: case OP_ABS: case OP_MIN: case OP_MAX: case OP_ATAN2:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+Returns true if the instruction is left exactly as it is and may read or write any slot.
+This is any instruction with a literal address outside of memory, which always fails.
+*/
+static bool is_barrier(const Optimizer *optimizer, const DecodedInstruction *ins) {
+    if (!is_modeled(ins->opcode)) {
+        return true;
+    }
+    byte argument_count = decoded_argument_count(ins->opcode);
+    for (byte i = 0; i < argument_count; i++) {
+        bool literal_destination = i == 0 && writes_destination(ins->opcode) && !is_address(ins, 0);
+        bool literal_source = i == 1 && ins->opcode == OP_MOVP && !is_address(ins, 1);
+        if ((is_address(ins, i) || literal_destination || literal_source) && !in_memory(optimizer, ins->operands[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns true if removing the instruction can only change the slot at its literal destination.
+static bool is_removable(const Optimizer *optimizer, const DecodedInstruction *ins) {
+    if (!writes_destination(ins->opcode) || ins->opcode == OP_GETP || is_address(ins, 0) || is_barrier(optimizer, ins)) {
+        return false;
+    }
+    if (ins->opcode == OP_MOVP) {
+        return !is_address(ins, 1);
+    }
+    if (ins->opcode == OP_DIV || ins->opcode == OP_MOD) {
+        // Dividing the smallest integer by -1 traps like dividing by zero
+        return !is_address(ins, 2) && ins->operands[2] != 0 && ins->operands[2] != -1;
+    }
+    return true;
+}
+
+
+// Modulo whose result takes the sign of the divisor.
+static int32_t floored_mod(int32_t a, int32_t b) {
+    int32_t mod = a % b;
+    if (mod != 0 && (mod < 0) ^ (b < 0)) {
+        mod += b;
+    }
+    return mod;
+}
+
+// Compute `opcode` on constants. Returns false if it would fail.
+static bool fold(byte opcode, int32_t a, int32_t b, int32_t *result) {
+    switch (opcode) {
+        case OP_ADD: *result = (int32_t) ((uint32_t) a + (uint32_t) b); return true;
+        case OP_SUB: *result = (int32_t) ((uint32_t) a - (uint32_t) b); return true;
+        case OP_MUL: *result = (int32_t) ((uint32_t) a * (uint32_t) b); return true;
+        case OP_DIV:
+        case OP_MOD:
+            if (b == 0 || (a == INT32_MIN && b == -1)) {
+                return false;
+            }
+            *result = opcode == OP_DIV ? a / b : floored_mod(a, b);
+            return true;
+        case OP_LESS: *result = a < b; return true;
+        case OP_EQUAL: *result = a == b; return true;
+        case OP_NOT: *result = !a; return true;
+        case OP_DIV_POW2: *result = div_pow2(a, b); return true;
+        case OP_MOD_POW2: *result = a & b; return true;
+        case OP_AND: *result = a & b; return true;
+        case OP_OR: *result = a | b; return true;
+        case OP_XOR: *result = a ^ b; return true;
+        case OP_SHL: *result = shift_left(a, b); return true;
+        case OP_SHR: *result = shift_right(a, b); return true;
+        case OP_SAR: *result = shift_right_arithmetic(a, b); return true;
+        case OP_SIN: *result = fixed_sin(a); return true;
+        case OP_COS: *result = fixed_cos(a); return true;
+        case OP_SQRT: *result = fixed_sqrt(a); return true;
+        case OP_ABS: *result = fixed_abs(a); return true;
+        case OP_MIN: *result = fixed_min(a, b); return true;
+        case OP_MAX: *result = fixed_max(a, b); return true;
+        case OP_ATAN2: *result = fixed_atan2(a, b); return true;
+        default: return false;
+    }
+}
+
+// Returns the shift of a power of two divisor that `OP_DIV_POW2` can run, or 0.
+static int32_t power_of_two_shift(int32_t divisor) {
+    if (divisor < 2 || (divisor & (divisor - 1))) {
+        return 0;
+    }
+    int32_t shift = 0;
+    while ((1 << shift) != divisor) {
+        shift++;
+    }
+    return shift;
+}
+
+
+// Returns the variable index of `slot`, or -1 if the program doesn't address it directly.
+static int32_t variable_index(const Optimizer *optimizer, int32_t slot) {
+    size_t low = 0, high = optimizer->variable_count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (optimizer->variables[middle] < slot) {
+            low = middle+1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low < optimizer->variable_count && optimizer->variables[low] == slot ? (int32_t) low : -1;
+}
+
+static int compare_slots(const void *a, const void *b) {
+    int32_t slot_a = *(const int32_t*) a, slot_b = *(const int32_t*) b;
+    return (slot_a > slot_b) - (slot_a < slot_b);
+}
+
+// Make every slot that the reachable code addresses directly a variable.
+static int collect_variables(Optimizer *optimizer) {
+    size_t capacity = 0;
+    for (size_t i = 0; i < optimizer->block_count; i++) {
+        capacity += optimizer->blocks[i].length * MAX_ARGUMENTS;
+    }
+    free(optimizer->variables);
+    optimizer->variables = malloc(sizeof(int32_t) * (capacity > 0 ? capacity : 1));
+    if (!optimizer->variables) {
+        return -1;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < optimizer->block_count; i++) {
+        const Block *block = &optimizer->blocks[i];
+        for (size_t j = 0; j < block->length && block->reachable; j++) {
+            const DecodedInstruction *ins = &block->code[j];
+            byte argument_count = decoded_argument_count(ins->opcode);
+            for (byte k = 0; k < argument_count; k++) {
+                bool literal_destination = k == 0 && writes_destination(ins->opcode) && !is_address(ins, 0);
+                bool literal_source = k == 1 && ins->opcode == OP_MOVP && !is_address(ins, 1);
+                if ((is_address(ins, k) || literal_destination || literal_source) && in_memory(optimizer, ins->operands[k])) {
+                    optimizer->variables[count++] = ins->operands[k];
+                }
+            }
+        }
+    }
+    qsort(optimizer->variables, count, sizeof(int32_t), compare_slots);
+
+    size_t unique_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (unique_count == 0 || optimizer->variables[unique_count-1] != optimizer->variables[i]) {
+            optimizer->variables[unique_count++] = optimizer->variables[i];
+        }
+    }
+    optimizer->variable_count = unique_count;
+    return 0;
+}
+
+
+static uint32_t phi_value(const Optimizer *optimizer, size_t block, size_t variable) {
+    return (uint32_t) (block * optimizer->variable_count + variable);
+}
+
+static Value* get_value(const Optimizer *optimizer, uint32_t id) {
+    return id < optimizer->phi_count ? NULL : &optimizer->values[id - optimizer->phi_count];
+}
+
+static bool get_constant(const Optimizer *optimizer, uint32_t id, int32_t *constant) {
+    const Value *value = get_value(optimizer, id);
+    if (!value || value->kind != VALUE_CONSTANT) {
+        return false;
+    }
+    *constant = value->constant;
+    return true;
+}
+
+static bool is_constant(const Optimizer *optimizer, uint32_t id, int32_t constant) {
+    int32_t value;
+    return get_constant(optimizer, id, &value) && value == constant;
+}
+
+// Returns true if the value is always 0 or 1.
+static bool is_boolean(const Optimizer *optimizer, uint32_t id) {
+    const Value *value = get_value(optimizer, id);
+    if (!value) {
+        return false;
+    }
+    if (value->kind == VALUE_CONSTANT) {
+        return value->constant == 0 || value->constant == 1;
+    }
+    return value->kind == VALUE_RESULT && (value->opcode == OP_LESS || value->opcode == OP_EQUAL || value->opcode == OP_NOT);
+}
+
+static int32_t value_home(const Optimizer *optimizer, uint32_t id) {
+    const Value *value = get_value(optimizer, id);
+    return value ? value->home : (int32_t) (id % optimizer->variable_count);
+}
+
+
+static uint32_t hash_value(const Value *value) {
+    uint32_t hash = value->kind * 31 + value->opcode;
+    hash = hash * 2654435761u + (uint32_t) value->constant;
+    hash = hash * 2654435761u + value->operands[0];
+    hash = hash * 2654435761u + value->operands[1];
+    return hash ^ (hash >> 15);
+}
+
+static bool same_value(const Value *a, const Value *b) {
+    return a->kind == b->kind && a->opcode == b->opcode && a->constant == b->constant
+        && a->operands[0] == b->operands[0] && a->operands[1] == b->operands[1];
+}
+
+static int grow_value_table(Optimizer *optimizer) {
+    size_t capacity = optimizer->value_table_capacity ? optimizer->value_table_capacity * 2 : 1024;
+    uint32_t *table = malloc(sizeof(uint32_t) * capacity);
+    if (!table) {
+        return -1;
+    }
+    memset(table, 0xff, sizeof(uint32_t) * capacity);
+    for (size_t i = 0; i < optimizer->value_table_capacity; i++) {
+        uint32_t id = optimizer->value_table[i];
+        if (id == NO_VALUE) {
+            continue;
+        }
+        size_t slot = hash_value(get_value(optimizer, id)) & (capacity-1);
+        while (table[slot] != NO_VALUE) {
+            slot = (slot+1) & (capacity-1);
+        }
+        table[slot] = id;
+    }
+    free(optimizer->value_table);
+    optimizer->value_table = table;
+    optimizer->value_table_capacity = capacity;
+    return 0;
+}
+
+// Add a value, returning its id or `NO_VALUE` if memory couldn't be allocated.
+static uint32_t add_value(Optimizer *optimizer, Value value) {
+    if (optimizer->value_count == optimizer->value_capacity) {
+        size_t capacity = optimizer->value_capacity ? optimizer->value_capacity * 2 : 1024;
+        if (optimizer->phi_count + capacity >= NO_VALUE) {
+            return NO_VALUE;
+        }
+        Value *values = realloc(optimizer->values, sizeof(Value) * capacity);
+        if (!values) {
+            return NO_VALUE;
+        }
+        optimizer->values = values;
+        optimizer->value_capacity = capacity;
+    }
+    optimizer->values[optimizer->value_count] = value;
+    return optimizer->phi_count + (uint32_t) optimizer->value_count++;
+}
+
+// Returns the id of an equal constant or result value, adding `value` if there isn't one.
+static uint32_t intern_value(Optimizer *optimizer, Value value) {
+    if ((optimizer->value_count+1) * 2 > optimizer->value_table_capacity && grow_value_table(optimizer) < 0) {
+        return NO_VALUE;
+    }
+    size_t mask = optimizer->value_table_capacity-1;
+    size_t slot = hash_value(&value) & mask;
+    while (optimizer->value_table[slot] != NO_VALUE) {
+        uint32_t id = optimizer->value_table[slot];
+        if (same_value(get_value(optimizer, id), &value)) {
+            return id;
+        }
+        slot = (slot+1) & mask;
+    }
+    uint32_t id = add_value(optimizer, value);
+    optimizer->value_table[slot] = id;
+    return id;
+}
+
+static uint32_t constant_value(Optimizer *optimizer, int32_t constant) {
+    return intern_value(optimizer, (Value) {VALUE_CONSTANT, 0, constant, {0, 0}, NO_SLOT});
+}
+
+static uint32_t unknown_value(Optimizer *optimizer, int32_t home) {
+    return add_value(optimizer, (Value) {VALUE_UNKNOWN, 0, 0, {0, 0}, home});
+}
+
+/*
+Returns the value of `opcode` on values `a` and `b`, after constant folding and simplification.
+This may be an existing value, in which case the instruction is a copy.
+*/
+static uint32_t expression_value(Optimizer *optimizer, byte opcode, uint32_t a, uint32_t b) {
+    int32_t constant_a = 0, constant_b = 0, result;
+    bool known_a = get_constant(optimizer, a, &constant_a);
+    bool known_b = b != NO_VALUE && get_constant(optimizer, b, &constant_b);
+    if (is_unary(opcode)) {
+        b = NO_VALUE;
+        known_b = true;
+        constant_b = 0;
+    }
+    if (known_a && known_b && fold(opcode, constant_a, constant_b, &result)) {
+        return constant_value(optimizer, result);
+    }
+
+    switch (opcode) {
+        case OP_ADD:
+            if (is_constant(optimizer, b, 0)) return a;
+            if (is_constant(optimizer, a, 0)) return b;
+            break;
+        case OP_SUB:
+            if (is_constant(optimizer, b, 0)) return a;
+            if (a == b) return constant_value(optimizer, 0);
+            break;
+        case OP_MUL:
+            if (is_constant(optimizer, a, 0) || is_constant(optimizer, b, 0)) return constant_value(optimizer, 0);
+            if (is_constant(optimizer, b, 1)) return a;
+            if (is_constant(optimizer, a, 1)) return b;
+            break;
+        case OP_DIV:
+            if (is_constant(optimizer, b, 1)) return a;
+            break;
+        case OP_MOD:
+            if (is_constant(optimizer, b, 1) || is_constant(optimizer, b, -1)) return constant_value(optimizer, 0);
+            break;
+        case OP_LESS:
+            if (a == b) return constant_value(optimizer, 0);
+            break;
+        case OP_EQUAL:
+            if (a == b) return constant_value(optimizer, 1);
+            break;
+        case OP_AND:
+            if (is_constant(optimizer, a, 0) || is_constant(optimizer, b, 0)) return constant_value(optimizer, 0);
+            if (is_constant(optimizer, b, -1) || a == b) return a;
+            if (is_constant(optimizer, a, -1)) return b;
+            break;
+        case OP_OR:
+            if (is_constant(optimizer, a, -1) || is_constant(optimizer, b, -1)) return constant_value(optimizer, -1);
+            if (is_constant(optimizer, b, 0) || a == b) return a;
+            if (is_constant(optimizer, a, 0)) return b;
+            break;
+        case OP_XOR:
+            if (is_constant(optimizer, b, 0)) return a;
+            if (is_constant(optimizer, a, 0)) return b;
+            if (a == b) return constant_value(optimizer, 0);
+            break;
+        case OP_SHL: case OP_SHR: case OP_SAR:
+            // Shifts only use the low five bits of the shift
+            if (known_b && (constant_b & 31) == 0) return a;
+            if (is_constant(optimizer, a, 0)) return a;
+            break;
+        case OP_MIN: case OP_MAX:
+            if (a == b) return a;
+            break;
+        case OP_ABS: {
+            const Value *inner = get_value(optimizer, a);
+            if (inner && inner->kind == VALUE_RESULT && inner->opcode == OP_ABS) {
+                return a;
+            }
+            break;
+        }
+        case OP_NOT: {
+            const Value *inner = get_value(optimizer, a);
+            if (inner && inner->kind == VALUE_RESULT && inner->opcode == OP_NOT && is_boolean(optimizer, inner->operands[0])) {
+                return inner->operands[0];
+            }
+            break;
+        }
+    }
+
+    if (is_commutative(opcode) && a > b) {
+        uint32_t swap = a;
+        a = b;
+        b = swap;
+    }
+    return intern_value(optimizer, (Value) {VALUE_RESULT, opcode, 0, {a, b}, NO_SLOT});
+}
+
+
+// Returns the value that variable `variable` holds at this point of the block being lifted, or `NO_VALUE` if it isn't known.
+static uint32_t current_value(const Optimizer *optimizer, int32_t variable) {
+    if (optimizer->current_generation[variable] == optimizer->generation) {
+        return optimizer->current[variable];
+    }
+    if (optimizer->generation == optimizer->block_generation) {
+        return phi_value(optimizer, optimizer->block, variable);
+    }
+    return NO_VALUE;
+}
+
+static void write_variable(Optimizer *optimizer, int32_t variable, uint32_t id) {
+    optimizer->current[variable] = id;
+    optimizer->current_generation[variable] = optimizer->generation;
+    Value *value = get_value(optimizer, id);
+    if (value && value->kind != VALUE_CONSTANT && value->home == NO_SLOT) {
+        value->home = variable;
+    }
+}
+
+static uint32_t read_variable(Optimizer *optimizer, int32_t variable) {
+    int32_t slot = optimizer->variables[variable];
+    if (slot >= FIRST_CONSTANT_SLOT && slot < FIRST_CONSTANT_SLOT + AMOUNT_CONSTANT_SLOTS && optimizer->constant_slots[slot - FIRST_CONSTANT_SLOT]) {
+        return constant_value(optimizer, optimizer->constant_values[slot - FIRST_CONSTANT_SLOT]);
+    }
+    uint32_t id = current_value(optimizer, variable);
+    if (id == NO_VALUE) {
+        id = unknown_value(optimizer, variable);
+        if (id != NO_VALUE) {
+            write_variable(optimizer, variable, id);
+        }
+    }
+    return id;
+}
+
+// Returns the slot that holds `id` at this point of the block being lifted, or `NO_SLOT`.
+static int32_t holder(const Optimizer *optimizer, uint32_t id) {
+    int32_t home = value_home(optimizer, id);
+    if (home == NO_SLOT || current_value(optimizer, home) != id) {
+        return NO_SLOT;
+    }
+    return optimizer->variables[home];
+}
+
+// Read argument `i` of `ins` into `ir`. Returns false if memory couldn't be allocated.
+static bool lift_argument(Optimizer *optimizer, const DecodedInstruction *ins, IrInstruction *ir, byte i) {
+    int32_t operand = ins->operands[i];
+    if (!is_address(ins, i)) {
+        ir->values[i] = constant_value(optimizer, operand);
+        return ir->values[i] != NO_VALUE;
+    }
+    ir->values[i] = read_variable(optimizer, variable_index(optimizer, operand));
+    int32_t slot = holder(optimizer, ir->values[i]);
+    ir->slots[i] = slot != NO_SLOT ? slot : operand;
+    return ir->values[i] != NO_VALUE;
+}
+
+// Lift the instructions of block `block_index` into SSA form. Returns -1 if memory couldn't be allocated.
+static int lift_block(Optimizer *optimizer, size_t block_index) {
+    Block *block = &optimizer->blocks[block_index];
+    optimizer->block = block_index;
+    optimizer->block_generation = ++optimizer->generation;
+    block->first_value = optimizer->phi_count + optimizer->value_count;
+    block->condition = NO_VALUE;
+
+    for (size_t i = 0; i < block->length; i++) {
+        const DecodedInstruction *ins = &block->code[i];
+        IrInstruction *ir = &optimizer->ir[ins - optimizer->code];
+        for (byte j = 0; j < MAX_ARGUMENTS; j++) {
+            ir->values[j] = NO_VALUE;
+            ir->slots[j] = NO_SLOT;
+        }
+        ir->result = ir->previous = NO_VALUE;
+        ir->copy_slot = NO_SLOT;
+        ir->effects = 0;
+
+        if (is_barrier(optimizer, ins)) {
+            ir->effects = EFFECT_BARRIER;
+            optimizer->generation++;
+            continue;
+        }
+
+        uint32_t first_new_value = optimizer->phi_count + optimizer->value_count;
+        bool stores = writes_destination(ins->opcode);
+        byte argument_count = decoded_argument_count(ins->opcode);
+        for (byte j = 0; j < argument_count; j++) {
+            bool literal_destination = j == 0 && stores && !is_address(ins, 0);
+            bool literal_source = j == 1 && ins->opcode == OP_MOVP && !is_address(ins, 1);
+            if (!literal_destination && !literal_source && !lift_argument(optimizer, ins, ir, j)) {
+                return -1;
+            }
+        }
+
+        uint32_t result = NO_VALUE;
+        if (ins->opcode == OP_MOV) {
+            result = ir->values[1];
+        }
+        else if (ins->opcode == OP_MOVP && !is_address(ins, 1)) {
+            result = read_variable(optimizer, variable_index(optimizer, ins->operands[1]));
+        }
+        else if (ins->opcode == OP_MOVP || ins->opcode == OP_GETP) {
+            result = unknown_value(optimizer, NO_SLOT);
+            ir->effects |= ins->opcode == OP_MOVP ? EFFECT_READS_MEMORY : 0;
+        }
+        else if (is_arithmetic(ins->opcode)) {
+            result = expression_value(optimizer, ins->opcode, ir->values[1], ir->values[2]);
+        }
+        else if (ins->opcode == OP_JMP) {
+            block->condition = ir->values[1];
+            ir->effects |= is_address(ins, 0) ? EFFECT_READS_MEMORY : 0;
+        }
+        if (stores && result == NO_VALUE) {
+            return -1;
+        }
+
+        if (!stores) {
+            continue;
+        }
+        if (is_address(ins, 0)) {
+            ir->effects |= EFFECT_CLOBBERS;
+            optimizer->generation++;
+            continue;
+        }
+        int32_t destination = variable_index(optimizer, ins->operands[0]);
+        ir->result = result;
+        ir->previous = current_value(optimizer, destination);
+        if (result < first_new_value) {
+            ir->copy_slot = holder(optimizer, result);
+        }
+        write_variable(optimizer, destination, result);
+    }
+
+    block->end_value = optimizer->phi_count + optimizer->value_count;
+    for (size_t i = 0; i < optimizer->variable_count; i++) {
+        uint32_t id = current_value(optimizer, i);
+        optimizer->exits[block_index * optimizer->variable_count + i] = id != NO_VALUE ? id : optimizer->unknown_value;
+    }
+    return 0;
+}
+
+
+static LatticeValue lattice_join(LatticeValue a, LatticeValue b) {
+    if (a.state == LATTICE_UNDEFINED) {
+        return b;
+    }
+    if (b.state == LATTICE_UNDEFINED) {
+        return a;
+    }
+    if (a.state == LATTICE_CONSTANT && b.state == LATTICE_CONSTANT && a.constant == b.constant) {
+        return a;
+    }
+    return (LatticeValue) {LATTICE_VARYING, 0};
+}
+
+static LatticeValue evaluate_value(const Optimizer *optimizer, const Value *value) {
+    if (value->kind == VALUE_CONSTANT) {
+        return (LatticeValue) {LATTICE_CONSTANT, value->constant};
+    }
+    if (value->kind == VALUE_UNKNOWN) {
+        return (LatticeValue) {LATTICE_VARYING, 0};
+    }
+    LatticeValue a = optimizer->lattice[value->operands[0]];
+    LatticeValue b = is_unary(value->opcode) ? (LatticeValue) {LATTICE_CONSTANT, 0} : optimizer->lattice[value->operands[1]];
+    if (a.state == LATTICE_UNDEFINED || b.state == LATTICE_UNDEFINED) {
+        return (LatticeValue) {LATTICE_UNDEFINED, 0};
+    }
+    if (value->opcode == OP_MUL && ((a.state == LATTICE_CONSTANT && a.constant == 0) || (b.state == LATTICE_CONSTANT && b.constant == 0))) {
+        return (LatticeValue) {LATTICE_CONSTANT, 0};
+    }
+    int32_t result;
+    if (a.state == LATTICE_CONSTANT && b.state == LATTICE_CONSTANT && fold(value->opcode, a.constant, b.constant, &result)) {
+        return (LatticeValue) {LATTICE_CONSTANT, result};
+    }
+    return (LatticeValue) {LATTICE_VARYING, 0};
+}
+
+static bool lattice_update(LatticeValue *dest, LatticeValue value) {
+    if (dest->state == value.state && dest->constant == value.constant) {
+        return false;
+    }
+    *dest = value;
+    return true;
+}
+
+static bool ends_with_jump(const Block *block) {
+    return block->length > 0 && block->code[block->length-1].opcode == OP_JMP;
+}
+
+static void queue_block(Optimizer *optimizer, size_t *worklist, size_t *worklist_length, size_t block) {
+    if (block >= optimizer->block_count || optimizer->blocks[block].queued) {
+        return;
+    }
+    optimizer->blocks[block].queued = true;
+    worklist[(*worklist_length)++] = block;
+}
+
+/*
+Sparse conditional constant propagation. Finds the values that are constant wherever they're used,
+and the blocks and jumps that can run when starting from the entry blocks.
+*/
+static int propagate_constants(Optimizer *optimizer) {
+    size_t *worklist = malloc(sizeof(size_t) * (optimizer->block_count > 0 ? optimizer->block_count : 1));
+    if (!worklist) {
+        return -1;
+    }
+    size_t worklist_length = 0;
+    size_t variable_count = optimizer->variable_count;
+
+    for (size_t i = 0; i < optimizer->phi_count; i++) {
+        optimizer->lattice[i] = (LatticeValue) {LATTICE_UNDEFINED, 0};
+    }
+    for (size_t i = 0; i < optimizer->value_count; i++) {
+        const Value *value = &optimizer->values[i];
+        LatticeValue *lattice = &optimizer->lattice[optimizer->phi_count + i];
+        *lattice = value->kind == VALUE_RESULT ? (LatticeValue) {LATTICE_UNDEFINED, 0} : evaluate_value(optimizer, value);
+    }
+    for (size_t i = 0; i < optimizer->block_count; i++) {
+        Block *block = &optimizer->blocks[i];
+        block->taken_feasible = block->next_feasible = block->visited = block->queued = false;
+        if (block->entry && block->reachable) {
+            for (size_t j = 0; j < variable_count; j++) {
+                optimizer->lattice[phi_value(optimizer, i, j)] = (LatticeValue) {LATTICE_VARYING, 0};
+            }
+            queue_block(optimizer, worklist, &worklist_length, i);
+        }
+    }
+
+    while (worklist_length > 0) {
+        size_t block_index = worklist[--worklist_length];
+        Block *block = &optimizer->blocks[block_index];
+        block->queued = false;
+        bool changed = !block->visited;
+        block->visited = true;
+
+        if (!block->entry) {
+            for (size_t i = 0; i < variable_count; i++) {
+                LatticeValue joined = {LATTICE_UNDEFINED, 0};
+                for (size_t j = optimizer->predecessor_starts[block_index]; j < optimizer->predecessor_starts[block_index+1]; j++) {
+                    const Block *predecessor = &optimizer->blocks[optimizer->predecessors[j]];
+                    if ((predecessor->taken == block_index && predecessor->taken_feasible) || (predecessor->next == block_index && predecessor->next_feasible)) {
+                        joined = lattice_join(joined, optimizer->lattice[optimizer->exits[optimizer->predecessors[j] * variable_count + i]]);
+                    }
+                }
+                changed |= lattice_update(&optimizer->lattice[phi_value(optimizer, block_index, i)], joined);
+            }
+        }
+        for (uint32_t id = block->first_value; id < block->end_value; id++) {
+            const Value *value = get_value(optimizer, id);
+            if (value->kind == VALUE_RESULT) {
+                changed |= lattice_update(&optimizer->lattice[id], evaluate_value(optimizer, value));
+            }
+        }
+
+        bool take = false, fall = true;
+        if (ends_with_jump(block) && block->condition == NO_VALUE) {
+            take = true;
+        }
+        else if (ends_with_jump(block)) {
+            LatticeValue condition = optimizer->lattice[block->condition];
+            take = condition.state == LATTICE_VARYING || (condition.state == LATTICE_CONSTANT && condition.constant != 0);
+            fall = condition.state == LATTICE_VARYING || (condition.state == LATTICE_CONSTANT && condition.constant == 0);
+        }
+        bool newly_taken = take && !block->taken_feasible;
+        bool newly_next = fall && !block->next_feasible;
+        block->taken_feasible |= take;
+        block->next_feasible |= fall;
+        if (take && (changed || newly_taken)) {
+            queue_block(optimizer, worklist, &worklist_length, block->taken);
+        }
+        if (fall && (changed || newly_next)) {
+            queue_block(optimizer, worklist, &worklist_length, block->next);
+        }
+    }
+
+    // Anything still undefined is in code that can't run, or in a loop that no value enters
+    for (size_t i = 0; i < optimizer->phi_count + optimizer->value_count; i++) {
+        if (optimizer->lattice[i].state == LATTICE_UNDEFINED) {
+            optimizer->lattice[i].state = LATTICE_VARYING;
+        }
+    }
+    free(worklist);
+    return 0;
+}
+
+
+static bool known_constant(const Optimizer *optimizer, uint32_t id, int32_t *constant) {
+    if (id == NO_VALUE || optimizer->lattice[id].state != LATTICE_CONSTANT) {
+        return false;
+    }
+    *constant = optimizer->lattice[id].constant;
+    return true;
+}
+
+// Rewrite argument `i` of `ins` to a literal if its value is known, or to the slot that holds it.
+static void rewrite_argument(const Optimizer *optimizer, DecodedInstruction *ins, const IrInstruction *ir, byte i) {
+    if (!is_address(ins, i)) {
+        return;
+    }
+    int32_t constant;
+    if (known_constant(optimizer, ir->values[i], &constant)) {
+        ins->operands[i] = constant;
+        ins->modes &= ~(1 << i);
+    }
+    else {
+        ins->operands[i] = ir->slots[i];
+    }
+}
+
+// Returns the rewritten instruction, or false if it can be removed.
+static bool rewrite_instruction(Optimizer *optimizer, Block *block, DecodedInstruction *ins, const IrInstruction *ir) {
+    if (ir->effects & EFFECT_BARRIER) {
+        return true;
+    }
+    int32_t constant;
+
+    if (ins->opcode == OP_JMP) {
+        if (known_constant(optimizer, ir->values[1], &constant)) {
+            if (constant == 0) {
+                block->taken = NO_BLOCK;
+                return false;
+            }
+            ins->operands[1] = 1;
+            ins->modes &= ~2;
+            block->next = NO_BLOCK;
+        }
+        else if (is_address(ins, 1)) {
+            ins->operands[1] = ir->slots[1];
+        }
+        if (is_address(ins, 0)) {
+            ins->operands[0] = ir->slots[0];
+        }
+        return true;
+    }
+
+    if (!writes_destination(ins->opcode)) {
+        byte argument_count = decoded_argument_count(ins->opcode);
+        for (byte i = 0; i < argument_count; i++) {
+            rewrite_argument(optimizer, ins, ir, i);
+        }
+        return true;
+    }
+
+    // Indirect stores through a known pointer store to that slot directly
+    DecodedInstruction destination = *ins;
+    if (is_address(ins, 0)) {
+        if (known_constant(optimizer, ir->values[0], &constant) && in_memory(optimizer, constant)) {
+            destination.operands[0] = constant;
+            destination.modes &= ~1;
+        }
+        else {
+            destination.operands[0] = ir->slots[0];
+        }
+    }
+
+    DecodedInstruction rewritten = {OP_MOV, destination.modes & 1, SUPER_NONE, IDIOM_NONE, false, false, {destination.operands[0], 0, 0, 0}};
+    if (known_constant(optimizer, ir->result, &constant)) {
+        rewritten.operands[1] = constant;
+    }
+    else if (ir->copy_slot != NO_SLOT) {
+        rewritten.operands[1] = ir->copy_slot;
+        rewritten.modes |= 2;
+    }
+    else if (ins->opcode == OP_MOVP && is_address(ins, 1) && known_constant(optimizer, ir->values[1], &constant) && in_memory(optimizer, constant)) {
+        rewritten.operands[1] = constant;
+        rewritten.modes |= 2;
+    }
+    else {
+        rewritten = destination;
+        byte argument_count = decoded_argument_count(ins->opcode);
+        for (byte i = 1; i < argument_count; i++) {
+            if (!(ins->opcode == OP_MOVP && !is_address(ins, 1))) {
+                rewrite_argument(optimizer, &rewritten, ir, i);
+            }
+        }
+
+        // Strength reduce division by a power of two
+        int32_t shift = (rewritten.opcode == OP_DIV || rewritten.opcode == OP_MOD) && !is_address(&rewritten, 2) ? power_of_two_shift(rewritten.operands[2]) : 0;
+        if (shift > 0) {
+            rewritten.operands[2] = rewritten.opcode == OP_DIV ? shift : rewritten.operands[2] - 1;
+            rewritten.opcode = rewritten.opcode == OP_DIV ? OP_DIV_POW2 : OP_MOD_POW2;
+        }
+    }
+
+    // Stores of the value a slot already holds do nothing
+    int32_t previous_constant;
+    bool same_constant = known_constant(optimizer, ir->result, &constant) && known_constant(optimizer, ir->previous, &previous_constant) && constant == previous_constant;
+    bool stores_held_value = ir->result != NO_VALUE && (ir->result == ir->previous || same_constant);
+    if (stores_held_value && is_removable(optimizer, &rewritten)) {
+        return false;
+    }
+    *ins = rewritten;
+    return true;
+}
+
+static void rewrite_block(Optimizer *optimizer, Block *block) {
+    size_t length = 0;
+    for (size_t i = 0; i < block->length; i++) {
+        DecodedInstruction ins = block->code[i];
+        const IrInstruction *ir = &optimizer->ir[&block->code[i] - optimizer->code];
+        bool kept = rewrite_instruction(optimizer, block, &ins, ir);
+        bool same = kept && ins.opcode == block->code[i].opcode && ins.modes == block->code[i].modes
+            && !memcmp(ins.operands, block->code[i].operands, sizeof(ins.operands));
+        optimizer->changed |= !same;
+        if (kept) {
+            block->code[length++] = ins;
+        }
+    }
+    block->length = length;
+}
+
+
+static void set_all(uint64_t *set, size_t words) {
+    memset(set, 0xff, sizeof(uint64_t) * words);
+}
+
+static void set_bit(uint64_t *set, int32_t variable, bool value) {
+    if (variable < 0) {
+        return;
+    }
+    if (value) {
+        set[variable / 64] |= (uint64_t) 1 << (variable % 64);
+    }
+    else {
+        set[variable / 64] &= ~((uint64_t) 1 << (variable % 64));
+    }
+}
+
+static bool get_bit(const uint64_t *set, int32_t variable) {
+    return variable >= 0 && (set[variable / 64] >> (variable % 64)) & 1;
+}
+
+/*
+Apply `ins` to the set of live variables, going backwards.
+If `remove` is set, stores that nothing reads are removed instead. Returns true if `ins` was removed.
+*/
+static bool transfer_liveness(const Optimizer *optimizer, uint64_t *live, size_t words, const DecodedInstruction *ins, bool remove) {
+    if (is_barrier(optimizer, ins)) {
+        set_all(live, words);
+        return false;
+    }
+    bool stores = writes_destination(ins->opcode);
+    if (stores && !is_address(ins, 0)) {
+        int32_t destination = variable_index(optimizer, ins->operands[0]);
+        if (remove && destination >= 0 && !get_bit(live, destination) && is_removable(optimizer, ins)) {
+            return true;
+        }
+        set_bit(live, destination, false);
+    }
+    if ((ins->opcode == OP_MOVP && is_address(ins, 1)) || (ins->opcode == OP_JMP && is_address(ins, 0))) {
+        set_all(live, words);
+    }
+    if (ins->opcode == OP_MOVP && !is_address(ins, 1)) {
+        set_bit(live, variable_index(optimizer, ins->operands[1]), true);
+    }
+    byte argument_count = decoded_argument_count(ins->opcode);
+    for (byte i = 0; i < argument_count; i++) {
+        if (is_address(ins, i)) {
+            set_bit(live, variable_index(optimizer, ins->operands[i]), true);
+        }
+    }
+    return false;
+}
+
+// Returns true if the block can continue at `next`.
+static bool can_fall_through(const Block *block) {
+    if (!ends_with_jump(block)) {
+        return true;
+    }
+    const DecodedInstruction *jump = &block->code[block->length-1];
+    return is_address(jump, 1) || jump->operands[1] == 0;
+}
+
+// Returns true if the block can continue at `taken`.
+static bool can_take(const Block *block) {
+    if (!ends_with_jump(block)) {
+        return false;
+    }
+    const DecodedInstruction *jump = &block->code[block->length-1];
+    return !is_address(jump, 0) && (is_address(jump, 1) || jump->operands[1] != 0);
+}
+
+// Join the live variables of the successors of `block` into `live`.
+static void live_out(const Optimizer *optimizer, const uint64_t *live_in, uint64_t *live, size_t words, const Block *block) {
+    memset(live, 0, sizeof(uint64_t) * words);
+    size_t successors[2] = {can_take(block) ? block->taken : NO_BLOCK, can_fall_through(block) ? block->next : NO_BLOCK};
+    for (int i = 0; i < 2; i++) {
+        if (successors[i] == HALT_BLOCK) {
+            set_all(live, words);
+        }
+        else if (successors[i] != NO_BLOCK) {
+            for (size_t j = 0; j < words; j++) {
+                live[j] |= live_in[successors[i] * words + j];
+            }
+        }
+    }
+}
+
+// Remove stores that are overwritten before anything reads them.
+static int eliminate_dead_stores(Optimizer *optimizer) {
+    size_t words = (optimizer->variable_count + 63) / 64;
+    words = words > 0 ? words : 1;
+    uint64_t *live_in = calloc(optimizer->block_count * words, sizeof(uint64_t));
+    uint64_t *live = malloc(sizeof(uint64_t) * words);
+    if (!live_in || !live) {
+        free(live_in);
+        free(live);
+        return -1;
+    }
+
+    bool removed = true;
+    while (removed) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t i = optimizer->block_count; i-- > 0;) {
+                const Block *block = &optimizer->blocks[i];
+                if (!block->reachable) {
+                    continue;
+                }
+                live_out(optimizer, live_in, live, words, block);
+                for (size_t j = block->length; j-- > 0;) {
+                    transfer_liveness(optimizer, live, words, &block->code[j], false);
+                }
+                if (memcmp(live, &live_in[i * words], sizeof(uint64_t) * words)) {
+                    memcpy(&live_in[i * words], live, sizeof(uint64_t) * words);
+                    changed = true;
+                }
+            }
+        }
+
+        removed = false;
+        for (size_t i = 0; i < optimizer->block_count; i++) {
+            Block *block = &optimizer->blocks[i];
+            if (!block->reachable) {
+                continue;
+            }
+            live_out(optimizer, live_in, live, words, block);
+            size_t kept = block->length;
+            for (size_t j = block->length; j-- > 0;) {
+                if (transfer_liveness(optimizer, live, words, &block->code[j], true)) {
+                    block->code[j].opcode = OP_HALT;  // Marks the instruction for removal
+                    kept--;
+                }
+            }
+            if (kept != block->length) {
+                size_t length = 0;
+                for (size_t j = 0; j < block->length; j++) {
+                    if (block->code[j].opcode != OP_HALT) {
+                        block->code[length++] = block->code[j];
+                    }
+                }
+                block->length = length;
+                removed = optimizer->changed = true;
+            }
+        }
+    }
+
+    free(live_in);
+    free(live);
+    return 0;
+}
+
+
+// Record the predecessors of every block.
+static int link_blocks(Optimizer *optimizer) {
+    size_t block_count = optimizer->block_count;
+    free(optimizer->predecessor_starts);
+    free(optimizer->predecessors);
+    optimizer->predecessor_starts = calloc(block_count+1, sizeof(size_t));
+    optimizer->predecessors = malloc(sizeof(size_t) * (block_count*2 + 1));
+    if (!optimizer->predecessor_starts || !optimizer->predecessors) {
+        return -1;
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        size_t *counts = optimizer->predecessor_starts;
+        for (size_t i = 0; i < block_count; i++) {
+            const Block *block = &optimizer->blocks[i];
+            size_t successors[2] = {can_take(block) ? block->taken : NO_BLOCK, can_fall_through(block) ? block->next : NO_BLOCK};
+            for (int j = 0; j < 2; j++) {
+                if (!block->reachable || successors[j] >= block_count || (j == 1 && successors[1] == successors[0])) {
+                    continue;
+                }
+                if (pass == 0) {
+                    counts[successors[j]+1]++;
+                }
+                else {
+                    optimizer->predecessors[counts[successors[j]]++] = i;
+                }
+            }
+        }
+        if (pass == 0) {
+            for (size_t i = 0; i < block_count; i++) {
+                counts[i+1] += counts[i];
+            }
+        }
+        else {
+            for (size_t i = block_count; i > 0; i--) {
+                counts[i] = counts[i-1];
+            }
+            counts[0] = 0;
+        }
+    }
+    return 0;
+}
+
+// Run every pass once. Returns -1 if the program is too large or memory couldn't be allocated.
+static int run_round(Optimizer *optimizer) {
+    if (collect_variables(optimizer) < 0 || link_blocks(optimizer) < 0) {
+        return -1;
+    }
+    size_t variable_count = optimizer->variable_count > 0 ? optimizer->variable_count : 1;
+    if (optimizer->block_count > MAX_PHI_VALUES / variable_count) {
+        return -1;
+    }
+    optimizer->phi_count = (uint32_t) (optimizer->block_count * optimizer->variable_count);
+    optimizer->value_count = 0;
+    free(optimizer->value_table);
+    optimizer->value_table = NULL;
+    optimizer->value_table_capacity = 0;
+
+    free(optimizer->exits);
+    free(optimizer->current);
+    free(optimizer->current_generation);
+    optimizer->exits = malloc(sizeof(uint32_t) * optimizer->block_count * variable_count);
+    optimizer->current = malloc(sizeof(uint32_t) * variable_count);
+    optimizer->current_generation = calloc(variable_count, sizeof(uint32_t));
+    optimizer->generation = 0;
+    optimizer->unknown_value = unknown_value(optimizer, NO_SLOT);
+    if (!optimizer->exits || !optimizer->current || !optimizer->current_generation || optimizer->unknown_value == NO_VALUE) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < optimizer->block_count; i++) {
+        if (optimizer->blocks[i].reachable && lift_block(optimizer, i) < 0) {
+            return -1;
+        }
+    }
+
+    free(optimizer->lattice);
+    optimizer->lattice = malloc(sizeof(LatticeValue) * (optimizer->phi_count + optimizer->value_count));
+    if (!optimizer->lattice || propagate_constants(optimizer) < 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < optimizer->block_count; i++) {
+        Block *block = &optimizer->blocks[i];
+        if (!block->reachable) {
+            continue;
+        }
+        if (!block->visited) {
+            block->reachable = false;
+            optimizer->changed = true;
+            continue;
+        }
+        rewrite_block(optimizer, block);
+    }
+    return eliminate_dead_stores(optimizer);
+}
+
+
+/*
+Split the program into blocks. A block starts at every entrypoint, every literal jump target and after every jump.
+Blocks that start where computed jumps are expected to land are entry blocks, like the entrypoints.
+*/
+static int find_blocks(Optimizer *optimizer, const DecodedInstruction *instructions) {
+    size_t instruction_count = optimizer->instruction_count;
+    const ProgramInfo *program_info = optimizer->program_info;
+
+    bool *entries = calloc(instruction_count+1, sizeof(bool));
+    bool *starts_block = calloc(instruction_count+1, sizeof(bool));
+    size_t *block_ids = malloc(sizeof(size_t) * (instruction_count+1));
+    if (!entries || !starts_block || !block_ids) {
+        free(entries);
+        free(starts_block);
+        free(block_ids);
+        return -1;
+    }
+
+    // Computed jumps are expected to target the labels that the program moves into memory, like the verifier expects
+    bool has_computed_jump = false;
+    for (size_t i = 0; i < instruction_count; i++) {
+        has_computed_jump |= instructions[i].opcode == OP_JMP && is_address(&instructions[i], 0);
+    }
+    for (size_t i = 0; i < instruction_count && has_computed_jump; i++) {
+        const DecodedInstruction *ins = &instructions[i];
+        if (ins->opcode == OP_MOV && !is_address(ins, 1) && (uint32_t) ins->operands[1] < instruction_count) {
+            entries[ins->operands[1]] = true;
+        }
+    }
+    if ((uint32_t) program_info->start_index < instruction_count) {
+        entries[program_info->start_index] = true;
+    }
+    if ((uint32_t) program_info->tick_index < instruction_count) {
+        entries[program_info->tick_index] = true;
+    }
+
+    // Returns land after their calls, and calls are left to jump to the original instructions
+    for (size_t i = 0; i < instruction_count; i++) {
+        const DecodedInstruction *ins = &instructions[i];
+        if (ins->opcode == OP_CALL) {
+            entries[i+1] = true;
+            if (!is_address(ins, 0)) {
+                entries[ins->operands[0]] = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < instruction_count; i++) {
+        const DecodedInstruction *ins = &instructions[i];
+        starts_block[i] |= i == 0 || entries[i];
+        if (ins->opcode == OP_JMP || ins->opcode == OP_CALL || ins->opcode == OP_RET) {
+            starts_block[i+1] = true;
+            if (ins->opcode == OP_JMP && !is_address(ins, 0)) {
+                starts_block[ins->operands[0]] = true;
+            }
+        }
+    }
+
+    size_t block_count = 0;
+    for (size_t i = 0; i < instruction_count; i++) {
+        block_count += starts_block[i];
+    }
+    optimizer->blocks = calloc(block_count > 0 ? block_count : 1, sizeof(Block));
+    if (!optimizer->blocks) {
+        free(entries);
+        free(starts_block);
+        free(block_ids);
+        return -1;
+    }
+    optimizer->block_count = block_count;
+
+    size_t block_index = 0;
+    for (size_t i = 0; i < instruction_count; i++) {
+        if (starts_block[i]) {
+            Block *block = &optimizer->blocks[block_index];
+            block->code = &optimizer->code[i];
+            block->source_index = i;
+            block->entry = entries[i];
+            block->reachable = true;
+            block_ids[i] = block_index++;
+        }
+        optimizer->blocks[block_index-1].length++;
+    }
+    block_ids[instruction_count] = HALT_BLOCK;
+
+    for (size_t i = 0; i < block_count; i++) {
+        Block *block = &optimizer->blocks[i];
+        size_t end = block->source_index + block->length;
+        block->next = end < instruction_count ? block_ids[end] : HALT_BLOCK;
+        if (block->code[block->length-1].opcode == OP_CALL || block->code[block->length-1].opcode == OP_RET) {
+            block->next = NO_BLOCK;
+        }
+        block->taken = NO_BLOCK;
+        if (ends_with_jump(block) && !is_address(&block->code[block->length-1], 0)) {
+            block->taken = block_ids[block->code[block->length-1].operands[0]];
+        }
+    }
+
+    free(entries);
+    free(starts_block);
+    free(block_ids);
+    return 0;
+}
+
+/*
+Build the optimized program: the original instructions and halt instruction, then the reachable blocks in their
+original order and another halt instruction. Entry blocks in the original instructions jump to their optimized code.
+*/
+static DecodedInstruction* lower_blocks(Optimizer *optimizer, DecodedInstruction *instructions, size_t *decoded_count) {
+    size_t instruction_count = optimizer->instruction_count;
+    size_t count = instruction_count + 1;
+    for (size_t i = 0; i < optimizer->block_count; i++) {
+        Block *block = &optimizer->blocks[i];
+        block->output_index = count;
+        count += block->reachable ? block->length : 0;
+    }
+
+    DecodedInstruction *output = realloc(instructions, sizeof(DecodedInstruction) * (count+1));
+    if (!output) {
+        return NULL;
+    }
+    DecodedInstruction halt = output[instruction_count];
+    for (size_t i = 0; i < optimizer->block_count; i++) {
+        const Block *block = &optimizer->blocks[i];
+        if (!block->reachable) {
+            continue;
+        }
+        for (size_t j = 0; j < block->length; j++) {
+            DecodedInstruction *ins = &output[block->output_index + j];
+            *ins = block->code[j];
+            ins->superinstruction = SUPER_NONE;
+            ins->idiom = IDIOM_NONE;
+            ins->verified = false;
+            ins->entry_point = false;
+            if (ins->opcode == OP_JMP && !is_address(ins, 0)) {
+                ins->operands[0] = block->taken == HALT_BLOCK ? instruction_count : optimizer->blocks[block->taken].output_index;
+            }
+        }
+    }
+    output[count] = halt;
+
+    for (size_t i = 0; i < optimizer->block_count; i++) {
+        const Block *block = &optimizer->blocks[i];
+        if (block->entry && block->reachable) {
+            output[block->output_index].entry_point = true;
+            output[block->source_index] = (DecodedInstruction) {OP_JMP, 0, SUPER_NONE, IDIOM_NONE, false, true, {(int32_t) block->output_index, 1, 0, 0}};
+        }
+    }
+    *decoded_count = count+1;
+    return output;
+}
+
+
+/*
+Find the reserved slots that hold constants, which are the ones the program never stores to.
+A program that stores through a pointer or with `memfill` or `memcopy` may store to any slot, so none of them are constant.
+*/
+static void find_constant_slots(Optimizer *optimizer, const DecodedInstruction *instructions) {
+    const ProgramInfo *program_info = optimizer->program_info;
+    int32_t values[AMOUNT_CONSTANT_SLOTS] = {program_info->memory_size, program_info->width, program_info->height, program_info->tickrate};
+    for (int i = 0; i < AMOUNT_CONSTANT_SLOTS; i++) {
+        optimizer->constant_values[i] = values[i];
+        optimizer->constant_slots[i] = in_memory(optimizer, FIRST_CONSTANT_SLOT + i);
+    }
+    for (size_t i = 0; i < optimizer->instruction_count; i++) {
+        const DecodedInstruction *ins = &instructions[i];
+        bool stores = writes_destination(ins->opcode);
+        if ((stores && is_address(ins, 0)) || ins->opcode == OP_MEMFILL || ins->opcode == OP_MEMCOPY) {
+            memset(optimizer->constant_slots, 0, sizeof(optimizer->constant_slots));
+            return;
+        }
+        int32_t slot = ins->operands[0] - FIRST_CONSTANT_SLOT;
+        if (stores && slot >= 0 && slot < AMOUNT_CONSTANT_SLOTS) {
+            optimizer->constant_slots[slot] = false;
+        }
+    }
+}
+
+
+DecodedInstruction* optimize_instructions(DecodedInstruction *instructions, size_t instruction_count, const ProgramInfo *program_info, size_t *decoded_count) {
+    *decoded_count = instruction_count+1;
+    if (instruction_count == 0 || program_info->memory_size <= 0) {
+        return instructions;
+    }
+
+    Optimizer optimizer = {0};
+    optimizer.program_info = program_info;
+    optimizer.instruction_count = instruction_count;
+    optimizer.code = malloc(sizeof(DecodedInstruction) * instruction_count);
+    optimizer.ir = malloc(sizeof(IrInstruction) * instruction_count);
+
+    DecodedInstruction *output = NULL;
+    if (optimizer.code && optimizer.ir) {
+        memcpy(optimizer.code, instructions, sizeof(DecodedInstruction) * instruction_count);
+        find_constant_slots(&optimizer, instructions);
+        int response = find_blocks(&optimizer, instructions);
+        for (int i = 0; i < OPTIMIZATION_ROUNDS && response == 0; i++) {
+            response = run_round(&optimizer);
+        }
+        if (response == 0 && optimizer.changed) {
+            output = lower_blocks(&optimizer, instructions, decoded_count);
+        }
+    }
+
+    free(optimizer.code);
+    free(optimizer.ir);
+    free(optimizer.blocks);
+    free(optimizer.predecessors);
+    free(optimizer.predecessor_starts);
+    free(optimizer.variables);
+    free(optimizer.values);
+    free(optimizer.value_table);
+    free(optimizer.exits);
+    free(optimizer.lattice);
+    free(optimizer.current);
+    free(optimizer.current_generation);
+    return output ? output : instructions;
+}
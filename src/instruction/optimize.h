@@ -0,0 +1,24 @@
+/*
+    Load-time optimization of decoded programs.
+*/
+
+#ifndef OPTIMIZE_HEADER
+#define OPTIMIZE_HEADER
+
+#include "decode.h"
+
+
+/*
+Optimize a decoded program, before superinstructions are fused.
+
+`instructions` holds `instruction_count` instructions followed by the halt instruction. The original instructions are
+kept at their indices, since computed jumps read them from memory, and the optimized code is appended after the halt
+instruction. The blocks that the entrypoints and computed jumps are expected to reach are replaced with jumps into the
+optimized code, and have `entry_point` set.
+
+Returns the new array and sets `decoded_count` to its length. If nothing could be optimized, `instructions` is
+returned as it was and `decoded_count` is set to `instruction_count+1`.
+*/
+DecodedInstruction* optimize_instructions(DecodedInstruction *instructions, size_t instruction_count, const ProgramInfo *program_info, size_t *decoded_count);
+
+#endif
@@ -0,0 +1,149 @@
+/*
+    Profiling of the instruction sequences run by the interpreter.
+    Only compiled in with `ENABLE_G1_PROFILING`.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "instruction.h"
+#include "decode.h"
+#include "threaded.h"
+#include "profile.h"
+
+#define PROFILE_TABLE_SIZE 16384
+#define PROFILE_REPORT_SIZE 24
+#define PROFILE_MAX_SEQUENCE_LENGTH 3
+
+
+typedef struct {
+    uint64_t key;
+    uint64_t count;
+} SequenceCount;
+
+
+static SequenceCount sequence_counts[PROFILE_TABLE_SIZE];
+static uint64_t instructions_run = 0;
+static const ThreadedInfo *previous[PROFILE_MAX_SEQUENCE_LENGTH-1] = {NULL};
+
+
+// A sequence key packs the opcode and addressing modes of each instruction into 16 bits.
+static uint64_t sequence_key(const ThreadedInfo **sequence, size_t length) {
+    uint64_t key = 0;
+    for (size_t i = 0; i < length; i++) {
+        key = (key << 16) | ((uint64_t) threaded_opcode(sequence[i]) << 4) | threaded_modes(sequence[i]);
+    }
+    return (key << 2) | length;
+}
+
+
+static void count_sequence(uint64_t key) {
+    size_t index = (key * 0x9E3779B97F4A7C15ULL) >> 50;
+    for (size_t i = 0; i < PROFILE_TABLE_SIZE; i++) {
+        SequenceCount *entry = &sequence_counts[(index + i) % PROFILE_TABLE_SIZE];
+        if (entry->count == 0 || entry->key == key) {
+            entry->key = key;
+            entry->count++;
+            return;
+        }
+    }
+}
+
+
+void profile_record(const ThreadedInfo *instruction) {
+    if (!instruction) {
+        memset(previous, 0, sizeof(previous));
+        return;
+    }
+    instructions_run++;
+
+    // Only count sequences of instructions that were run back to back
+    const ThreadedInfo *sequence[PROFILE_MAX_SEQUENCE_LENGTH];
+    size_t length = 1;
+    sequence[PROFILE_MAX_SEQUENCE_LENGTH-1] = instruction;
+    while (length < PROFILE_MAX_SEQUENCE_LENGTH) {
+        const ThreadedInfo *before = previous[PROFILE_MAX_SEQUENCE_LENGTH-1-length];
+        if (before != sequence[PROFILE_MAX_SEQUENCE_LENGTH-length]-1) {
+            break;
+        }
+        sequence[PROFILE_MAX_SEQUENCE_LENGTH-1-length] = before;
+        length++;
+        count_sequence(sequence_key(&sequence[PROFILE_MAX_SEQUENCE_LENGTH-length], length));
+    }
+
+    memmove(previous, previous+1, sizeof(previous) - sizeof(previous[0]));
+    previous[PROFILE_MAX_SEQUENCE_LENGTH-2] = instruction;
+}
+
+
+// Returns the name of `opcode`, including the opcodes only the decoder produces.
+static const char* opcode_name(byte opcode) {
+    switch (opcode) {
+        case OP_HALT: return "halt";
+        case OP_DIV_POW2: return "div_pow2";
+        case OP_MOD_POW2: return "mod_pow2";
+    }
+    return INSTRUCTIONS[opcode];
+}
+
+
+static void print_sequence(FILE *file, uint64_t key) {
+    size_t length = key & 3;
+    key >>= 2;
+    for (size_t i = 0; i < length; i++) {
+        uint16_t element = (key >> (16 * (length-1-i))) & 0xFFFF;
+        byte opcode = element >> 4;
+        byte modes = element & 0xF;
+
+        fprintf(file, i == 0 ? "%s" : ", %s", opcode_name(opcode));
+        byte argument_count = decoded_argument_count(opcode);
+        if (argument_count) {
+            fputc(' ', file);
+        }
+        for (byte j = 0; j < argument_count; j++) {
+            fputc(modes & (1 << j) ? 'M' : 'L', file);
+        }
+    }
+    fputc('\n', file);
+}
+
+
+void profile_report() {
+    printf("\nMost frequent instruction sequences (%llu instructions run):\n", (unsigned long long) instructions_run);
+    for (size_t i = 0; i < PROFILE_REPORT_SIZE; i++) {
+        // Find the next most frequent sequence
+        SequenceCount *best = NULL;
+        for (size_t j = 0; j < PROFILE_TABLE_SIZE; j++) {
+            SequenceCount *entry = &sequence_counts[j];
+            if (entry->count && (!best || entry->count > best->count)) {
+                best = entry;
+            }
+        }
+        if (!best) {
+            break;
+        }
+
+        printf("%12llu %6.2f%%  ", (unsigned long long) best->count, 100.0 * best->count / instructions_run);
+        print_sequence(stdout, best->key);
+        best->count = 0;
+    }
+}
+
+
+int profile_write(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        printf("Failed to open \"%s\" for the profile counts.\n", path);
+        return -1;
+    }
+    fprintf(file, "%llu instructions\n", (unsigned long long) instructions_run);
+    for (size_t i = 0; i < PROFILE_TABLE_SIZE; i++) {
+        const SequenceCount *entry = &sequence_counts[i];
+        if (entry->count) {
+            fprintf(file, "%llu ", (unsigned long long) entry->count);
+            print_sequence(file, entry->key);
+        }
+    }
+    fclose(file);
+    return 0;
+}
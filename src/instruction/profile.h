@@ -0,0 +1,28 @@
+/*
+    Profiling of the instruction sequences run by the interpreter.
+    Only compiled in with `ENABLE_G1_PROFILING`.
+*/
+
+#ifndef PROFILE_HEADER
+#define PROFILE_HEADER
+
+#include "threaded.h"
+
+
+/*
+Record that the instruction described by `instruction`, an element of `ThreadedCode.info`, is about to be run.
+Passing `NULL` marks the start of a new thread, so the next instruction does not continue a sequence.
+*/
+void profile_record(const ThreadedInfo *instruction);
+
+// Print the most frequently run sequences of adjacent instructions.
+void profile_report();
+
+/*
+Write the number of instructions run and every counted sequence to `path`, one `count sequence` line each,
+for tools that combine the counts of several programs. Returns -1 if the file couldn't be written.
+Call it before `profile_report`, which clears the counts it prints.
+*/
+int profile_write(const char *path);
+
+#endif
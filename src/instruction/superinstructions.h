@@ -0,0 +1,109 @@
+/*
+    The superinstructions the decoder fuses, generated by `profile/superinstructions.py` from the instruction
+    sequence counts of the programs in `profile/corpus`, which are in `profile/counts.txt`. Don't edit it by hand.
+*/
+
+#ifndef SUPERINSTRUCTIONS_HEADER
+#define SUPERINSTRUCTIONS_HEADER
+
+
+/*
+Share of the dispatches of an average corpus program that each superinstruction saves:
+    ADD_LML_LESS_LML_JMP_LM   8.49%  add LML, less LML, jmp LM
+    ADD_LML_MOVP_LM           8.44%  add LML, movp LM
+    MOVP_LM_ADD_LMM_ADD_LML   5.09%  movp LM, add LMM, add LML
+    ADD_LML_MOVP_LM_ADD_LMM   3.38%  add LML, movp LM, add LMM
+    ADD_LMM_ADD_LML_MOVP_LM   2.96%  add LMM, add LML, movp LM
+    LESS_LML_JMP_LM           2.63%  less LML, jmp LM
+    NOT_LM_JMP_LM             2.45%  not LM, jmp LM
+    MOVP_LM_MUL_LML_ADD_LML   2.33%  movp LM, mul LML, add LML
+    MOVP_LM_ADD_LML           2.29%  movp LM, add LML
+    LESS_LMM_JMP_LM           2.23%  less LMM, jmp LM
+    MUL_LMM_SAR_LML_ADD_LMM   2.11%  mul LMM, sar LML, add LMM
+    JMP_LM_ADD_LML            1.87%  jmp LM, add LML
+    JMP_LM_LESS_LLM_JMP_LM    1.84%  jmp LM, less LLM, jmp LM
+    JMP_LM_ADD_LMM_ADD_LMM    1.66%  jmp LM, add LMM, add LMM
+    ADD_LMM_MOVP_LM_MUL_LML   1.63%  add LMM, movp LM, mul LML
+    SHR_LMM_AND_LML_NOT_LM    1.54%  shr LMM, and LML, not LM
+
+Each entry is the name, the number of instructions, their opcodes and their addressing modes.
+*/
+#define SUPERINSTRUCTIONS(X) \
+    X(ADD_LML_LESS_LML_JMP_LM, 3, (OP_ADD, OP_LESS, OP_JMP), (0x2, 0x2, 0x2)) \
+    X(ADD_LML_MOVP_LM, 2, (OP_ADD, OP_MOVP), (0x2, 0x2)) \
+    X(MOVP_LM_ADD_LMM_ADD_LML, 3, (OP_MOVP, OP_ADD, OP_ADD), (0x2, 0x6, 0x2)) \
+    X(ADD_LML_MOVP_LM_ADD_LMM, 3, (OP_ADD, OP_MOVP, OP_ADD), (0x2, 0x2, 0x6)) \
+    X(ADD_LMM_ADD_LML_MOVP_LM, 3, (OP_ADD, OP_ADD, OP_MOVP), (0x6, 0x2, 0x2)) \
+    X(LESS_LML_JMP_LM, 2, (OP_LESS, OP_JMP), (0x2, 0x2)) \
+    X(NOT_LM_JMP_LM, 2, (OP_NOT, OP_JMP), (0x2, 0x2)) \
+    X(MOVP_LM_MUL_LML_ADD_LML, 3, (OP_MOVP, OP_MUL, OP_ADD), (0x2, 0x2, 0x2)) \
+    X(MOVP_LM_ADD_LML, 2, (OP_MOVP, OP_ADD), (0x2, 0x2)) \
+    X(LESS_LMM_JMP_LM, 2, (OP_LESS, OP_JMP), (0x6, 0x2)) \
+    X(MUL_LMM_SAR_LML_ADD_LMM, 3, (OP_MUL, OP_SAR, OP_ADD), (0x6, 0x2, 0x6)) \
+    X(JMP_LM_ADD_LML, 2, (OP_JMP, OP_ADD), (0x2, 0x2)) \
+    X(JMP_LM_LESS_LLM_JMP_LM, 3, (OP_JMP, OP_LESS, OP_JMP), (0x2, 0x4, 0x2)) \
+    X(JMP_LM_ADD_LMM_ADD_LMM, 3, (OP_JMP, OP_ADD, OP_ADD), (0x2, 0x6, 0x6)) \
+    X(ADD_LMM_MOVP_LM_MUL_LML, 3, (OP_ADD, OP_MOVP, OP_MUL), (0x6, 0x2, 0x2)) \
+    X(SHR_LMM_AND_LML_NOT_LM, 3, (OP_SHR, OP_AND, OP_NOT), (0x6, 0x2, 0x2))
+
+// The body of each superinstruction, its instructions' bodies in order, see `instruction_impl.h`
+#define SUPERINSTRUCTION_BODY_ADD_LML_LESS_LML_JMP_LM(C) \
+    _BINARY_BODY(C, L, M, L, lhs + rhs) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, L, lhs < rhs) _NEXT_COMPONENT() \
+    _JMP_BODY(C, L, M)
+#define SUPERINSTRUCTION_BODY_ADD_LML_MOVP_LM(C) \
+    _BINARY_BODY(C, L, M, L, lhs + rhs) _NEXT_COMPONENT() \
+    _MOVP_BODY(C, L, M)
+#define SUPERINSTRUCTION_BODY_MOVP_LM_ADD_LMM_ADD_LML(C) \
+    _MOVP_BODY(C, L, M) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, M, lhs + rhs) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, L, lhs + rhs)
+#define SUPERINSTRUCTION_BODY_ADD_LML_MOVP_LM_ADD_LMM(C) \
+    _BINARY_BODY(C, L, M, L, lhs + rhs) _NEXT_COMPONENT() \
+    _MOVP_BODY(C, L, M) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, M, lhs + rhs)
+#define SUPERINSTRUCTION_BODY_ADD_LMM_ADD_LML_MOVP_LM(C) \
+    _BINARY_BODY(C, L, M, M, lhs + rhs) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, L, lhs + rhs) _NEXT_COMPONENT() \
+    _MOVP_BODY(C, L, M)
+#define SUPERINSTRUCTION_BODY_LESS_LML_JMP_LM(C) \
+    _BINARY_BODY(C, L, M, L, lhs < rhs) _NEXT_COMPONENT() \
+    _JMP_BODY(C, L, M)
+#define SUPERINSTRUCTION_BODY_NOT_LM_JMP_LM(C) \
+    _UNARY_BODY(C, L, M, !value) _NEXT_COMPONENT() \
+    _JMP_BODY(C, L, M)
+#define SUPERINSTRUCTION_BODY_MOVP_LM_MUL_LML_ADD_LML(C) \
+    _MOVP_BODY(C, L, M) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, L, lhs * rhs) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, L, lhs + rhs)
+#define SUPERINSTRUCTION_BODY_MOVP_LM_ADD_LML(C) \
+    _MOVP_BODY(C, L, M) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, L, lhs + rhs)
+#define SUPERINSTRUCTION_BODY_LESS_LMM_JMP_LM(C) \
+    _BINARY_BODY(C, L, M, M, lhs < rhs) _NEXT_COMPONENT() \
+    _JMP_BODY(C, L, M)
+#define SUPERINSTRUCTION_BODY_MUL_LMM_SAR_LML_ADD_LMM(C) \
+    _BINARY_BODY(C, L, M, M, lhs * rhs) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, L, shift_right_arithmetic(lhs, rhs)) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, M, lhs + rhs)
+#define SUPERINSTRUCTION_BODY_JMP_LM_ADD_LML(C) \
+    _JMP_BODY(C, L, M) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, L, lhs + rhs)
+#define SUPERINSTRUCTION_BODY_JMP_LM_LESS_LLM_JMP_LM(C) \
+    _JMP_BODY(C, L, M) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, L, M, lhs < rhs) _NEXT_COMPONENT() \
+    _JMP_BODY(C, L, M)
+#define SUPERINSTRUCTION_BODY_JMP_LM_ADD_LMM_ADD_LMM(C) \
+    _JMP_BODY(C, L, M) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, M, lhs + rhs) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, M, lhs + rhs)
+#define SUPERINSTRUCTION_BODY_ADD_LMM_MOVP_LM_MUL_LML(C) \
+    _BINARY_BODY(C, L, M, M, lhs + rhs) _NEXT_COMPONENT() \
+    _MOVP_BODY(C, L, M) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, L, lhs * rhs)
+#define SUPERINSTRUCTION_BODY_SHR_LMM_AND_LML_NOT_LM(C) \
+    _BINARY_BODY(C, L, M, M, shift_right(lhs, rhs)) _NEXT_COMPONENT() \
+    _BINARY_BODY(C, L, M, L, lhs & rhs) _NEXT_COMPONENT() \
+    _UNARY_BODY(C, L, M, !value)
+
+#endif
@@ -0,0 +1,65 @@
+/*
+    The compact form of a decoded program that the interpreter runs.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "instruction.h"
+#include "decode.h"
+#include "threaded.h"
+
+
+// Returns the number of operands the interpreter reads from `ins`, which calls and idioms use past its arguments.
+static byte threaded_operand_count(const DecodedInstruction *ins) {
+    switch (ins->idiom) {
+        case IDIOM_FILL: case IDIOM_COPY: case IDIOM_SPAN: case IDIOM_JUMP_TABLE:
+            return MAX_ARGUMENTS;  // The index of the loop or table
+        case IDIOM_CALL:
+            return 3;  // The return target, see `link_calls`
+    }
+    return ins->opcode == OP_CALL ? 3 : decoded_argument_count(ins->opcode);
+}
+
+
+int thread_instructions(const DecodedInstruction *instructions, size_t decoded_count, ThreadedCode *code) {
+    size_t operand_count = 0;
+    for (size_t i = 0; i < decoded_count; i++) {
+        operand_count += threaded_operand_count(&instructions[i]);
+    }
+
+    code->instructions = malloc(sizeof(ThreadedInstruction) * decoded_count);
+    code->info = malloc(sizeof(ThreadedInfo) * decoded_count);
+    code->operands = malloc(sizeof(int32_t) * (operand_count ? operand_count : 1));
+    code->count = decoded_count;
+    if (!code->instructions || !code->info || !code->operands || operand_count > UINT32_MAX) {
+        printf("Failed to allocate memory for threaded instructions.\n");
+        free_threaded_code(code);
+        return -1;
+    }
+
+    uint32_t offset = 0;
+    for (size_t i = 0; i < decoded_count; i++) {
+        const DecodedInstruction *ins = &instructions[i];
+        code->instructions[i] = (ThreadedInstruction) {0, {ins->operands[0], ins->operands[1], ins->operands[2]}};
+        code->info[i] = (ThreadedInfo) {
+            INSTRUCTION_CODE(ins->opcode, ins->modes), ins->superinstruction, ins->idiom, ins->verified, ins->entry_point,
+            offset
+        };
+        byte count = threaded_operand_count(ins);
+        for (byte j = 0; j < count; j++) {
+            code->operands[offset++] = ins->operands[j];
+        }
+    }
+    return 0;
+}
+
+
+void free_threaded_code(ThreadedCode *code) {
+    free(code->instructions);
+    free(code->info);
+    free(code->operands);
+    code->instructions = NULL;
+    code->info = NULL;
+    code->operands = NULL;
+    code->count = 0;
+}
@@ -0,0 +1,70 @@
+/*
+    The compact form of a decoded program that the interpreter runs.
+*/
+
+#ifndef THREADED_HEADER
+#define THREADED_HEADER
+
+#include "decode.h"
+
+
+// Operands kept in `ThreadedInstruction`, which is every operand the operand-specialized handlers read
+#define THREADED_OPERANDS 3
+
+/*
+An instruction as the interpreter dispatches it.
+`handler` is the offset of the interpreter code that runs the instruction from the interpreter's `do_halt` label,
+and is filled in by the interpreter. `operands` are the first operands of the instruction.
+*/
+typedef struct {
+    int32_t handler;
+    int32_t operands[THREADED_OPERANDS];
+} ThreadedInstruction;
+
+/*
+What the interpreter needs to pick an instruction's handler or to run it with every check, which dispatch doesn't read.
+`code` holds the opcode in the low byte and the addressing modes in the high byte, like `InstructionList.codes`.
+Every operand the instruction reads starts at `first_operand` in the operands of its `ThreadedCode`.
+The other fields are the same as in `DecodedInstruction`.
+*/
+typedef struct {
+    uint16_t code;
+    byte superinstruction;
+    byte idiom;
+    bool verified;
+    bool entry_point;
+    uint32_t first_operand;
+} ThreadedInfo;
+
+/*
+A decoded program with 16 bytes per instruction on the dispatch path instead of a `DecodedInstruction`.
+Generic instructions, idioms and the checked slow path read their operands from `operands` instead,
+which only holds the operands each instruction reads, like `InstructionList.operands`.
+Instruction `i` is `instructions[i]` and `info[i]`, so jump targets are still instruction indices.
+*/
+typedef struct {
+    ThreadedInstruction *instructions;
+    ThreadedInfo *info;
+    int32_t *operands;
+    size_t count;
+} ThreadedCode;
+
+
+/*
+Lay out the `decoded_count` instructions of a decoded program as threaded code.
+The instructions should be verified first, see `verify.h`. Returns -1 if the code couldn't be allocated.
+*/
+int thread_instructions(const DecodedInstruction *instructions, size_t decoded_count, ThreadedCode *code);
+
+void free_threaded_code(ThreadedCode *code);
+
+
+static inline byte threaded_opcode(const ThreadedInfo *info) {
+    return info->code & 0xff;
+}
+
+static inline byte threaded_modes(const ThreadedInfo *info) {
+    return info->code >> 8;
+}
+
+#endif
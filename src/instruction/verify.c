@@ -0,0 +1,867 @@
+/*
+    Static verification of memory accesses, so the interpreter can skip runtime checks that can never fail.
+
+    This is an interval analysis over the instructions of the program. Every slot that is used as a pointer
+    (the destination of an indirect store or the source of a `movp`) is tracked, along with the slots its
+    value is computed from and the slots holding comparisons against them, so loops like
+    `add ptr BASE $i; movp x $ptr; ...; less c $i N; jmp loop $c` can be proven to stay inside memory.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "instruction.h"
+#include "decode.h"
+#include "verify.h"
+#include "fixed_math.h"
+
+#define MAX_TRACKED_SLOTS 64
+
+// Block entry states are widened after this many updates, so loops reach a fixed point quickly
+#define WIDENING_DELAY 3
+
+// Passes made after the fixed point to recover bounds lost to widening
+#define NARROWING_PASSES 2
+
+#define NO_BLOCK SIZE_MAX
+
+
+// An inclusive range of values. Bounds always fit in an int32.
+typedef struct {
+    int64_t low, high;
+} Interval;
+
+static const Interval TOP = {INT32_MIN, INT32_MAX};
+
+
+typedef enum {
+    CONDITION_NONE,
+    CONDITION_LESS,
+    CONDITION_EQUAL
+} ConditionKind;
+
+// One side of a comparison. `tracked` is the tracked slot it was read from, or -1 if `value` is all that's known.
+typedef struct {
+    int tracked;
+    Interval value;
+} ComparisonOperand;
+
+// Records that a tracked slot holds the result of `lhs < rhs` or `lhs == rhs`, or the opposite if `negated`.
+typedef struct {
+    byte kind;
+    bool negated;
+    ComparisonOperand lhs, rhs;
+} Condition;
+
+// What is known about the tracked slots at some point in the program.
+typedef struct {
+    bool reachable;
+    Interval *values;
+    Condition *conditions;
+} AbstractState;
+
+
+typedef struct {
+    DecodedInstruction *instructions;
+    size_t instruction_count, decoded_count;
+    int32_t memory_size;
+
+    int32_t tracked_slots[MAX_TRACKED_SLOTS];  // Sorted
+    int tracked_count;
+
+    size_t *block_starts;
+    size_t *block_ids;  // Block that starts at each instruction, or `NO_BLOCK`
+    size_t block_count;
+
+    AbstractState *entry_states;
+    size_t *update_counts;
+    size_t *worklist;
+    bool *queued;
+    size_t worklist_head, worklist_length;
+} Verifier;
+
+
+typedef enum {
+    RUN_WORKLIST,  // Join successor states with widening and queue the ones that changed
+    RUN_NARROWING, // Join successor states into a fresh set of entry states
+    RUN_MARK       // Set `verified` on every instruction whose checks pass
+} RunMode;
+
+
+static Interval make_interval(int64_t low, int64_t high) {
+    if (low < INT32_MIN || high > INT32_MAX) {
+        return TOP;
+    }
+    return (Interval) {low, high};
+}
+
+static Interval point(int64_t value) {
+    return (Interval) {value, value};
+}
+
+static bool is_empty(Interval a) {
+    return a.low > a.high;
+}
+
+static bool is_within(Interval a, int64_t low, int64_t high) {
+    return a.low >= low && a.high <= high;
+}
+
+static bool contains(Interval a, int64_t value) {
+    return a.low <= value && value <= a.high;
+}
+
+static Interval hull(Interval a, Interval b) {
+    return (Interval) {a.low < b.low ? a.low : b.low, a.high > b.high ? a.high : b.high};
+}
+
+static Interval intersect(Interval a, Interval b) {
+    return (Interval) {a.low > b.low ? a.low : b.low, a.high < b.high ? a.high : b.high};
+}
+
+
+static Interval interval_mul(Interval a, Interval b) {
+    int64_t products[4] = {a.low*b.low, a.low*b.high, a.high*b.low, a.high*b.high};
+    Interval result = point(products[0]);
+    for (int i = 1; i < 4; i++) {
+        result = hull(result, point(products[i]));
+    }
+    return make_interval(result.low, result.high);
+}
+
+// Truncating division, only bounded for a known divisor.
+static Interval interval_div(Interval a, Interval b) {
+    if (b.low != b.high || b.low == 0) {
+        return TOP;
+    }
+    int64_t divisor = b.low;
+    if (divisor > 0) {
+        return make_interval(a.low / divisor, a.high / divisor);
+    }
+    return make_interval(a.high / divisor, a.low / divisor);
+}
+
+// Floored modulo, so the result lies between zero and the divisor.
+static Interval interval_mod(Interval a, Interval b) {
+    if (b.low > 0) {
+        if (b.low == b.high && is_within(a, 0, b.low-1)) {
+            return a;
+        }
+        return (Interval) {0, b.high-1};
+    }
+    if (b.high < 0) {
+        return (Interval) {b.low+1, 0};
+    }
+    return TOP;
+}
+
+// Bitwise and, bounded by its nonnegative operands.
+static Interval interval_and(Interval a, Interval b) {
+    if (a.low >= 0 && b.low >= 0) {
+        return (Interval) {0, a.high < b.high ? a.high : b.high};
+    }
+    if (a.low >= 0 || b.low >= 0) {
+        return (Interval) {0, a.low >= 0 ? a.high : b.high};
+    }
+    return TOP;
+}
+
+// Bitwise or and xor, only bounded for nonnegative operands, which stay below the next power of two.
+static Interval interval_or(Interval a, Interval b) {
+    if (a.low < 0 || b.low < 0) {
+        return TOP;
+    }
+    int64_t high = a.high > b.high ? a.high : b.high, bound = 1;
+    while (bound <= high) {
+        bound <<= 1;
+    }
+    return (Interval) {0, bound-1};
+}
+
+// Logical or arithmetic right shift, only bounded for a known shift.
+static Interval interval_shift_right(Interval a, Interval b, bool arithmetic) {
+    if (b.low != b.high) {
+        return TOP;
+    }
+    int32_t shift = b.low & 31;
+    if (arithmetic || a.low >= 0 || shift == 0) {
+        return make_interval(a.low >> shift, a.high >> shift);
+    }
+    return (Interval) {0, UINT32_MAX >> shift};
+}
+
+static Interval interval_abs(Interval a) {
+    if (a.low >= 0) {
+        return a;
+    }
+    if (a.high <= 0) {
+        return make_interval(-a.high, -a.low);
+    }
+    return make_interval(0, -a.low > a.high ? -a.low : a.high);
+}
+
+// Square roots read their operand as unsigned, so negative operands can have any root.
+static Interval interval_sqrt(Interval a) {
+    if (a.low >= 0) {
+        return (Interval) {fixed_sqrt((int32_t) a.low), fixed_sqrt((int32_t) a.high)};
+    }
+    return (Interval) {0, UINT16_MAX};
+}
+
+static Interval interval_less(Interval a, Interval b) {
+    if (a.high < b.low) {
+        return point(1);
+    }
+    if (a.low >= b.high) {
+        return point(0);
+    }
+    return (Interval) {0, 1};
+}
+
+static Interval interval_equal(Interval a, Interval b) {
+    if (a.low == a.high && b.low == b.high && a.low == b.low) {
+        return point(1);
+    }
+    if (is_empty(intersect(a, b))) {
+        return point(0);
+    }
+    return (Interval) {0, 1};
+}
+
+static Interval interval_not(Interval a) {
+    if (!contains(a, 0)) {
+        return point(0);
+    }
+    if (a.low == 0 && a.high == 0) {
+        return point(1);
+    }
+    return (Interval) {0, 1};
+}
+
+
+// Returns the index of `slot` in the tracked slots, or -1 if it isn't tracked.
+static int tracked_index(const Verifier *verifier, int32_t slot) {
+    int low = 0, high = verifier->tracked_count-1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        int32_t tracked = verifier->tracked_slots[middle];
+        if (tracked == slot) {
+            return middle;
+        }
+        if (tracked < slot) {
+            low = middle+1;
+        }
+        else {
+            high = middle-1;
+        }
+    }
+    return -1;
+}
+
+// Adds `slot` to the tracked slots. Returns true if it wasn't tracked before.
+static bool track_slot(Verifier *verifier, int32_t slot) {
+    if (slot < 0 || slot >= verifier->memory_size || verifier->tracked_count >= MAX_TRACKED_SLOTS || tracked_index(verifier, slot) >= 0) {
+        return false;
+    }
+    int i = verifier->tracked_count++;
+    while (i > 0 && verifier->tracked_slots[i-1] > slot) {
+        verifier->tracked_slots[i] = verifier->tracked_slots[i-1];
+        i--;
+    }
+    verifier->tracked_slots[i] = slot;
+    return true;
+}
+
+
+static bool is_address(const DecodedInstruction *ins, byte argument) {
+    return ins->modes & (1 << argument);
+}
+
+// Returns true if the instruction has no effect on memory.
+static bool writes_nothing(byte opcode) {
+    switch (opcode) {
+        case OP_JMP: case OP_COLOR: case OP_POINT: case OP_LINE: case OP_RECT: case OP_PUTC: case OP_SETCH: case OP_HALT:
+        case OP_CALL: case OP_RET: case OP_BLIT: case OP_BLITKEY: case OP_COPYRECT: case OP_TRI:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+/*
+Choose the slots to track: every slot used as a pointer, then the slots that values stored
+into tracked slots are computed from, and the slots that hold comparisons against tracked slots.
+*/
+static void choose_tracked_slots(Verifier *verifier) {
+    for (size_t i = 0; i < verifier->decoded_count; i++) {
+        const DecodedInstruction *ins = &verifier->instructions[i];
+        if (writes_destination(ins->opcode) && is_address(ins, 0)) {
+            track_slot(verifier, ins->operands[0]);
+        }
+        if (ins->opcode == OP_MOVP && is_address(ins, 1)) {
+            track_slot(verifier, ins->operands[1]);
+        }
+        if ((ins->opcode == OP_DIV || ins->opcode == OP_MOD) && is_address(ins, 2)) {
+            track_slot(verifier, ins->operands[2]);
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < verifier->decoded_count; i++) {
+            const DecodedInstruction *ins = &verifier->instructions[i];
+            if (!writes_destination(ins->opcode) || ins->opcode == OP_MOVP || ins->opcode == OP_GETP || is_address(ins, 0)) {
+                continue;
+            }
+            byte argument_count = decoded_argument_count(ins->opcode);
+            bool writes_tracked = tracked_index(verifier, ins->operands[0]) >= 0;
+            bool compares_tracked = false;
+            if (ins->opcode == OP_LESS || ins->opcode == OP_EQUAL || ins->opcode == OP_NOT) {
+                for (byte j = 1; j < argument_count; j++) {
+                    compares_tracked |= is_address(ins, j) && tracked_index(verifier, ins->operands[j]) >= 0;
+                }
+            }
+            if (!writes_tracked && !compares_tracked) {
+                continue;
+            }
+            changed |= track_slot(verifier, ins->operands[0]);
+            for (byte j = 1; j < argument_count; j++) {
+                if (is_address(ins, j)) {
+                    changed |= track_slot(verifier, ins->operands[j]);
+                }
+            }
+        }
+    }
+}
+
+
+/*
+Split the program into blocks. A block starts at every entrypoint, every literal jump and call target, after every
+jump, call and return, and at and after every halt instruction. Instructions with `entry_point` set are also added
+here if computed jumps or returns may target them.
+*/
+static int find_blocks(Verifier *verifier, int32_t start_index, int32_t tick_index) {
+    DecodedInstruction *instructions = verifier->instructions;
+    size_t instruction_count = verifier->instruction_count;
+    size_t decoded_count = verifier->decoded_count;
+
+    // Computed jumps are expected to target the labels that the program moves into memory
+    bool has_computed_jump = false;
+    for (size_t i = 0; i < instruction_count; i++) {
+        has_computed_jump |= instructions[i].opcode == OP_JMP && is_address(&instructions[i], 0);
+    }
+    if (has_computed_jump) {
+        for (size_t i = 0; i < instruction_count; i++) {
+            const DecodedInstruction *ins = &instructions[i];
+            if (ins->opcode == OP_MOV && !is_address(ins, 1) && (uint32_t) ins->operands[1] < instruction_count) {
+                instructions[ins->operands[1]].entry_point = true;
+            }
+        }
+    }
+    // Returns land where their calls return to
+    for (size_t i = 0; i < decoded_count; i++) {
+        const DecodedInstruction *ins = &instructions[i];
+        if (ins->opcode == OP_CALL) {
+            instructions[ins->operands[1]].entry_point = true;
+            instructions[ins->operands[2]].entry_point = true;
+        }
+    }
+    if ((uint32_t) start_index < instruction_count) {
+        instructions[start_index].entry_point = true;
+    }
+    if ((uint32_t) tick_index < instruction_count) {
+        instructions[tick_index].entry_point = true;
+    }
+
+    verifier->block_ids = malloc(sizeof(size_t) * (decoded_count+1));
+    verifier->block_starts = malloc(sizeof(size_t) * (decoded_count+1));
+    if (!verifier->block_ids || !verifier->block_starts) {
+        return -1;
+    }
+    bool *starts_block = (bool*) verifier->block_ids;  // Reused before the block ids are written
+    memset(starts_block, 0, sizeof(bool) * (decoded_count+1));
+    for (size_t i = 0; i < decoded_count; i++) {
+        const DecodedInstruction *ins = &instructions[i];
+        starts_block[i] |= i == 0 || ins->entry_point;
+        if (ins->opcode == OP_HALT) {
+            starts_block[i] = starts_block[i+1] = true;
+        }
+        else if (ins->opcode == OP_JMP || ins->opcode == OP_CALL || ins->opcode == OP_RET) {
+            starts_block[i+1] = true;
+            if (ins->opcode != OP_RET && !is_address(ins, 0)) {
+                starts_block[ins->operands[0]] = true;
+            }
+        }
+    }
+
+    size_t block_count = 0;
+    for (size_t i = 0; i < decoded_count; i++) {
+        if (starts_block[i]) {
+            verifier->block_starts[block_count++] = i;
+        }
+    }
+    verifier->block_starts[block_count] = decoded_count;
+    verifier->block_count = block_count;
+
+    for (size_t i = 0; i <= decoded_count; i++) {
+        verifier->block_ids[i] = NO_BLOCK;
+    }
+    for (size_t i = 0; i < block_count; i++) {
+        verifier->block_ids[verifier->block_starts[i]] = i;
+    }
+    return 0;
+}
+
+
+static void state_set_top(const Verifier *verifier, AbstractState *state) {
+    state->reachable = true;
+    for (int i = 0; i < verifier->tracked_count; i++) {
+        state->values[i] = TOP;
+        state->conditions[i].kind = CONDITION_NONE;
+    }
+}
+
+static void state_copy(const Verifier *verifier, AbstractState *dest, const AbstractState *src) {
+    dest->reachable = src->reachable;
+    memcpy(dest->values, src->values, sizeof(Interval) * verifier->tracked_count);
+    memcpy(dest->conditions, src->conditions, sizeof(Condition) * verifier->tracked_count);
+}
+
+static bool same_condition(const Condition *a, const Condition *b) {
+    if (a->kind != b->kind || a->negated != b->negated || a->lhs.tracked != b->lhs.tracked || a->rhs.tracked != b->rhs.tracked) {
+        return false;
+    }
+    const ComparisonOperand *operands_a[2] = {&a->lhs, &a->rhs};
+    const ComparisonOperand *operands_b[2] = {&b->lhs, &b->rhs};
+    for (int i = 0; i < 2; i++) {
+        if (operands_a[i]->tracked < 0 && memcmp(&operands_a[i]->value, &operands_b[i]->value, sizeof(Interval))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+Merge `src` into `dest`, widening any bound that moved if `widen` is set.
+Returns true if `dest` changed.
+*/
+static bool state_join(const Verifier *verifier, AbstractState *dest, const AbstractState *src, bool widen) {
+    if (!src->reachable) {
+        return false;
+    }
+    if (!dest->reachable) {
+        state_copy(verifier, dest, src);
+        return true;
+    }
+    bool changed = false;
+    for (int i = 0; i < verifier->tracked_count; i++) {
+        Interval old = dest->values[i];
+        Interval joined = hull(old, src->values[i]);
+        if (widen) {
+            joined.low = joined.low < old.low ? INT32_MIN : joined.low;
+            joined.high = joined.high > old.high ? INT32_MAX : joined.high;
+        }
+        changed |= joined.low != old.low || joined.high != old.high;
+        dest->values[i] = joined;
+
+        Condition *condition = &dest->conditions[i];
+        if (condition->kind != CONDITION_NONE && !same_condition(condition, &src->conditions[i])) {
+            condition->kind = CONDITION_NONE;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+
+// Forget every condition that depends on the value of tracked slot `index`.
+static void kill_conditions(const Verifier *verifier, AbstractState *state, int index) {
+    for (int i = 0; i < verifier->tracked_count; i++) {
+        Condition *condition = &state->conditions[i];
+        if (i == index || condition->lhs.tracked == index || condition->rhs.tracked == index) {
+            condition->kind = CONDITION_NONE;
+        }
+    }
+}
+
+static Interval read_slot(const Verifier *verifier, const AbstractState *state, int32_t slot) {
+    int index = tracked_index(verifier, slot);
+    return index >= 0 ? state->values[index] : TOP;
+}
+
+static Interval read_operand(const Verifier *verifier, const AbstractState *state, const DecodedInstruction *ins, byte argument) {
+    int32_t operand = ins->operands[argument];
+    return is_address(ins, argument) ? read_slot(verifier, state, operand) : point(operand);
+}
+
+static ComparisonOperand comparison_operand(const Verifier *verifier, const AbstractState *state, const DecodedInstruction *ins, byte argument) {
+    int tracked = is_address(ins, argument) ? tracked_index(verifier, ins->operands[argument]) : -1;
+    return (ComparisonOperand) {tracked, read_operand(verifier, state, ins, argument)};
+}
+
+// The range of addresses the instruction can store to.
+static Interval destination(const Verifier *verifier, const AbstractState *state, const DecodedInstruction *ins) {
+    return read_operand(verifier, state, ins, 0);
+}
+
+
+/*
+Record a store of `value` to any address in `dest`, along with the condition it holds if `condition` is set.
+Stores outside of memory end the thread, so only addresses inside memory are considered.
+*/
+static void store(const Verifier *verifier, AbstractState *state, Interval dest, Interval value, const Condition *condition) {
+    dest = intersect(dest, (Interval) {0, verifier->memory_size-1});
+    if (is_empty(dest)) {
+        state->reachable = false;
+        return;
+    }
+    if (dest.low == dest.high) {
+        int index = tracked_index(verifier, dest.low);
+        if (index < 0) {
+            return;
+        }
+        kill_conditions(verifier, state, index);
+        state->values[index] = value;
+        if (condition && condition->lhs.tracked != index && condition->rhs.tracked != index) {
+            state->conditions[index] = *condition;
+        }
+        return;
+    }
+    for (int i = 0; i < verifier->tracked_count; i++) {
+        if (contains(dest, verifier->tracked_slots[i])) {
+            kill_conditions(verifier, state, i);
+            state->values[i] = hull(state->values[i], value);
+        }
+    }
+}
+
+
+static bool narrow_slot(const Verifier *verifier, AbstractState *state, int index, Interval value) {
+    if (index < 0) {
+        return true;
+    }
+    Interval narrowed = intersect(state->values[index], value);
+    if (is_empty(narrowed)) {
+        return false;
+    }
+    state->values[index] = narrowed;
+    return true;
+}
+
+/*
+Narrow the tracked slots in `condition` assuming it evaluated to `truth`.
+Returns false if that can't happen.
+*/
+static bool assume_condition(const Verifier *verifier, AbstractState *state, const Condition *condition, bool truth) {
+    const ComparisonOperand *lhs = &condition->lhs, *rhs = &condition->rhs;
+    Interval a = lhs->tracked >= 0 ? state->values[lhs->tracked] : lhs->value;
+    Interval b = rhs->tracked >= 0 ? state->values[rhs->tracked] : rhs->value;
+    bool holds = truth != condition->negated;
+
+    Interval new_a = a, new_b = b;
+    if (condition->kind == CONDITION_LESS) {
+        if (holds) {  // a < b
+            new_a.high = a.high < b.high-1 ? a.high : b.high-1;
+            new_b.low = b.low > a.low+1 ? b.low : a.low+1;
+        }
+        else {  // a >= b
+            new_a.low = a.low > b.low ? a.low : b.low;
+            new_b.high = b.high < a.high ? b.high : a.high;
+        }
+    }
+    else if (holds) {
+        new_a = new_b = intersect(a, b);
+    }
+    else {
+        if (b.low == b.high) {
+            new_a.low += a.low == b.low;
+            new_a.high -= a.high == b.low;
+        }
+        if (a.low == a.high) {
+            new_b.low += b.low == a.low;
+            new_b.high -= b.high == a.low;
+        }
+    }
+
+    if (is_empty(new_a) || is_empty(new_b)) {
+        return false;
+    }
+    return narrow_slot(verifier, state, lhs->tracked, new_a) && narrow_slot(verifier, state, rhs->tracked, new_b);
+}
+
+/*
+Narrow `state` assuming the jump condition in `ins` evaluated to `truth`.
+Returns false if that can't happen.
+*/
+static bool assume_jump(const Verifier *verifier, AbstractState *state, const DecodedInstruction *ins, bool truth) {
+    Interval condition_value = read_operand(verifier, state, ins, 1);
+    if (truth ? (condition_value.low == 0 && condition_value.high == 0) : !contains(condition_value, 0)) {
+        return false;
+    }
+    if (!is_address(ins, 1)) {
+        return true;
+    }
+    int index = tracked_index(verifier, ins->operands[1]);
+    if (index < 0) {
+        return true;
+    }
+    if (truth) {
+        Interval *value = &state->values[index];
+        value->low += value->low == 0;
+        value->high -= value->high == 0;
+    }
+    else {
+        state->values[index] = point(0);
+    }
+    Condition condition = state->conditions[index];
+    return condition.kind == CONDITION_NONE || assume_condition(verifier, state, &condition, truth);
+}
+
+
+// Returns true if every runtime check in `ins` passes when run from `state`.
+static bool checks_pass(const Verifier *verifier, const AbstractState *state, const DecodedInstruction *ins) {
+    Interval memory_range = {0, verifier->memory_size-1};
+    byte argument_count = decoded_argument_count(ins->opcode);
+    for (byte i = 0; i < argument_count; i++) {
+        if (is_address(ins, i) && !contains(memory_range, ins->operands[i])) {
+            return false;
+        }
+    }
+
+    bool destination_valid = is_within(destination(verifier, state, ins), 0, verifier->memory_size-1);
+    switch (ins->opcode) {
+        case OP_MOV: case OP_ADD: case OP_SUB: case OP_MUL: case OP_LESS: case OP_EQUAL: case OP_NOT:
+        case OP_DIV_POW2: case OP_MOD_POW2: case OP_AND: case OP_OR: case OP_XOR: case OP_SHL: case OP_SHR: case OP_SAR:
+        case OP_SIN: case OP_COS: case OP_SQRT: case OP_ABS: case OP_MIN: case OP_MAX: case OP_ATAN2:
+            return destination_valid;
+        case OP_MOVP:
+            return destination_valid && is_within(read_operand(verifier, state, ins, 1), 0, verifier->memory_size-1);
+        case OP_DIV: case OP_MOD:
+            return destination_valid && !contains(read_operand(verifier, state, ins, 2), 0);
+        case OP_JMP: case OP_CALL: case OP_RET:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Apply the effect of a non-jump instruction to `state`.
+static void transfer(const Verifier *verifier, AbstractState *state, const DecodedInstruction *ins) {
+    if (writes_nothing(ins->opcode)) {
+        return;
+    }
+    if (!writes_destination(ins->opcode)) {
+        state_set_top(verifier, state);
+        return;
+    }
+
+    Interval dest = destination(verifier, state, ins);
+    Interval a = decoded_argument_count(ins->opcode) > 1 ? read_operand(verifier, state, ins, 1) : TOP;
+    Interval b = decoded_argument_count(ins->opcode) > 2 ? read_operand(verifier, state, ins, 2) : TOP;
+    Condition condition = {CONDITION_NONE};
+    Interval value;
+    switch (ins->opcode) {
+        case OP_MOV: value = a; break;
+        case OP_ADD: value = make_interval(a.low + b.low, a.high + b.high); break;
+        case OP_SUB: value = make_interval(a.low - b.high, a.high - b.low); break;
+        case OP_MUL: value = interval_mul(a, b); break;
+        case OP_DIV: value = interval_div(a, b); break;
+        case OP_MOD: value = interval_mod(a, b); break;
+        case OP_DIV_POW2: value = interval_div(a, point((int64_t) 1 << b.low)); break;
+        case OP_MOD_POW2: value = is_within(a, 0, b.low) ? a : (Interval) {0, b.low}; break;
+        case OP_AND: value = interval_and(a, b); break;
+        case OP_OR: case OP_XOR: value = interval_or(a, b); break;
+        case OP_SHR: value = interval_shift_right(a, b, false); break;
+        case OP_SAR: value = interval_shift_right(a, b, true); break;
+        case OP_SIN: case OP_COS: value = (Interval) {-FIXED_ONE, FIXED_ONE}; break;
+        case OP_SQRT: value = interval_sqrt(a); break;
+        case OP_ABS: value = interval_abs(a); break;
+        case OP_MIN: value = (Interval) {a.low < b.low ? a.low : b.low, a.high < b.high ? a.high : b.high}; break;
+        case OP_MAX: value = (Interval) {a.low > b.low ? a.low : b.low, a.high > b.high ? a.high : b.high}; break;
+        case OP_ATAN2: value = (Interval) {-FIXED_TURN/2, FIXED_TURN/2}; break;
+        case OP_LESS: case OP_EQUAL:
+            value = ins->opcode == OP_LESS ? interval_less(a, b) : interval_equal(a, b);
+            condition = (Condition) {
+                ins->opcode == OP_LESS ? CONDITION_LESS : CONDITION_EQUAL, false,
+                comparison_operand(verifier, state, ins, 1), comparison_operand(verifier, state, ins, 2)
+            };
+            break;
+        case OP_NOT:
+            value = interval_not(a);
+            if (is_address(ins, 1)) {
+                int index = tracked_index(verifier, ins->operands[1]);
+                if (index >= 0 && state->conditions[index].kind != CONDITION_NONE) {
+                    condition = state->conditions[index];
+                    condition.negated = !condition.negated;
+                }
+            }
+            break;
+        default:
+            value = TOP;
+            break;
+    }
+    store(verifier, state, dest, value, condition.kind != CONDITION_NONE ? &condition : NULL);
+}
+
+
+static void propagate(Verifier *verifier, AbstractState *entry_states, size_t target, const AbstractState *state, RunMode mode) {
+    if (target >= verifier->decoded_count) {
+        return;
+    }
+    size_t block = verifier->block_ids[target];
+    bool widen = mode == RUN_WORKLIST && verifier->update_counts[block] >= WIDENING_DELAY;
+    if (!state_join(verifier, &entry_states[block], state, widen) || mode != RUN_WORKLIST) {
+        return;
+    }
+    verifier->update_counts[block]++;
+    if (!verifier->queued[block]) {
+        verifier->queued[block] = true;
+        verifier->worklist[(verifier->worklist_head + verifier->worklist_length++) % verifier->block_count] = block;
+    }
+}
+
+/*
+Run the instructions of `block` from its entry state, using `state` and `branch` as scratch space.
+Successor states are joined into `successor_states`.
+*/
+static void run_block(Verifier *verifier, size_t block, AbstractState *successor_states, AbstractState *state, AbstractState *branch, RunMode mode) {
+    state_copy(verifier, state, &verifier->entry_states[block]);
+    size_t end = verifier->block_starts[block+1];
+    for (size_t i = verifier->block_starts[block]; i < end && state->reachable; i++) {
+        DecodedInstruction *ins = &verifier->instructions[i];
+        if (ins->opcode == OP_HALT) {
+            break;
+        }
+        if (mode == RUN_MARK) {
+            ins->verified = checks_pass(verifier, state, ins);
+        }
+        // Calls continue at their target, and returns at entrypoints
+        if (ins->opcode == OP_CALL || ins->opcode == OP_RET) {
+            if (ins->opcode == OP_CALL && !is_address(ins, 0)) {
+                propagate(verifier, successor_states, ins->operands[0], state, mode);
+            }
+            break;
+        }
+        if (ins->opcode != OP_JMP) {
+            transfer(verifier, state, ins);
+            if (i+1 == end) {
+                propagate(verifier, successor_states, i+1, state, mode);
+            }
+            continue;
+        }
+
+        // Computed jumps only continue at entrypoints, which start from an unknown state anyway
+        if (!is_address(ins, 0)) {
+            state_copy(verifier, branch, state);
+            if (assume_jump(verifier, branch, ins, true)) {
+                propagate(verifier, successor_states, ins->operands[0], branch, mode);
+            }
+        }
+        if (assume_jump(verifier, state, ins, false)) {
+            propagate(verifier, successor_states, i+1, state, mode);
+        }
+        break;
+    }
+}
+
+
+// Point each state at its own part of the `values` and `conditions` arrays.
+static void init_states(const Verifier *verifier, AbstractState *states, size_t amount, Interval *values, Condition *conditions) {
+    for (size_t i = 0; i < amount; i++) {
+        states[i].reachable = false;
+        states[i].values = &values[i * verifier->tracked_count];
+        states[i].conditions = &conditions[i * verifier->tracked_count];
+    }
+}
+
+
+void verify_instructions(DecodedInstruction *instructions, size_t instruction_count, size_t decoded_count, int32_t memory_size, int32_t start_index, int32_t tick_index) {
+    Verifier verifier = {0};
+    verifier.instructions = instructions;
+    verifier.instruction_count = instruction_count;
+    verifier.decoded_count = decoded_count;
+    verifier.memory_size = memory_size;
+
+    if (instruction_count == 0 || memory_size <= 0) {
+        return;
+    }
+
+    choose_tracked_slots(&verifier);
+    if (find_blocks(&verifier, start_index, tick_index) < 0) {
+        printf("Failed to allocate memory for instruction verification.\n");
+        free(verifier.block_ids);
+        free(verifier.block_starts);
+        return;
+    }
+
+    // Entry states for every block, two sets of them while narrowing, and two scratch states
+    size_t block_count = verifier.block_count;
+    size_t state_count = block_count*2 + 2;
+    size_t slot_count = state_count * (verifier.tracked_count > 0 ? verifier.tracked_count : 1);
+    AbstractState *states = malloc(sizeof(AbstractState) * state_count);
+    Interval *values = malloc(sizeof(Interval) * slot_count);
+    Condition *conditions = malloc(sizeof(Condition) * slot_count);
+    verifier.update_counts = calloc(block_count, sizeof(size_t));
+    verifier.worklist = malloc(sizeof(size_t) * block_count);
+    verifier.queued = calloc(block_count, sizeof(bool));
+
+    if (states && values && conditions && verifier.update_counts && verifier.worklist && verifier.queued) {
+        init_states(&verifier, states, state_count, values, conditions);
+        verifier.entry_states = states;
+        AbstractState *narrowed_states = &states[block_count];
+        AbstractState *state = &states[block_count*2], *branch = &states[block_count*2 + 1];
+
+        for (size_t i = 0; i < block_count; i++) {
+            if (instructions[verifier.block_starts[i]].entry_point) {
+                state_set_top(&verifier, &verifier.entry_states[i]);
+                verifier.queued[i] = true;
+                verifier.worklist[verifier.worklist_length++] = i;
+            }
+        }
+
+        while (verifier.worklist_length > 0) {
+            size_t block = verifier.worklist[verifier.worklist_head];
+            verifier.worklist_head = (verifier.worklist_head + 1) % block_count;
+            verifier.worklist_length--;
+            verifier.queued[block] = false;
+            run_block(&verifier, block, verifier.entry_states, state, branch, RUN_WORKLIST);
+        }
+
+        for (int pass = 0; pass < NARROWING_PASSES; pass++) {
+            for (size_t i = 0; i < block_count; i++) {
+                narrowed_states[i].reachable = false;
+                if (instructions[verifier.block_starts[i]].entry_point) {
+                    state_set_top(&verifier, &narrowed_states[i]);
+                }
+            }
+            for (size_t i = 0; i < block_count; i++) {
+                if (verifier.entry_states[i].reachable) {
+                    run_block(&verifier, i, narrowed_states, state, branch, RUN_NARROWING);
+                }
+            }
+            for (size_t i = 0; i < block_count; i++) {
+                state_copy(&verifier, &verifier.entry_states[i], &narrowed_states[i]);
+            }
+        }
+
+        for (size_t i = 0; i < block_count; i++) {
+            if (verifier.entry_states[i].reachable) {
+                run_block(&verifier, i, narrowed_states, state, branch, RUN_MARK);
+            }
+        }
+    }
+    else {
+        printf("Failed to allocate memory for instruction verification.\n");
+    }
+
+    free(states);
+    free(values);
+    free(conditions);
+    free(verifier.update_counts);
+    free(verifier.worklist);
+    free(verifier.queued);
+    free(verifier.block_ids);
+    free(verifier.block_starts);
+}
@@ -0,0 +1,24 @@
+/*
+    Static verification of memory accesses, so the interpreter can skip runtime checks that can never fail.
+*/
+
+#ifndef VERIFY_HEADER
+#define VERIFY_HEADER
+
+#include "decode.h"
+
+
+/*
+Prove which runtime checks in `instructions` always pass and set `verified` on those instructions.
+
+The analysis assumes that nothing is known about memory at the start and tick entrypoints, or at any
+instruction with `entry_point` set. It marks the instructions that computed jumps may target without
+leaving the verified code; the interpreter must run every check when a computed jump lands anywhere else.
+
+`instructions` is the whole decoded program of `decoded_count` instructions, including the halt instruction at
+`instruction_count` and any optimized code after it.
+`memory_size` is the number of memory slots the program will be run with.
+*/
+void verify_instructions(DecodedInstruction *instructions, size_t instruction_count, size_t decoded_count, int32_t memory_size, int32_t start_index, int32_t tick_index);
+
+#endif
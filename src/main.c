@@ -11,7 +11,7 @@ const char *CG1_VERSION = "1.1.0";
 int main_cli(int argc, char* argv[]) {
     char flags[FLAG_BUFFER_SIZE] = "";
     if (argc == 1) {
-        printf("usage: cg1 program_path [--show_fps] [--scale SCALE] [--title TITLE]\n");
+        printf("usage: cg1 program_path [--show_fps] [--scale SCALE] [--title TITLE] [--unchecked] [--budget INSTRUCTIONS] [--deferred] [--profile PATH]\n");
         return 1;
     }
     
@@ -0,0 +1,132 @@
+/*
+    Guard-page backed program memory.
+    Memory is placed inside a reservation that covers every int32 address,
+    so out of bounds accesses fault instead of needing bounds checks.
+*/
+
+#include "guard.h"
+
+#ifdef G1_GUARD_MEMORY
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef MAP_NORESERVE
+    #define MAP_NORESERVE 0
+#endif
+
+// Bytes addressable on either side of slot 0 by an int32 address
+#define ADDRESS_RANGE_BYTES ((size_t) 1 << 33)
+
+// Guard pages before the lowest and after the highest addressable byte
+#define GUARD_PAGES 2
+
+
+static struct sigaction previous_segv_action, previous_bus_action;
+static bool handler_installed = false;
+
+static volatile sig_atomic_t fault_address;
+static sigjmp_buf *volatile armed_recovery = NULL;
+static char *volatile armed_memory, *volatile armed_reservation;
+
+
+static size_t page_size() {
+    return (size_t) sysconf(_SC_PAGESIZE);
+}
+
+static size_t reservation_size() {
+    return 2 * ADDRESS_RANGE_BYTES + 2 * GUARD_PAGES * page_size();
+}
+
+// Bytes committed for `memory_size` slots, which is a whole amount of pages
+static size_t committed_size(size_t memory_size) {
+    size_t page = page_size();
+    return (memory_size * sizeof(int32_t) + page - 1) / page * page;
+}
+
+// The start of the reservation that `memory` was placed in
+static char* reservation_of(int32_t *memory, size_t memory_size) {
+    char *committed_start = (char*) memory - (committed_size(memory_size) - memory_size * sizeof(int32_t));
+    return committed_start - ADDRESS_RANGE_BYTES - GUARD_PAGES * page_size();
+}
+
+
+static void handle_fault(int signal, siginfo_t *info, void *ucontext) {
+    (void) ucontext;
+    char *address = info->si_addr;
+    sigjmp_buf *recovery = armed_recovery;
+    if (recovery && address >= armed_reservation && address < armed_reservation + reservation_size()) {
+        fault_address = (int32_t) ((address - armed_memory) / (ptrdiff_t) sizeof(int32_t));
+        armed_recovery = NULL;
+        siglongjmp(*recovery, 1);
+    }
+
+    // Not a program memory access, so hand the fault to the previous handler when the access faults again
+    sigaction(signal, signal == SIGSEGV ? &previous_segv_action : &previous_bus_action, NULL);
+}
+
+
+static void install_handler() {
+    struct sigaction action = {0};
+    action.sa_sigaction = handle_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previous_segv_action);
+    sigaction(SIGBUS, &action, &previous_bus_action);
+    handler_installed = true;
+}
+
+
+int32_t* guard_memory_allocate(size_t memory_size) {
+    if (memory_size > (size_t) INT32_MAX) {
+        return NULL;
+    }
+    char *reservation = mmap(NULL, reservation_size(), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reservation == MAP_FAILED) {
+        return NULL;
+    }
+
+    char *committed_start = reservation + GUARD_PAGES * page_size() + ADDRESS_RANGE_BYTES;
+    size_t committed = committed_size(memory_size);
+    if (committed && mprotect(committed_start, committed, PROT_READ | PROT_WRITE) != 0) {
+        munmap(reservation, reservation_size());
+        return NULL;
+    }
+
+    if (!handler_installed) {
+        install_handler();
+    }
+    return (int32_t*) (committed_start + committed - memory_size * sizeof(int32_t));
+}
+
+
+void guard_memory_free(int32_t *memory, size_t memory_size) {
+    if (memory) {
+        munmap(reservation_of(memory, memory_size), reservation_size());
+    }
+}
+
+
+bool guard_memory_is_exact(size_t memory_size) {
+    return committed_size(memory_size) == memory_size * sizeof(int32_t);
+}
+
+
+void guard_memory_arm(int32_t *memory, size_t memory_size, sigjmp_buf *recovery) {
+    armed_memory = (char*) memory;
+    armed_reservation = reservation_of(memory, memory_size);
+    armed_recovery = recovery;
+}
+
+
+void guard_memory_disarm(void) {
+    armed_recovery = NULL;
+}
+
+
+int32_t guard_memory_fault_address(void) {
+    return fault_address;
+}
+
+#endif
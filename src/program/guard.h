@@ -0,0 +1,47 @@
+/*
+    Guard-page backed program memory.
+    Memory is placed inside a reservation that covers every int32 address,
+    so out of bounds accesses fault instead of needing bounds checks.
+*/
+
+#ifndef GUARD_HEADER
+#define GUARD_HEADER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#if defined(ENABLE_G1_GUARD_MEMORY) && !defined(_WIN32) && UINTPTR_MAX > UINT32_MAX
+    #define G1_GUARD_MEMORY
+    #include <setjmp.h>
+#endif
+
+#ifdef G1_GUARD_MEMORY
+
+/*
+Reserve the address range of a program memory and commit its first `memory_size` slots, which are zeroed on first use.
+The end of the memory lines up with a page boundary, so addresses from `memory_size` on fault. Negative addresses fault
+too, except for the ones within the partial page before slot 0 when `memory_size` isn't a multiple of the page size.
+Returns `NULL` if the memory couldn't be reserved.
+*/
+int32_t* guard_memory_allocate(size_t memory_size);
+
+void guard_memory_free(int32_t *memory, size_t memory_size);
+
+// Returns true if every out of bounds address of a memory with `memory_size` slots faults.
+bool guard_memory_is_exact(size_t memory_size);
+
+/*
+Until `guard_memory_disarm` is called, a fault inside the reservation of `memory` jumps to `recovery` with `siglongjmp`.
+Faults anywhere else crash as usual.
+*/
+void guard_memory_arm(int32_t *memory, size_t memory_size, sigjmp_buf *recovery);
+
+void guard_memory_disarm(void);
+
+// The address of the last fault that jumped to a recovery point.
+int32_t guard_memory_fault_address(void);
+
+#endif
+
+#endif
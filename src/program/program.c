@@ -8,12 +8,25 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include "instruction.h"
+#include "decode.h"
+#include "verify.h"
+#include "threaded.h"
 #include "program.h"
+#include "guard.h"
+
+// Signatures of g1b files. Versioned files have a uint16 version after the signature, the rest is the same.
+#define G1B_SIGNATURE 0x6731            // "g1", a version 1 program
+#define G1B_VERSIONED_SIGNATURE 0x6756  // "gV"
 
 
 // Allocates memory for the program and records it in `program_context`
 int init_program_context(ProgramContext *program_context, int32_t memory_size) {
-    program_context->memory = calloc(memory_size, sizeof(int32_t));
+    #ifdef G1_GUARD_MEMORY
+        program_context->memory = memory_size >= 0 ? guard_memory_allocate(memory_size) : NULL;
+        program_context->memory_guarded = memory_size >= 0 && guard_memory_is_exact(memory_size);
+    #else
+        program_context->memory = calloc(memory_size, sizeof(int32_t));
+    #endif
     program_context->memory_size = memory_size;
     if (!program_context->memory) {
         printf("Failed to allocate program memory.\n");
@@ -23,6 +36,63 @@ int init_program_context(ProgramContext *program_context, int32_t memory_size) {
 }
 
 
+void free_program_memory(ProgramContext *program_context) {
+    #ifdef G1_GUARD_MEMORY
+        guard_memory_free(program_context->memory, program_context->memory_size);
+    #else
+        free(program_context->memory);
+    #endif
+    program_context->memory = NULL;
+}
+
+
+// Returns true if the program's instruction set version is one that can be run
+static bool check_version(int32_t version) {
+    if (version < G1_VERSION_BASE || version > G1_LATEST_VERSION) {
+        printf("Unsupported program version %d, the latest supported version is %d.\n", version, G1_LATEST_VERSION);
+        return false;
+    }
+    return true;
+}
+
+
+/*
+Decode the parsed `instructions` of `program_data`, which needs its metadata and entrypoints to be set, and lay them
+out as the threaded code the interpreter runs. The parsed instructions are freed, and so are the decoded ones unless
+compiled code needs them.
+*/
+static int decode_program(ProgramData *program_data, InstructionList *instructions) {
+    ProgramInfo program_info = {
+        program_data->memory_size, program_data->width, program_data->height, program_data->tickrate,
+        program_data->start_index, program_data->tick_index
+    };
+    DecodedInstruction *decoded_instructions = decode_instructions(
+        instructions, program_data->instruction_count, &program_info, &program_data->decoded_count,
+        &program_data->counted_loops, &program_data->jump_tables
+    );
+    free_instructions(instructions);
+    if (!decoded_instructions) {
+        return -1;
+    }
+
+    // The checked interpreter skips the checks the verifier proves always pass
+    #ifdef ENABLE_G1_RUNTIME_ERRORS
+        verify_instructions(
+            decoded_instructions, program_data->instruction_count, program_data->decoded_count,
+            program_data->memory_size, program_data->start_index, program_data->tick_index
+        );
+    #endif
+    int thread_response = thread_instructions(decoded_instructions, program_data->decoded_count, &program_data->threaded_code);
+
+    #ifdef ENABLE_G1_JIT
+        program_data->decoded_instructions = decoded_instructions;
+    #else
+        free(decoded_instructions);
+    #endif
+    return thread_response;
+}
+
+
 // Load all data entries from `data_array` into memory
 void add_data_entries_json(ProgramContext* program_context, cJSON* data_array) {
     if (data_array == NULL) {
@@ -53,24 +123,31 @@ int init_program_state_json(ProgramState *program_state, cJSON *program_data_jso
         printf("JSON instructions object is not an array.\n");
         return -2;
     }
-    size_t instruction_count = cJSON_GetArraySize(instructions_json);
-    Instruction *instructions = parse_instructions_json(instructions_json);
-    if (!instructions) {
+    ProgramData *program_data = program_state->data;
+    cJSON *meta = cJSON_GetObjectItem(program_data_json, "meta");
+    program_data->memory_size = get_json_int(meta, "memory");
+    program_data->width = get_json_int(meta, "width");
+    program_data->height = get_json_int(meta, "height");
+    program_data->tickrate = get_json_int(meta, "tickrate");
+
+    // Programs without a version are written for the original instruction set
+    program_data->version = cJSON_GetObjectItem(meta, "version") ? get_json_int(meta, "version") : G1_VERSION_BASE;
+    if (!check_version(program_data->version)) {
         return -3;
     }
 
-    ProgramData *program_data = program_state->data;
-    program_data->instruction_count = instruction_count;
-    program_data->instructions = instructions;
+    InstructionList instructions;
+    if (parse_instructions_json(instructions_json, program_data->version, &instructions) < 0) {
+        return -3;
+    }
+    program_data->instruction_count = cJSON_GetArraySize(instructions_json);
 
     program_data->start_index = get_json_int(program_data_json, "start");
     program_data->tick_index = get_json_int(program_data_json, "tick");
 
-    cJSON *meta = cJSON_GetObjectItem(program_data_json, "meta");
-    program_data->memory_size = get_json_int(meta, "memory");
-    program_data->width = get_json_int(meta, "width");
-    program_data->height = get_json_int(meta, "height");
-    program_data->tickrate = get_json_int(meta, "tickrate");
+    if (decode_program(program_data, &instructions) < 0) {
+        return -3;
+    }
 
     int program_context_response = init_program_context(program_state->context, program_data->memory_size);
     if (program_context_response < 0) {
@@ -106,15 +183,25 @@ int init_program_state_binary(ProgramState *program_state, byte *program_bytes,
     uint16_t u16_buffer = 0;
     uint32_t u32_buffer = 0;
 
-    // Check for "g1" signature
+    // Check for the "g1" signature, or the versioned signature followed by the version
+    ProgramData *program_data = program_state->data;
     uint16_t signature;
     bi_next_n(&signature, &iter, 2);
-    if (signature != 0x6731) {
+    if (signature == G1B_SIGNATURE) {
+        program_data->version = G1_VERSION_BASE;
+    }
+    else if (signature == G1B_VERSIONED_SIGNATURE) {
+        bi_next_n(&u16_buffer, &iter, 2);
+        program_data->version = (int32_t) u16_buffer;
+        if (!check_version(program_data->version)) {
+            return -2;
+        }
+    }
+    else {
         return -1;
     }
 
     // Get program metadata
-    ProgramData *program_data = program_state->data;
     bi_next_n(&program_data->memory_size, &iter, 4);
     bi_next_n(&u16_buffer, &iter, 2);
     program_data->width = (uint32_t) u16_buffer;
@@ -128,11 +215,14 @@ int init_program_state_binary(ProgramState *program_state, byte *program_bytes,
     // Create instructions
     bi_next_n(&u32_buffer, &iter, 4);
     program_data->instruction_count = (size_t) u32_buffer;
-    Instruction* instructions = parse_instructions_binary(program_data->instruction_count, &iter);
-    if (!instructions) {
+    InstructionList instructions;
+    if (parse_instructions_binary(program_data->instruction_count, program_data->version, &iter, &instructions) < 0) {
+        return -2;
+    }
+
+    if (decode_program(program_data, &instructions) < 0) {
         return -2;
     }
-    program_data->instructions = instructions;
 
     // Set data entries
     uint32_t data_entry_count;
@@ -10,28 +10,72 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include "instruction.h"
+#include "decode.h"
+#include "threaded.h"
+#include "idiom.h"
+#include "jump_table.h"
 #include "audio_defs.h"
+#include "dirty_tiles.h"
+#include "draw_buffer.h"
 
 
 // Stores static information about a program. (instructions, program metadata, etc.)
 typedef struct {
     size_t instruction_count;
-    Instruction *instructions;
+    ThreadedCode threaded_code;  // The instructions the interpreter runs
+    DecodedInstruction *decoded_instructions;  // Only kept in `ENABLE_G1_JIT` builds, which compile from them
+    size_t decoded_count;  // Length of `decoded_instructions` and `threaded_code`, see `decode_instructions`
+    CountedLoopList counted_loops;
+    JumpTableList jump_tables;
+    const void *handler_owner;  // The interpreter whose handlers are stored in `threaded_code`
+    struct JitCode *jit_code;  // Only used in `ENABLE_G1_JIT` builds
+    bool jit_failed;
 
     int32_t start_index, tick_index;
     int32_t memory_size, width, height, tickrate;
+    int32_t version;  // Instruction set version, see `G1_VERSION_BASE`
 
 } ProgramData;
 
+
+// Frames on the hidden return stack of `call` and `ret`
+#define CALL_STACK_SIZE 1024
+
+/*
+A return to instruction `address`, which is where the program sees it return to.
+`target` is the decoded instruction that continues from there, which may be in the optimized code.
+*/
+typedef struct {
+    int32_t address, target;
+} CallFrame;
+
 // Stores dynamic information about a program. (memory, program counter, etc.)
 typedef struct {
     size_t program_counter;
     size_t memory_size;  // Also store memory size here so we can do bounds checks
     int32_t *memory;
+    bool memory_guarded;  // Every out of bounds access to `memory` faults, see `guard.h`
+    bool runtime_errors;  // Run with the checked interpreter
+
+    // Threads are suspended after running about this many instructions, and resumed on the next frame. 0 means no limit.
+    // `thread_suspended` is set while a thread waits to be resumed, and `budget_overruns` counts the suspensions,
+    // which are reported when the program exits.
+    int64_t instruction_budget;
+    bool thread_suspended;
+    bool resume_slow_path;  // The suspended thread stopped in the checked interpreter's slow path
+    uint64_t budget_overruns;
+
+    // Return stack of the running thread, which starts empty in every thread
+    CallFrame call_stack[CALL_STACK_SIZE];
+    uint32_t call_depth;
 
     SDL_Window *win;
     SDL_Renderer *renderer;
     SDL_Surface *render_surface;
+    SDL_Texture *present_texture;  // Streaming texture the CPU renderer copies `render_surface` to every frame
+    DirtyTiles dirty_tiles;        // Parts of `render_surface` that changed since they were copied to `present_texture`
+    DrawBuffer draw_buffer;        // Draws recorded in deferred mode, see `draw_buffer.h`
+    bool deferred_drawing;
     TTF_Font *font;
     Uint32 color;
 
@@ -49,6 +93,9 @@ typedef struct {
 } ProgramState;
 
 
+// Free the memory allocated for the program by `init_program_context`.
+void free_program_memory(ProgramContext *program_context);
+
 // Initialize `program_state` from JSON format.
 int init_program_state_json(ProgramState *program_state, cJSON *program_data_json);
 
@@ -6,6 +6,19 @@
 #define RENDER_CPU_PRIMITIVES_HEADER
 
 #include <SDL2/SDL.h>
+#include "dirty_tiles.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    #include <immintrin.h>
+#endif
+
+
+// Mark `rect` as changed if the surface tracks its changes, see `dirty_tiles.h`.
+static inline void __mark_dirty(SDL_Surface *surf, SDL_Rect rect) {
+    if (surf->userdata) {
+        dirty_tiles_mark((DirtyTiles*) surf->userdata, rect);
+    }
+}
 
 
 // Draw a single pixel.
@@ -17,21 +30,25 @@ static inline void surf_draw_point(SDL_Surface *surf, int x, int y, Uint32 color
 
     Uint32 *pixels = (Uint32*) surf->pixels;
     pixels[y * surf->w + x] = color;
+    __mark_dirty(surf, (SDL_Rect) {x, y, 1, 1});
 }
 
 
 /*
 Return the rectangle created by the overlap between two other rectangles.
 Returns a zeroed struct if there is no intersection.
+Edges are computed in 64 bits, so rectangles that reach past the range of an int don't wrap around.
 */
 static inline SDL_Rect __get_rect_intersection(SDL_Rect a, SDL_Rect b) {
     // Find the leftmost right edge and the rightmost left edge
-    int left = (a.x > b.x) ? a.x : b.x;
-    int right = (a.x + a.w < b.x + b.w) ? (a.x + a.w) : (b.x + b.w);
+    int64_t a_right = (int64_t) a.x + a.w, b_right = (int64_t) b.x + b.w;
+    int64_t left = (a.x > b.x) ? a.x : b.x;
+    int64_t right = (a_right < b_right) ? a_right : b_right;
     
     // Find the highest bottom edge and the lowest top edge
-    int top = (a.y > b.y) ? a.y : b.y;
-    int bottom = (a.y + a.h < b.y + b.h) ? (a.y + a.h) : (b.y + b.h);
+    int64_t a_bottom = (int64_t) a.y + a.h, b_bottom = (int64_t) b.y + b.h;
+    int64_t top = (a.y > b.y) ? a.y : b.y;
+    int64_t bottom = (a_bottom < b_bottom) ? a_bottom : b_bottom;
     
     SDL_Rect result = {0};
 
@@ -47,6 +64,26 @@ static inline SDL_Rect __get_rect_intersection(SDL_Rect a, SDL_Rect b) {
 }
 
 
+// Fill `count` pixels starting at `row` with `color`, a vector at a time where the compiler targets SSE2 or AVX2.
+static inline void __fill_row(Uint32 *row, size_t count, Uint32 color) {
+    size_t i = 0;
+    #if defined(__AVX2__)
+        __m256i colors = _mm256_set1_epi32((int) color);
+        for (; i + 8 <= count; i += 8) {
+            _mm256_storeu_si256((__m256i*) &row[i], colors);
+        }
+    #elif defined(__SSE2__)
+        __m128i colors = _mm_set1_epi32((int) color);
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_si128((__m128i*) &row[i], colors);
+        }
+    #endif
+    for (; i < count; i++) {
+        row[i] = color;
+    }
+}
+
+
 // Draw a filled rectangle.
 static inline void surf_draw_rect(SDL_Surface *surf, int x, int y, int width, int height, Uint32 color) {
     // Compute the intersection of the desired rect and the viewport rect
@@ -57,124 +94,353 @@ static inline void surf_draw_rect(SDL_Surface *surf, int x, int y, int width, in
         return;
     }
 
+    // Rows that span the whole surface are contiguous, so they're filled as one
     Uint32 *pixels = (Uint32*) surf->pixels;
-    for (Uint32 i = draw_rect.y; i < draw_rect.y+draw_rect.h; i++) {
-        for (Uint32 j = draw_rect.x; j < draw_rect.x+draw_rect.w; j++) {
-            pixels[i * surf->w + j] = color;
+    if (draw_rect.w == surf->w) {
+        __fill_row(&pixels[(size_t) draw_rect.y * surf->w], (size_t) draw_rect.w * draw_rect.h, color);
+    }
+    else {
+        for (int i = draw_rect.y; i < draw_rect.y+draw_rect.h; i++) {
+            __fill_row(&pixels[(size_t) i * surf->w + draw_rect.x], draw_rect.w, color);
         }
     }
+    __mark_dirty(surf, draw_rect);
 }
 
 
-// Region codes for Cohen-Sutherland
-#define CS_INSIDE 0
-#define CS_LEFT   1
-#define CS_RIGHT  2
-#define CS_BOTTOM 4
-#define CS_TOP    8
+// Division rounding toward negative and positive infinity. `b` must be positive.
+static inline int64_t __floor_div(int64_t a, int64_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static inline int64_t __ceil_div(int64_t a, int64_t b) {
+    return -__floor_div(-a, b);
+}
 
-// Helper to compute the region code for a point (x, y)
-static inline int compute_region_code(int x, int y, int w, int h) {
-    int code = CS_INSIDE;
 
-    if (x < 0)           code |= CS_LEFT;
-    else if (x >= w)     code |= CS_RIGHT;
-    if (y < 0)           code |= CS_BOTTOM;
-    else if (y >= h)     code |= CS_TOP;
+// Vertex coordinates are clamped to this so edge functions on doubled coordinates fit in 64 bits
+#define TRIANGLE_COORDINATE_LIMIT (1 << 24)
 
-    return code;
+static inline int64_t __clamp_coordinate(int32_t value) {
+    return value < -TRIANGLE_COORDINATE_LIMIT ? -TRIANGLE_COORDINATE_LIMIT : (value > TRIANGLE_COORDINATE_LIMIT ? TRIANGLE_COORDINATE_LIMIT : value);
 }
 
-static inline int surf_clip_line(SDL_Surface* surf, int* x1, int* y1, int* x2, int* y2) {
-    int w = surf->w;
-    int h = surf->h;
-    
-    int code1 = compute_region_code(*x1, *y1, w, h);
-    int code2 = compute_region_code(*x2, *y2, w, h);
-    int accept = 0;
-
-    while (true) {
-        if (!(code1 | code2)) {
-            // Both points inside window
-            accept = 1;
-            break;
-        }
-        else if (code1 & code2) {
-            // Both points share an outside region (completely outside)
-            break;
-        }
-        else {
-            // Some segment is inside; calculate intersection
-            int code_out = code1 ? code1 : code2;
-            int x, y;
-
-            // Standard line-intersection formulas
-            if (code_out & CS_TOP) {
-                x = *x1 + (*x2 - *x1) * (h - 1 - *y1) / (*y2 - *y1);
-                y = h - 1;
-            }
-            else if (code_out & CS_BOTTOM) {
-                x = *x1 + (*x2 - *x1) * (0 - *y1) / (*y2 - *y1);
-                y = 0;
+/*
+Draw a filled triangle. A pixel is drawn if its center is inside the triangle, or on a top or left edge,
+so triangles sharing an edge never both draw a pixel on it.
+*/
+static inline void surf_draw_triangle(SDL_Surface *surf, const int32_t *points, Uint32 color) {
+    // Work with doubled coordinates, so pixel centers are at odd integers
+    int64_t xs[3], ys[3];
+    for (int i = 0; i < 3; i++) {
+        xs[i] = 2 * __clamp_coordinate(points[i*2]);
+        ys[i] = 2 * __clamp_coordinate(points[i*2 + 1]);
+    }
+
+    // Wind the triangle so the inside of each edge is on the side where its edge function is positive
+    int64_t area = (xs[1] - xs[0]) * (ys[2] - ys[0]) - (ys[1] - ys[0]) * (xs[2] - xs[0]);
+    if (area == 0) {
+        return;
+    }
+    if (area < 0) {
+        int64_t x = xs[1], y = ys[1];
+        xs[1] = xs[2]; ys[1] = ys[2];
+        xs[2] = x; ys[2] = y;
+    }
+
+    int64_t top = ys[0], bottom = ys[0];
+    for (int i = 1; i < 3; i++) {
+        top = ys[i] < top ? ys[i] : top;
+        bottom = ys[i] > bottom ? ys[i] : bottom;
+    }
+    int first_row = top / 2 < 0 ? 0 : top / 2;
+    int last_row = bottom / 2 >= surf->h ? surf->h - 1 : bottom / 2;
+
+    Uint32 *pixels = (Uint32*) surf->pixels;
+    int64_t drawn_left = surf->w, drawn_right = -1;
+    for (int y = first_row; y <= last_row; y++) {
+        int64_t center_y = 2 * y + 1;
+        int64_t left = 0, right = surf->w - 1;
+
+        // Narrow the row to the columns inside every edge
+        for (int i = 0; i < 3 && left <= right; i++) {
+            int64_t ax = xs[i], ay = ys[i], bx = xs[(i+1) % 3], by = ys[(i+1) % 3];
+            int64_t dx = bx - ax, dy = by - ay;
+
+            // The edge function is `c - dy * center_x`, and must be at least `bias`
+            int64_t c = dx * (center_y - ay) + dy * ax;
+            bool top_left = dy < 0 || (dy == 0 && dx > 0);
+            int64_t bias = top_left ? 0 : 1;
+            if (dy == 0) {
+                right = c >= bias ? right : -1;
             }
-            else if (code_out & CS_RIGHT) {
-                y = *y1 + (*y2 - *y1) * (w - 1 - *x1) / (*x2 - *x1);
-                x = w - 1;
+            else if (dy > 0) {
+                int64_t last = __floor_div(__floor_div(c - bias, dy) - 1, 2);
+                right = last < right ? last : right;
             }
-            else if (code_out & CS_LEFT) {
-                y = *y1 + (*y2 - *y1) * (0 - *x1) / (*x2 - *x1);
-                x = 0;
+            else {
+                int64_t first = __ceil_div(__ceil_div(bias - c, -dy) - 1, 2);
+                left = first > left ? first : left;
             }
+        }
+
+        if (left <= right) {
+            __fill_row(&pixels[y * surf->w + left], right - left + 1, color);
+            drawn_left = left < drawn_left ? left : drawn_left;
+            drawn_right = right > drawn_right ? right : drawn_right;
+        }
+    }
+
+    if (drawn_left <= drawn_right) {
+        __mark_dirty(surf, (SDL_Rect) {drawn_left, first_row, drawn_right - drawn_left + 1, last_row - first_row + 1});
+    }
+}
+
+
+// Convert a color packed like `getp` returns it, `r | g << 8 | b << 16`, to a pixel of `format`.
+static inline Uint32 surf_map_packed(const SDL_PixelFormat *format, int32_t packed) {
+    Uint32 r = packed & 0xff, g = (packed >> 8) & 0xff, b = (packed >> 16) & 0xff;
+    return (r << format->Rshift) | (g << format->Gshift) | (b << format->Bshift) | format->Amask;
+}
+
+
+/*
+Draw a `width` by `height` image of packed colors with its top left corner at (`x`, `y`).
+If `keyed` is set, pixels of color `key` are left as they are.
+*/
+static inline void surf_blit_packed(SDL_Surface *surf, int x, int y, int width, int height, const int32_t *image, bool keyed, int32_t key) {
+    SDL_Rect draw_rect = __get_rect_intersection((SDL_Rect) {x, y, width, height}, (SDL_Rect) {0, 0, surf->w, surf->h});
+    if (!draw_rect.w) {
+        return;
+    }
 
-            // Replace outside point with intersection point
-            if (code_out == code1) {
-                *x1 = x;
-                *y1 = y;
-                code1 = compute_region_code(*x1, *y1, w, h);
+    const SDL_PixelFormat *format = surf->format;
+    Uint32 *pixels = (Uint32*) surf->pixels;
+    for (int i = 0; i < draw_rect.h; i++) {
+        const int32_t *source = &image[(size_t) ((int64_t) draw_rect.y - y + i) * width + ((int64_t) draw_rect.x - x)];
+        Uint32 *row = &pixels[(draw_rect.y + i) * surf->w + draw_rect.x];
+        if (keyed) {
+            for (int j = 0; j < draw_rect.w; j++) {
+                row[j] = source[j] == key ? row[j] : surf_map_packed(format, source[j]);
             }
-            else {
-                *x2 = x;
-                *y2 = y;
-                code2 = compute_region_code(*x2, *y2, w, h);
+        }
+        else {
+            for (int j = 0; j < draw_rect.w; j++) {
+                row[j] = surf_map_packed(format, source[j]);
+            }
+        }
+    }
+    __mark_dirty(surf, draw_rect);
+}
+
+
+/*
+Copy the `width` by `height` rectangle at (`source_x`, `source_y`) so its top left corner is at (`x`, `y`).
+Only the part that is on the surface at both ends is copied, and the two rectangles may overlap.
+*/
+static inline void surf_copy_rect(SDL_Surface *surf, int source_x, int source_y, int width, int height, int x, int y) {
+    SDL_Rect bounds = {0, 0, surf->w, surf->h};
+    SDL_Rect source_rect = __get_rect_intersection((SDL_Rect) {source_x, source_y, width, height}, bounds);
+    if (!source_rect.w) {
+        return;
+    }
+
+    // Move the clipped source to the destination and clip it again, then bring the source along.
+    // Moving by the size of the surface or more always leaves it, and smaller offsets can't overflow.
+    int64_t offset_x = (int64_t) x - source_x, offset_y = (int64_t) y - source_y;
+    if (offset_x <= -surf->w || offset_x >= surf->w || offset_y <= -surf->h || offset_y >= surf->h) {
+        return;
+    }
+    SDL_Rect draw_rect = __get_rect_intersection((SDL_Rect) {source_rect.x + offset_x, source_rect.y + offset_y, source_rect.w, source_rect.h}, bounds);
+    if (!draw_rect.w || (!offset_x && !offset_y)) {
+        return;
+    }
+    source_rect.x = draw_rect.x - offset_x;
+    source_rect.y = draw_rect.y - offset_y;
+
+    // Copy rows bottom up when moving down, so rows aren't overwritten before they're copied
+    Uint32 *pixels = (Uint32*) surf->pixels;
+    size_t row_size = sizeof(Uint32) * draw_rect.w;
+    for (int i = 0; i < draw_rect.h; i++) {
+        int row = offset_y > 0 ? draw_rect.h - 1 - i : i;
+        memmove(&pixels[(draw_rect.y + row) * surf->w + draw_rect.x], &pixels[(source_rect.y + row) * surf->w + source_rect.x], row_size);
+    }
+    __mark_dirty(surf, draw_rect);
+}
+
+
+// Draw the pixels from `x1` to `x2` on row `y`, in either order, that are on the surface.
+static inline void __draw_horizontal_line(SDL_Surface *surf, int64_t x1, int64_t x2, int64_t y, Uint32 color) {
+    int64_t left = x1 < x2 ? x1 : x2, right = x1 < x2 ? x2 : x1;
+    left = left < 0 ? 0 : left;
+    right = right >= surf->w ? surf->w - 1 : right;
+    if (y < 0 || y >= surf->h || left > right) {
+        return;
+    }
+
+    Uint32 *pixels = (Uint32*) surf->pixels;
+    __fill_row(&pixels[y * surf->w + left], right - left + 1, color);
+    __mark_dirty(surf, (SDL_Rect) {left, y, right - left + 1, 1});
+}
+
+// Draw the pixels from `y1` to `y2` on column `x`, in either order, that are on the surface.
+static inline void __draw_vertical_line(SDL_Surface *surf, int64_t x, int64_t y1, int64_t y2, Uint32 color) {
+    int64_t top = y1 < y2 ? y1 : y2, bottom = y1 < y2 ? y2 : y1;
+    top = top < 0 ? 0 : top;
+    bottom = bottom >= surf->h ? surf->h - 1 : bottom;
+    if (x < 0 || x >= surf->w || top > bottom) {
+        return;
+    }
+
+    Uint32 *pixel = &((Uint32*) surf->pixels)[top * surf->w + x];
+    for (int64_t i = top; i <= bottom; i++, pixel += surf->w) {
+        *pixel = color;
+    }
+    __mark_dirty(surf, (SDL_Rect) {x, top, 1, bottom - top + 1});
+}
+
+
+// Lines reaching further than this from the origin are cut at it, so their Bresenham terms fit in 64 bits
+#define LINE_COORDINATE_LIMIT (1 << 24)
+
+static inline int64_t __round_to_int64(double value) {
+    return (int64_t) (value < 0 ? value - 0.5 : value + 0.5);
+}
+
+/*
+Cut the line from (`x1`, `y1`) to (`x2`, `y2`) to the part inside `LINE_COORDINATE_LIMIT` of the origin,
+Liang-Barsky style. Returns false if none of it is inside.
+*/
+static inline bool __limit_line(int64_t *x1, int64_t *y1, int64_t *x2, int64_t *y2) {
+    double start = 0, end = 1;
+    double dx = (double) (*x2 - *x1), dy = (double) (*y2 - *y1);
+    double directions[4] = {-dx, dx, -dy, dy};
+    double distances[4] = {*x1 + LINE_COORDINATE_LIMIT, LINE_COORDINATE_LIMIT - *x1, *y1 + LINE_COORDINATE_LIMIT, LINE_COORDINATE_LIMIT - *y1};
+    for (int i = 0; i < 4; i++) {
+        if (directions[i] == 0) {
+            if (distances[i] < 0) {
+                return false;
             }
+            continue;
+        }
+        double t = distances[i] / directions[i];
+        if (directions[i] < 0) {
+            start = t > start ? t : start;
+        }
+        else {
+            end = t < end ? t : end;
         }
     }
+    if (start > end) {
+        return false;
+    }
 
-    return accept;
+    int64_t start_x = *x1, start_y = *y1;
+    *x1 = __round_to_int64(start_x + start * dx);
+    *y1 = __round_to_int64(start_y + start * dy);
+    *x2 = __round_to_int64(start_x + end * dx);
+    *y2 = __round_to_int64(start_y + end * dy);
+    return true;
 }
 
-// Draw a line.
+
+/*
+Draw a line, the same pixels a Bresenham walk from (`x1`, `y1`) to (`x2`, `y2`) visits.
+
+Along the major axis the walk takes one step per pixel, and after `i` steps it has taken
+ceil((2 * minor * i - major) / (2 * major)) steps along the minor axis, where `major` and `minor` are the
+line's lengths along each axis. That finds where each row or column of the line starts directly, so lines
+that run mostly horizontally are drawn as a row fill per row and steep lines as one store per row,
+and the rows off the surface are skipped without walking them.
+*/
 static inline void surf_draw_line(SDL_Surface* surf, int x1, int y1, int x2, int y2, Uint32 color) {
-    if (!surf_clip_line(surf, &x1, &y1, &x2, &y2)) {
+    int64_t start_x = x1, start_y = y1, end_x = x2, end_y = y2;
+    if (y1 == y2) {
+        __draw_horizontal_line(surf, start_x, end_x, start_y, color);
+        return;
+    }
+    if (x1 == x2) {
+        __draw_vertical_line(surf, start_x, start_y, end_y, color);
+        return;
+    }
+
+    bool limited = start_x < -LINE_COORDINATE_LIMIT || start_x > LINE_COORDINATE_LIMIT || start_y < -LINE_COORDINATE_LIMIT || start_y > LINE_COORDINATE_LIMIT
+        || end_x < -LINE_COORDINATE_LIMIT || end_x > LINE_COORDINATE_LIMIT || end_y < -LINE_COORDINATE_LIMIT || end_y > LINE_COORDINATE_LIMIT;
+    if (limited) {
+        if (!__limit_line(&start_x, &start_y, &end_x, &end_y)) {
+            return;
+        }
+        if (start_y == end_y || start_x == end_x) {
+            surf_draw_line(surf, start_x, start_y, end_x, end_y, color);
+            return;
+        }
+    }
+
+    int64_t dx = end_x > start_x ? end_x - start_x : start_x - end_x;
+    int64_t dy = end_y > start_y ? end_y - start_y : start_y - end_y;
+    int64_t sx = start_x < end_x ? 1 : -1;
+    int64_t sy = start_y < end_y ? 1 : -1;
+
+    // Steps along each axis that land on the surface
+    int64_t first_x = sx > 0 ? -start_x : start_x - (surf->w - 1);
+    int64_t last_x = sx > 0 ? surf->w - 1 - start_x : start_x;
+    int64_t first_y = sy > 0 ? -start_y : start_y - (surf->h - 1);
+    int64_t last_y = sy > 0 ? surf->h - 1 - start_y : start_y;
+    first_x = first_x < 0 ? 0 : first_x;
+    first_y = first_y < 0 ? 0 : first_y;
+    last_x = last_x > dx ? dx : last_x;
+    last_y = last_y > dy ? dy : last_y;
+    if (first_x > last_x || first_y > last_y) {
         return;
     }
 
     Uint32 *pixels = (Uint32*) surf->pixels;
-    
-    int dx = abs(x2 - x1);
-    int dy = abs(y2 - y1);
-    int sx = (x1 < x2) ? 1 : -1;
-    int sy = (y1 < y2) ? 1 : -1;
-    int err = dx - dy;
-    
-    while (1) {
-        pixels[y1 * surf->w + x1] = color;
+    int64_t drawn_left = surf->w, drawn_right = -1, drawn_top = surf->h, drawn_bottom = -1;
+    if (dx >= dy) {
+        // Only the rows the columns on the surface reach
+        int64_t first_row = __ceil_div(2 * dy * first_x - dx, 2 * dx), last_row = __ceil_div(2 * dy * last_x - dx, 2 * dx);
+        first_y = first_row > first_y ? first_row : first_y;
+        last_y = last_row < last_y ? last_row : last_y;
 
-        if (x1 == x2 && y1 == y2) {
-            break;
-        }
+        for (int64_t j = first_y; j <= last_y; j++) {
+            // The row is the columns from the one after the last step onto row `j` to the one before the step off it
+            int64_t first = j == 0 ? 0 : __floor_div(2 * dx * j - dx, 2 * dy) + 1;
+            int64_t last = __floor_div(2 * dx * (j + 1) - dx, 2 * dy);
+            first = first < first_x ? first_x : first;
+            last = last > last_x ? last_x : last;
+            if (first > last) {
+                continue;
+            }
 
-        int e2 = 2 * err;
-        if (e2 > -dy) {
-            err -= dy;
-            x1 += sx;
+            int64_t left = sx > 0 ? start_x + first : start_x - last;
+            int64_t y = start_y + sy * j;
+            __fill_row(&pixels[y * surf->w + left], last - first + 1, color);
+            drawn_left = left < drawn_left ? left : drawn_left;
+            drawn_right = left + last - first > drawn_right ? left + last - first : drawn_right;
+            drawn_top = y < drawn_top ? y : drawn_top;
+            drawn_bottom = y > drawn_bottom ? y : drawn_bottom;
         }
-        if (e2 < dx) {
-            err += dx;
-            y1 += sy;
+    }
+    else {
+        for (int64_t j = first_y; j <= last_y; j++) {
+            int64_t i = __ceil_div(2 * dx * j - dy, 2 * dy);
+            if (i < first_x || i > last_x) {
+                continue;
+            }
+
+            int64_t x = start_x + sx * i, y = start_y + sy * j;
+            pixels[y * surf->w + x] = color;
+            drawn_left = x < drawn_left ? x : drawn_left;
+            drawn_right = x > drawn_right ? x : drawn_right;
+            drawn_top = y < drawn_top ? y : drawn_top;
+            drawn_bottom = y > drawn_bottom ? y : drawn_bottom;
         }
     }
+
+    if (drawn_left <= drawn_right) {
+        __mark_dirty(surf, (SDL_Rect) {drawn_left, drawn_top, drawn_right - drawn_left + 1, drawn_bottom - drawn_top + 1});
+    }
 }
 
 
-#endif
\ No newline at end of file
+#endif
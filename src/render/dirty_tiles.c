@@ -0,0 +1,89 @@
+/*
+    Tracking of the parts of the render surface that changed since the last frame was presented.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "dirty_tiles.h"
+
+
+int dirty_tiles_init(DirtyTiles *dirty, int width, int height) {
+    dirty->columns = (width + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+    dirty->rows = (height + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+    dirty->tiles = malloc((size_t) dirty->columns * dirty->rows);
+    if (!dirty->tiles) {
+        return -1;
+    }
+    memset(dirty->tiles, 1, (size_t) dirty->columns * dirty->rows);
+    dirty->any = true;
+    return 0;
+}
+
+
+void dirty_tiles_free(DirtyTiles *dirty) {
+    free(dirty->tiles);
+    dirty->tiles = NULL;
+}
+
+
+// Upload the tiles from `column` and `row` spanning `columns` and `rows` tiles, clipped to the surface.
+static int upload_tiles(SDL_Surface *surf, SDL_Texture *texture, int column, int row, int columns, int rows) {
+    SDL_Rect rect = {column * DIRTY_TILE_SIZE, row * DIRTY_TILE_SIZE, columns * DIRTY_TILE_SIZE, rows * DIRTY_TILE_SIZE};
+    rect.w = rect.x + rect.w > surf->w ? surf->w - rect.x : rect.w;
+    rect.h = rect.y + rect.h > surf->h ? surf->h - rect.y : rect.h;
+    const Uint8 *pixels = (const Uint8*) surf->pixels + (size_t) rect.y * surf->pitch + (size_t) rect.x * sizeof(Uint32);
+    return SDL_UpdateTexture(texture, &rect, pixels, surf->pitch);
+}
+
+
+int dirty_tiles_upload(DirtyTiles *dirty, SDL_Surface *surf, SDL_Texture *texture) {
+    if (!dirty->any) {
+        return 0;
+    }
+
+    // Rectangles that may still grow downwards, as the first row of tiles they cover, indexed by their first column.
+    // A rectangle only grows if the next row of tiles has a run with exactly its span.
+    int *open_rows = malloc(sizeof(int) * dirty->columns);
+    int *open_widths = malloc(sizeof(int) * dirty->columns);
+    if (!open_rows || !open_widths) {
+        free(open_rows);
+        free(open_widths);
+        return upload_tiles(surf, texture, 0, 0, dirty->columns, dirty->rows);
+    }
+    for (int i = 0; i < dirty->columns; i++) {
+        open_widths[i] = 0;
+    }
+
+    int response = 0;
+    for (int row = 0; row <= dirty->rows; row++) {
+        const uint8_t *tiles = &dirty->tiles[row * dirty->columns];
+        int column = 0;
+        while (column < dirty->columns) {
+            // Find the run of marked tiles at `column`, past the end of the surface everything is unmarked
+            int width = 0;
+            while (row < dirty->rows && column + width < dirty->columns && tiles[column + width]) {
+                width++;
+            }
+
+            // Close every rectangle that started inside this run or over the gap before the next run
+            int end = column + (width ? width : 1);
+            for (int i = column; i < end; i++) {
+                if (open_widths[i] && !(i == column && open_widths[i] == width)) {
+                    response |= upload_tiles(surf, texture, i, open_rows[i], open_widths[i], row - open_rows[i]);
+                    open_widths[i] = 0;
+                }
+            }
+            if (width && !open_widths[column]) {
+                open_rows[column] = row;
+                open_widths[column] = width;
+            }
+            column = end;
+        }
+    }
+
+    free(open_rows);
+    free(open_widths);
+    memset(dirty->tiles, 0, (size_t) dirty->columns * dirty->rows);
+    dirty->any = false;
+    return response;
+}
@@ -0,0 +1,57 @@
+/*
+    Tracking of the parts of the render surface that changed since the last frame was presented.
+
+    The surface is split into `DIRTY_TILE_SIZE` by `DIRTY_TILE_SIZE` tiles with one flag each. A surface whose
+    `userdata` points at a `DirtyTiles` has its tiles marked by every primitive drawn on it, and presenting
+    uploads the marked tiles to the texture as rectangles, or nothing when no tile is marked.
+*/
+
+#ifndef RENDER_DIRTY_TILES_HEADER
+#define RENDER_DIRTY_TILES_HEADER
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#define DIRTY_TILE_SIZE 32
+
+
+typedef struct {
+    int columns, rows;
+    uint8_t *tiles;  // `columns` flags for each row of tiles, set if the tile changed
+    bool any;        // Set if any tile is marked
+} DirtyTiles;
+
+
+// Allocate the tiles for a `width` by `height` surface, all marked since the texture starts out undefined.
+int dirty_tiles_init(DirtyTiles *dirty, int width, int height);
+
+void dirty_tiles_free(DirtyTiles *dirty);
+
+/*
+Upload the marked tiles of `surf` to `texture` and unmark them. Marked tiles are merged into rectangles,
+first along each row of tiles and then with the same span of the rows below it.
+*/
+int dirty_tiles_upload(DirtyTiles *dirty, SDL_Surface *surf, SDL_Texture *texture);
+
+
+// Mark every tile `rect` touches. `rect` must not be empty, and is clamped to the surface.
+static inline void dirty_tiles_mark(DirtyTiles *dirty, SDL_Rect rect) {
+    int first_column = rect.x / DIRTY_TILE_SIZE, last_column = (rect.x + rect.w - 1) / DIRTY_TILE_SIZE;
+    int first_row = rect.y / DIRTY_TILE_SIZE, last_row = (rect.y + rect.h - 1) / DIRTY_TILE_SIZE;
+    first_column = first_column < 0 ? 0 : first_column;
+    first_row = first_row < 0 ? 0 : first_row;
+    last_column = last_column >= dirty->columns ? dirty->columns - 1 : last_column;
+    last_row = last_row >= dirty->rows ? dirty->rows - 1 : last_row;
+    if (first_column > last_column || first_row > last_row) {
+        return;
+    }
+
+    for (int i = first_row; i <= last_row; i++) {
+        memset(&dirty->tiles[i * dirty->columns + first_column], 1, last_column - first_column + 1);
+    }
+    dirty->any = true;
+}
+
+#endif
@@ -0,0 +1,129 @@
+/*
+    Deferred drawing for the CPU renderer.
+*/
+
+#include "draw_buffer.h"
+#include "cpu_primitives.h"
+
+
+int draw_buffer_init(DrawBuffer *buffer) {
+    buffer->commands = malloc(sizeof(DrawCommand) * DRAW_BUFFER_CAPACITY);
+    buffer->length = 0;
+    return buffer->commands ? 0 : -1;
+}
+
+
+void draw_buffer_free(DrawBuffer *buffer) {
+    free(buffer->commands);
+    buffer->commands = NULL;
+    buffer->length = 0;
+}
+
+
+// Clip the box from (`left`, `top`) to (`right`, `bottom`), inclusive, to `surf`. Returns false if none of it is on `surf`.
+static bool clip_box(SDL_Surface *surf, int64_t left, int64_t top, int64_t right, int64_t bottom, SDL_Rect *rect) {
+    left = left < 0 ? 0 : left;
+    top = top < 0 ? 0 : top;
+    right = right >= surf->w ? surf->w - 1 : right;
+    bottom = bottom >= surf->h ? surf->h - 1 : bottom;
+    if (left > right || top > bottom) {
+        return false;
+    }
+    *rect = (SDL_Rect) {left, top, right - left + 1, bottom - top + 1};
+    return true;
+}
+
+// Find the part of `surf` that `command` may draw on. Returns false if it can't draw anything.
+static bool draw_bounds(const DrawCommand *command, SDL_Surface *surf, SDL_Rect *bounds) {
+    const int32_t *args = command->args;
+    switch (command->kind) {
+        case DRAW_POINT:
+            return clip_box(surf, args[0], args[1], args[0], args[1], bounds);
+        case DRAW_LINE: {
+            int64_t left = args[0] < args[2] ? args[0] : args[2], right = args[0] < args[2] ? args[2] : args[0];
+            int64_t top = args[1] < args[3] ? args[1] : args[3], bottom = args[1] < args[3] ? args[3] : args[1];
+            return clip_box(surf, left, top, right, bottom, bounds);
+        }
+        case DRAW_RECT:
+            return clip_box(surf, args[0], args[1], (int64_t) args[0] + args[2] - 1, (int64_t) args[1] + args[3] - 1, bounds);
+        case DRAW_TRI: {
+            int64_t left = args[0], right = args[0], top = args[1], bottom = args[1];
+            for (int i = 2; i < 6; i += 2) {
+                left = args[i] < left ? args[i] : left;
+                right = args[i] > right ? args[i] : right;
+                top = args[i+1] < top ? args[i+1] : top;
+                bottom = args[i+1] > bottom ? args[i+1] : bottom;
+            }
+            return clip_box(surf, left, top, right, bottom, bounds);
+        }
+        default:
+            return false;
+    }
+}
+
+static bool contains(SDL_Rect outer, SDL_Rect inner) {
+    return inner.x >= outer.x && inner.y >= outer.y && inner.x + inner.w <= outer.x + outer.w && inner.y + inner.h <= outer.y + outer.h;
+}
+
+
+void draw_buffer_flush(DrawBuffer *buffer, SDL_Surface *surf) {
+    // Walk the draws backwards, dropping the ones the largest rects drawn after them cover.
+    // Rects draw every pixel they cover in one color, so nothing before them shows through.
+    SDL_Rect occluders[DRAW_OCCLUDER_COUNT];
+    int occluder_count = 0;
+    size_t first = 0;
+    for (size_t i = buffer->length; i-- > 0;) {
+        DrawCommand *command = &buffer->commands[i];
+        SDL_Rect bounds;
+        bool covered = !draw_bounds(command, surf, &bounds);
+        for (int j = 0; j < occluder_count && !covered; j++) {
+            covered = contains(occluders[j], bounds);
+        }
+        if (covered) {
+            command->kind = DRAW_CULLED;
+            continue;
+        }
+        if (command->kind != DRAW_RECT) {
+            continue;
+        }
+
+        // A clear hides everything before it
+        if (bounds.w == surf->w && bounds.h == surf->h) {
+            first = i;
+            break;
+        }
+        if (occluder_count < DRAW_OCCLUDER_COUNT) {
+            occluders[occluder_count++] = bounds;
+            continue;
+        }
+        int smallest = 0;
+        for (int j = 1; j < DRAW_OCCLUDER_COUNT; j++) {
+            if ((int64_t) occluders[j].w * occluders[j].h < (int64_t) occluders[smallest].w * occluders[smallest].h) {
+                smallest = j;
+            }
+        }
+        if ((int64_t) bounds.w * bounds.h > (int64_t) occluders[smallest].w * occluders[smallest].h) {
+            occluders[smallest] = bounds;
+        }
+    }
+
+    for (size_t i = first; i < buffer->length; i++) {
+        const DrawCommand *command = &buffer->commands[i];
+        const int32_t *args = command->args;
+        switch (command->kind) {
+            case DRAW_POINT:
+                surf_draw_point(surf, args[0], args[1], command->color);
+                break;
+            case DRAW_LINE:
+                surf_draw_line(surf, args[0], args[1], args[2], args[3], command->color);
+                break;
+            case DRAW_RECT:
+                surf_draw_rect(surf, args[0], args[1], args[2], args[3], command->color);
+                break;
+            case DRAW_TRI:
+                surf_draw_triangle(surf, args, command->color);
+                break;
+        }
+    }
+    buffer->length = 0;
+}
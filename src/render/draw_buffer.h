@@ -0,0 +1,64 @@
+/*
+    Deferred drawing for the CPU renderer.
+
+    In deferred mode, `point`, `line`, `rect` and `tri` are recorded instead of drawn. The recorded draws are
+    replayed in order when the frame is presented, or before anything else reads or draws on the surface,
+    so the surface ends up exactly as if they had been drawn right away. Before replaying, draws that a later
+    rect covers completely are dropped, and a rect that covers the whole surface drops everything before it.
+*/
+
+#ifndef RENDER_DRAW_BUFFER_HEADER
+#define RENDER_DRAW_BUFFER_HEADER
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <SDL2/SDL.h>
+
+#define DRAW_BUFFER_CAPACITY 65536  // Draws recorded before the buffer is replayed early
+
+#define DRAW_POINT 0
+#define DRAW_LINE 1
+#define DRAW_RECT 2
+#define DRAW_TRI 3
+#define DRAW_CULLED 4
+
+#define DRAW_MAX_ARGUMENTS 6
+#define DRAW_OCCLUDER_COUNT 8  // Later rects that earlier draws are checked against
+
+
+typedef struct {
+    uint8_t kind;
+    Uint32 color;
+    int32_t args[DRAW_MAX_ARGUMENTS];  // The arguments of the instruction, or the corners of a `tri`
+} DrawCommand;
+
+typedef struct {
+    DrawCommand *commands;
+    size_t length;
+} DrawBuffer;
+
+
+int draw_buffer_init(DrawBuffer *buffer);
+
+void draw_buffer_free(DrawBuffer *buffer);
+
+// Draw every recorded draw that isn't covered by a later one on `surf`, and empty the buffer.
+void draw_buffer_flush(DrawBuffer *buffer, SDL_Surface *surf);
+
+
+// Record a draw of `kind` with the first `count` of `args`, replaying the buffer first if it's full.
+static inline void draw_buffer_record(DrawBuffer *buffer, SDL_Surface *surf, uint8_t kind, Uint32 color, const int32_t *args, int count) {
+    if (buffer->length == DRAW_BUFFER_CAPACITY) {
+        draw_buffer_flush(buffer, surf);
+    }
+
+    DrawCommand *command = &buffer->commands[buffer->length++];
+    command->kind = kind;
+    command->color = color;
+    for (int i = 0; i < count; i++) {
+        command->args[i] = args[i];
+    }
+}
+
+#endif
@@ -13,6 +13,10 @@ void parse_flags(struct FlagData* flag_data, const char* flags) {
     flag_data->show_fps = false;
     flag_data->pixel_size = 1;
     flag_data->title[0] = '\0';
+    flag_data->unchecked = false;
+    flag_data->instruction_budget = 0;
+    flag_data->deferred = false;
+    flag_data->profile_path[0] = '\0';
 
     if (flags[0] == '\0') {  // No flags provided
         return;
@@ -66,6 +70,42 @@ void parse_flags(struct FlagData* flag_data, const char* flags) {
             
             safecat(flag_data->title, flag_buffer, TITLE_BUFFER_SIZE);
         }
+
+        // Unchecked flag
+        else if (strcmp(flag_buffer, "--unchecked") == 0 || strcmp(flag_buffer, "-u") == 0) {
+            flag_data->unchecked = true;
+        }
+
+        // Instruction budget flag
+        else if (strcmp(flag_buffer, "--budget") == 0 || strcmp(flag_buffer, "-b") == 0) {
+            ss_next_response = ss_next(flag_buffer, &ss, FLAG_BUFFER_SIZE);
+            if (ss_next_response != 0) {
+                printf("Expected a value for instruction budget flag.\n");
+                continue;
+            }
+            uint32_t possible_budget = atoi(flag_buffer);
+            if (possible_budget == 0) {
+                printf("Expected numeric or nonzero value for instruction budget flag.\n");
+                continue;
+            }
+            flag_data->instruction_budget = possible_budget;
+        }
+
+        // Deferred drawing flag
+        else if (strcmp(flag_buffer, "--deferred") == 0 || strcmp(flag_buffer, "-df") == 0) {
+            flag_data->deferred = true;
+        }
+
+        // Profile counts flag
+        else if (strcmp(flag_buffer, "--profile") == 0 || strcmp(flag_buffer, "-pf") == 0) {
+            ss_next_response = ss_next(flag_buffer, &ss, FLAG_BUFFER_SIZE);
+            if (ss_next_response != 0) {
+                printf("Expected a path for profile flag.\n");
+                continue;
+            }
+            flag_data->profile_path[0] = '\0';
+            safecat(flag_data->profile_path, flag_buffer, FLAG_BUFFER_SIZE);
+        }
         else {
             printf("Unrecognized flag \"%s\".\n", flag_buffer);
         }
@@ -15,6 +15,10 @@ struct FlagData {
     bool show_fps;
     uint32_t pixel_size;
     char title[TITLE_BUFFER_SIZE];
+    bool unchecked;
+    uint32_t instruction_budget;  // Instructions a thread runs per frame before it's suspended, 0 for no limit
+    bool deferred;  // Record draws and replay them when the frame is presented, see `draw_buffer.h`
+    char profile_path[FLAG_BUFFER_SIZE];  // Where profiling builds write every sequence count, see `profile_write`
 };
 
 
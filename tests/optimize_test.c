@@ -0,0 +1,346 @@
+/*
+    Differential tests for load-time optimization.
+
+    Random programs made of the instructions the optimizer models are run before and after `optimize_instructions`
+    by a small reference interpreter. The two runs must print the same characters, stop the same way, and leave the
+    same memory when they halt.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "instruction.h"
+#include "decode.h"
+#include "fixed_math.h"
+#include "optimize.h"
+
+#define TEST_PROGRAMS 20000
+#define TEST_MEMORY_SIZE 48
+#define TEST_MAX_INSTRUCTIONS 24
+#define TEST_MAX_OUTPUT 256
+#define TEST_STEP_LIMIT 4000
+
+#define RUN_HALTED 0
+#define RUN_ERROR 1
+#define RUN_TIMEOUT 2
+
+
+typedef struct {
+    int32_t memory[TEST_MEMORY_SIZE];
+    char output[TEST_MAX_OUTPUT];
+    size_t output_length;
+    int status;
+} RunResult;
+
+
+static uint64_t random_state = 0x2545f4914f6cdd1dULL;
+
+static uint32_t random_next(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t) (random_state >> 32);
+}
+
+static int32_t random_range(int32_t low, int32_t high) {
+    return low + (int32_t) (random_next() % (uint32_t) (high - low + 1));
+}
+
+// Values that are mostly small enough to be addresses, so indirect stores and bulk memory hit the reserved slots.
+static int32_t random_value(void) {
+    switch (random_next() % 8) {
+        case 0: return random_range(-3, 3);
+        case 1: return (int32_t) random_next();
+        default: return random_range(0, TEST_MEMORY_SIZE + 2);
+    }
+}
+
+
+static int32_t floored_mod(int32_t a, int32_t b) {
+    int32_t mod = a % b;
+    if (mod != 0 && (mod < 0) ^ (b < 0)) {
+        mod += b;
+    }
+    return mod;
+}
+
+static bool in_memory(int32_t address) {
+    return address >= 0 && address < TEST_MEMORY_SIZE;
+}
+
+// Run `instructions` from the first instruction, like the checked interpreter does.
+static void run_program(const DecodedInstruction *instructions, size_t instruction_count, const int32_t *memory, int step_limit, RunResult *result) {
+    memcpy(result->memory, memory, sizeof(result->memory));
+    result->output_length = 0;
+    int32_t *mem = result->memory;
+
+    size_t pc = 0;
+    for (int step = 0; step < step_limit; step++) {
+        const DecodedInstruction *ins = &instructions[pc];
+        if (ins->opcode == OP_HALT) {
+            result->status = RUN_HALTED;
+            return;
+        }
+
+        int32_t args[MAX_ARGUMENTS];
+        byte argument_count = decoded_argument_count(ins->opcode);
+        for (byte i = 0; i < argument_count; i++) {
+            args[i] = ins->operands[i];
+            if (ins->modes & (1 << i)) {
+                if (!in_memory(args[i])) {
+                    result->status = RUN_ERROR;
+                    return;
+                }
+                args[i] = mem[args[i]];
+            }
+        }
+
+        bool stores = writes_destination(ins->opcode);
+        int32_t value = 0;
+        switch (ins->opcode) {
+            case OP_MOV: value = args[1]; break;
+            case OP_MOVP:
+                if (!in_memory(args[1])) {
+                    result->status = RUN_ERROR;
+                    return;
+                }
+                value = mem[args[1]];
+                break;
+            case OP_ADD: value = (int32_t) ((uint32_t) args[1] + (uint32_t) args[2]); break;
+            case OP_SUB: value = (int32_t) ((uint32_t) args[1] - (uint32_t) args[2]); break;
+            case OP_MUL: value = (int32_t) ((uint32_t) args[1] * (uint32_t) args[2]); break;
+            case OP_DIV: case OP_MOD:
+                if (args[2] == 0 || (args[1] == INT32_MIN && args[2] == -1)) {
+                    result->status = RUN_ERROR;
+                    return;
+                }
+                value = ins->opcode == OP_DIV ? args[1] / args[2] : floored_mod(args[1], args[2]);
+                break;
+            case OP_DIV_POW2: value = div_pow2(args[1], args[2]); break;
+            case OP_MOD_POW2: value = args[1] & args[2]; break;
+            case OP_LESS: value = args[1] < args[2]; break;
+            case OP_EQUAL: value = args[1] == args[2]; break;
+            case OP_NOT: value = !args[1]; break;
+            case OP_AND: value = args[1] & args[2]; break;
+            case OP_OR: value = args[1] | args[2]; break;
+            case OP_XOR: value = args[1] ^ args[2]; break;
+            case OP_SHL: value = shift_left(args[1], args[2]); break;
+            case OP_SHR: value = shift_right(args[1], args[2]); break;
+            case OP_SAR: value = shift_right_arithmetic(args[1], args[2]); break;
+            case OP_ABS: value = fixed_abs(args[1]); break;
+            case OP_MIN: value = fixed_min(args[1], args[2]); break;
+            case OP_MAX: value = fixed_max(args[1], args[2]); break;
+            case OP_PUTC:
+                if (result->output_length < TEST_MAX_OUTPUT) {
+                    result->output[result->output_length++] = (char) args[0];
+                }
+                break;
+            case OP_MEMFILL: case OP_MEMCOPY:
+                if (args[2] <= 0) {
+                    break;
+                }
+                if (!in_memory(args[0]) || args[2] > TEST_MEMORY_SIZE - args[0] || (ins->opcode == OP_MEMCOPY && (!in_memory(args[1]) || args[2] > TEST_MEMORY_SIZE - args[1]))) {
+                    result->status = RUN_ERROR;
+                    return;
+                }
+                if (ins->opcode == OP_MEMFILL) {
+                    for (int32_t i = 0; i < args[2]; i++) {
+                        mem[args[0] + i] = args[1];
+                    }
+                }
+                else {
+                    memmove(&mem[args[0]], &mem[args[1]], sizeof(int32_t) * args[2]);
+                }
+                break;
+            case OP_JMP:
+                if (args[1]) {
+                    bool in_program = !(ins->modes & 1) || (uint32_t) args[0] < instruction_count;
+                    pc = in_program ? (size_t) args[0] : instruction_count;
+                    continue;
+                }
+                break;
+            default:
+                fprintf(stderr, "Unexpected opcode %d\n", ins->opcode);
+                exit(1);
+        }
+
+        if (stores) {
+            if (!in_memory(args[0])) {
+                result->status = RUN_ERROR;
+                return;
+            }
+            mem[args[0]] = value;
+        }
+        pc++;
+    }
+    result->status = RUN_TIMEOUT;
+}
+
+
+static const byte TEST_OPCODES[] = {
+    OP_MOV, OP_MOV, OP_MOV, OP_MOVP, OP_ADD, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_LESS, OP_EQUAL, OP_NOT,
+    OP_JMP, OP_JMP, OP_PUTC, OP_PUTC, OP_AND, OP_OR, OP_XOR, OP_SHL, OP_SHR, OP_SAR, OP_ABS, OP_MIN, OP_MAX,
+    OP_MEMFILL, OP_MEMCOPY
+};
+
+static void random_instruction(DecodedInstruction *ins, size_t instruction_count) {
+    *ins = (DecodedInstruction) {TEST_OPCODES[random_next() % sizeof(TEST_OPCODES)], 0, SUPER_NONE, IDIOM_NONE, false, false, {0}};
+    byte argument_count = ARGUMENT_COUNTS[ins->opcode];
+    for (byte i = 0; i < argument_count; i++) {
+        if (random_next() % 2) {
+            ins->modes |= 1 << i;
+            ins->operands[i] = random_range(0, TEST_MEMORY_SIZE - 1);
+        }
+        else {
+            ins->operands[i] = random_value();
+        }
+    }
+
+    bool stores = writes_destination(ins->opcode);
+    if (stores && random_next() % 4) {
+        // Mostly literal destinations, including the reserved slots
+        ins->modes &= ~1;
+        ins->operands[0] = random_range(0, TEST_MEMORY_SIZE - 1);
+    }
+    if (ins->opcode == OP_MOVP && random_next() % 2) {
+        ins->modes &= ~2;
+        ins->operands[1] = random_range(0, TEST_MEMORY_SIZE - 1);
+    }
+    if (ins->opcode == OP_JMP && (random_next() % 4 || !(ins->modes & 1))) {
+        // Decoding points literal jumps outside of the program at the halt instruction
+        ins->modes &= ~1;
+        ins->operands[0] = random_range(0, instruction_count);
+    }
+    if (ins->opcode == OP_PUTC && !(ins->modes & 1)) {
+        ins->operands[0] = random_range('a', 'z');
+    }
+}
+
+
+static bool same_result(const RunResult *a, const RunResult *b) {
+    if (a->status != b->status || a->output_length != b->output_length || memcmp(a->output, b->output, a->output_length) != 0) {
+        return false;
+    }
+    return a->status != RUN_HALTED || memcmp(a->memory, b->memory, sizeof(a->memory)) == 0;
+}
+
+static void print_program(const DecodedInstruction *instructions, size_t instruction_count) {
+    for (size_t i = 0; i < instruction_count; i++) {
+        const DecodedInstruction *ins = &instructions[i];
+        printf("    %zu: %s", i, ins->opcode < AMOUNT_INSTRUCTIONS ? INSTRUCTIONS[ins->opcode] : "(internal)");
+        for (byte j = 0; j < decoded_argument_count(ins->opcode); j++) {
+            printf(" %s%d", ins->modes & (1 << j) ? "$" : "", ins->operands[j]);
+        }
+        printf("\n");
+    }
+}
+
+/*
+Optimize `instructions` and compare runs of both versions. `instructions` must have room for the halt instruction.
+Returns 1 if the runs differ, and 0 if they match or the original program doesn't stop.
+*/
+static int check_program(DecodedInstruction *instructions, size_t instruction_count, const int32_t *memory, const char *name) {
+    instructions[instruction_count] = (DecodedInstruction) {OP_HALT, 0, SUPER_NONE, IDIOM_NONE, false, true, {0}};
+    size_t size = sizeof(DecodedInstruction) * (instruction_count+1);
+    DecodedInstruction *original = malloc(size);
+    DecodedInstruction *optimized = malloc(size);
+    if (!original || !optimized) {
+        fprintf(stderr, "Failed to allocate test program\n");
+        exit(1);
+    }
+    memcpy(original, instructions, size);
+    memcpy(optimized, instructions, size);
+
+    ProgramInfo program_info = {TEST_MEMORY_SIZE, memory[9], memory[10], memory[11], 0, -1};
+    size_t decoded_count;
+    optimized = optimize_instructions(optimized, instruction_count, &program_info, &decoded_count);
+    if (!optimized) {
+        fprintf(stderr, "Failed to optimize test program\n");
+        exit(1);
+    }
+
+    RunResult expected, actual;
+    run_program(original, instruction_count, memory, TEST_STEP_LIMIT, &expected);
+    int failed = 0;
+    if (expected.status != RUN_TIMEOUT) {
+        // Optimized code adds a jump into it at each entry block it reaches
+        run_program(optimized, instruction_count, memory, TEST_STEP_LIMIT * 2, &actual);
+        if (!same_result(&expected, &actual)) {
+            printf("%s: optimized program differs\n", name);
+            print_program(original, instruction_count);
+            printf("  expected status %d, output \"%.*s\"\n", expected.status, (int) expected.output_length, expected.output);
+            printf("  actual status %d, output \"%.*s\"\n", actual.status, (int) actual.output_length, actual.output);
+            failed = 1;
+        }
+    }
+    free(original);
+    free(optimized);
+    return failed;
+}
+
+
+static void initial_memory(int32_t *memory) {
+    memset(memory, 0, sizeof(int32_t) * TEST_MEMORY_SIZE);
+    for (int i = 0; i < 8; i++) {
+        memory[i] = random_next() % 2;
+    }
+    memory[8] = TEST_MEMORY_SIZE;
+    memory[9] = 16;
+    memory[10] = 12;
+    memory[11] = 60;
+    memory[12] = random_range(0, 50);
+}
+
+
+// Programs that once ran differently after optimization.
+static int check_regressions(void) {
+    int32_t memory[TEST_MEMORY_SIZE];
+    initial_memory(memory);
+    int failed = 0;
+
+    // A reserved slot written through a pointer isn't a constant
+    DecodedInstruction indirect_store[] = {
+        {OP_MOV, 0, SUPER_NONE, IDIOM_NONE, false, false, {20, 9}},
+        {OP_MOV, 0x1, SUPER_NONE, IDIOM_NONE, false, false, {20, 0}},
+        {OP_ADD, 0x2, SUPER_NONE, IDIOM_NONE, false, false, {30, 9, 48}},
+        {OP_PUTC, 0x1, SUPER_NONE, IDIOM_NONE, false, false, {30}},
+        {0}
+    };
+    failed += check_program(indirect_store, 4, memory, "indirect store to a reserved slot");
+
+    // Or one written by `memfill`
+    DecodedInstruction fill[] = {
+        {OP_MEMFILL, 0, SUPER_NONE, IDIOM_NONE, false, false, {0, 0, 20}},
+        {OP_ADD, 0x2, SUPER_NONE, IDIOM_NONE, false, false, {30, 9, 48}},
+        {OP_PUTC, 0x1, SUPER_NONE, IDIOM_NONE, false, false, {30}},
+        {0}
+    };
+    failed += check_program(fill, 3, memory, "memfill over the reserved slots");
+    return failed;
+}
+
+
+int main(void) {
+    int failed = check_regressions();
+
+    DecodedInstruction instructions[TEST_MAX_INSTRUCTIONS+1];
+    int32_t memory[TEST_MEMORY_SIZE];
+    for (int i = 0; i < TEST_PROGRAMS && failed < 10; i++) {
+        size_t instruction_count = random_range(1, TEST_MAX_INSTRUCTIONS);
+        for (size_t j = 0; j < instruction_count; j++) {
+            random_instruction(&instructions[j], instruction_count);
+        }
+        initial_memory(memory);
+
+        char name[32];
+        snprintf(name, sizeof(name), "program %d", i);
+        failed += check_program(instructions, instruction_count, memory, name);
+    }
+
+    if (failed) {
+        printf("%d optimizer tests failed\n", failed);
+        return 1;
+    }
+    printf("Optimizer tests passed\n");
+    return 0;
+}